@@ -0,0 +1,316 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cctype>
+#include <cstring>
+#include "AssetFormats.h"
+
+namespace
+{
+  template <typename T>
+  void writePod(std::ofstream& out, const T& value)
+  {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  bool readPod(std::ifstream& in, T& value)
+  {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+  }
+
+  void writeString(std::ofstream& out, const std::string& str)
+  {
+    writePod(out, static_cast<uint32_t>(str.size()));
+    out.write(str.data(), str.size());
+  }
+
+  bool readString(std::ifstream& in, std::string& str)
+  {
+    uint32_t length{};
+    if (!readPod(in, length)) return false;
+    str.resize(length);
+    return length == 0 || static_cast<bool>(in.read(&str[0], length));
+  }
+
+  bool isImageExtension(const std::string& extension)
+  {
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".tga" || extension == ".bmp";
+  }
+}
+
+std::string getCookedPath(const std::string& sourcePath, const std::string& cookedDirectory)
+{
+  std::filesystem::path relative(sourcePath);
+  relative = relative.lexically_normal();
+
+  // the cooked tree mirrors the source tree, so drop the leading "./"
+  std::string extension = relative.extension().string();
+  for (char& c : extension) c = static_cast<char>(tolower(c));
+
+  if (extension == ".obj")
+  {
+    relative.replace_extension(".flymesh");
+  }
+  else if (isImageExtension(extension))
+  {
+    relative.replace_extension(".flytex");
+  }
+
+  return (std::filesystem::path(cookedDirectory) / relative).generic_string();
+}
+
+bool isCookedAssetUpToDate(const std::string& sourcePath, const std::string& cookedPath)
+{
+  std::error_code error{};
+  const std::filesystem::file_time_type cookedTime = std::filesystem::last_write_time(cookedPath, error);
+  if (error) return false;
+
+  // the source may not be shipped at all. Then the cooked file is all we have
+  const std::filesystem::file_time_type sourceTime = std::filesystem::last_write_time(sourcePath, error);
+  if (error) return true;
+
+  return cookedTime >= sourceTime;
+}
+
+bool writeFlyMesh(const std::string& filename, const MeshData& mesh, uint64_t sourceHash)
+{
+  std::error_code error{};
+  std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), error);
+
+  std::ofstream out(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    std::cerr << "Cannot write " << filename << std::endl;
+    return false;
+  }
+
+  FlyMeshHeader header{};
+  header.sourceHash = sourceHash;
+  header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+  header.sectionCount = static_cast<uint32_t>(mesh.sections.size());
+  header.libraryCount = static_cast<uint32_t>(mesh.materialLibraries.size());
+  writePod(out, header);
+
+  for (const std::string& library : mesh.materialLibraries)
+  {
+    writeString(out, library);
+  }
+
+  for (const MeshSection& section : mesh.sections)
+  {
+    writePod(out, section.firstIndex);
+    writePod(out, section.indexCount);
+    writeString(out, section.material);
+  }
+
+  out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+  out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+
+  return static_cast<bool>(out);
+}
+
+bool readFlyMesh(const std::string& filename, MeshData& mesh)
+{
+  mesh = MeshData{};
+
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in)
+  {
+    std::cerr << "Cannot open " << filename << std::endl;
+    return false;
+  }
+
+  FlyMeshHeader header{};
+  if (!readPod(in, header) || header.magic != FLYMESH_MAGIC || header.version != FLYMESH_VERSION)
+  {
+    std::cerr << filename << " is not a .flymesh file of version " << FLYMESH_VERSION << std::endl;
+    return false;
+  }
+
+  mesh.materialLibraries.resize(header.libraryCount);
+  for (std::string& library : mesh.materialLibraries)
+  {
+    if (!readString(in, library)) return false;
+  }
+
+  mesh.sections.resize(header.sectionCount);
+  for (MeshSection& section : mesh.sections)
+  {
+    if (!readPod(in, section.firstIndex) || !readPod(in, section.indexCount) || !readString(in, section.material)) return false;
+  }
+
+  mesh.vertices.resize(header.vertexCount);
+  mesh.indices.resize(header.indexCount);
+  in.read(reinterpret_cast<char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+  in.read(reinterpret_cast<char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+
+  if (!in)
+  {
+    std::cerr << filename << " is truncated" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool writeFlyTex(const std::string& filename, const ImageData& image, uint64_t sourceHash)
+{
+  if (image.mips.empty()) return false;
+
+  std::error_code error{};
+  std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), error);
+
+  std::ofstream out(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    std::cerr << "Cannot write " << filename << std::endl;
+    return false;
+  }
+
+  FlyTexHeader header{};
+  header.sourceHash = sourceHash;
+  header.width = image.mips[0].width;
+  header.height = image.mips[0].height;
+  header.format = static_cast<uint32_t>(image.format);
+  header.mipCount = static_cast<uint32_t>(image.mips.size());
+  writePod(out, header);
+
+  // level table first, so a reader can seek to (or map) any level without reading the ones before it
+  uint64_t offset = sizeof(FlyTexHeader) + sizeof(FlyTexLevel) * image.mips.size();
+  for (const MipLevel& mip : image.mips)
+  {
+    FlyTexLevel level{};
+    level.width = mip.width;
+    level.height = mip.height;
+    level.offset = offset;
+    level.size = mip.pixels.size();
+    writePod(out, level);
+    offset += level.size;
+  }
+
+  for (const MipLevel& mip : image.mips)
+  {
+    out.write(reinterpret_cast<const char*>(mip.pixels.data()), mip.pixels.size());
+  }
+
+  return static_cast<bool>(out);
+}
+
+bool readFlyTex(const std::string& filename, ImageData& image)
+{
+  image = ImageData{};
+
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in)
+  {
+    std::cerr << "Cannot open " << filename << std::endl;
+    return false;
+  }
+
+  FlyTexHeader header{};
+  if (!readPod(in, header) || header.magic != FLYTEX_MAGIC || header.version != FLYTEX_VERSION)
+  {
+    std::cerr << filename << " is not a .flytex file of version " << FLYTEX_VERSION << std::endl;
+    return false;
+  }
+
+  std::vector<FlyTexLevel> levels(header.mipCount);
+  for (FlyTexLevel& level : levels)
+  {
+    if (!readPod(in, level)) return false;
+  }
+
+  image.format = static_cast<TextureFormat>(header.format);
+  image.mips.resize(header.mipCount);
+  for (uint32_t i = 0; i < header.mipCount; i++)
+  {
+    MipLevel& mip = image.mips[i];
+    mip.width = levels[i].width;
+    mip.height = levels[i].height;
+    mip.pixels.resize(static_cast<size_t>(levels[i].size));
+
+    in.seekg(static_cast<std::streamoff>(levels[i].offset));
+    in.read(reinterpret_cast<char*>(mip.pixels.data()), mip.pixels.size());
+  }
+
+  if (!in)
+  {
+    std::cerr << filename << " is truncated" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool readFlyTexHeader(const std::string& filename, FlyTexHeader& header)
+{
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in) return false;
+
+  return readPod(in, header) && header.magic == FLYTEX_MAGIC && header.version == FLYTEX_VERSION;
+}
+
+bool mapFlyTex(const std::string& filename, MappedFile& file, ImageView& image)
+{
+  image = ImageView{};
+
+  if (!file.open(filename))
+  {
+    std::cerr << "Cannot map " << filename << std::endl;
+    return false;
+  }
+
+  // the level table comes right after the header, so the whole layout is known from the first few hundred bytes
+  FlyTexHeader header{};
+  const bool hasHeader = file.getSize() >= sizeof(FlyTexHeader);
+  if (hasHeader) memcpy(&header, file.getData(), sizeof(FlyTexHeader));
+
+  if (!hasHeader || header.magic != FLYTEX_MAGIC || header.version != FLYTEX_VERSION)
+  {
+    std::cerr << filename << " is not a .flytex file of version " << FLYTEX_VERSION << std::endl;
+    file.close();
+    return false;
+  }
+
+  const size_t tableEnd = sizeof(FlyTexHeader) + sizeof(FlyTexLevel) * static_cast<size_t>(header.mipCount);
+  if (file.getSize() < tableEnd)
+  {
+    std::cerr << filename << " is truncated" << std::endl;
+    file.close();
+    return false;
+  }
+
+  image.format = static_cast<TextureFormat>(header.format);
+  image.mips.resize(header.mipCount);
+  for (uint32_t i = 0; i < header.mipCount; i++)
+  {
+    // the table isn't necessarily aligned for uint64_t reads, so copy each entry out
+    FlyTexLevel level{};
+    memcpy(&level, file.getData() + sizeof(FlyTexHeader) + sizeof(FlyTexLevel) * i, sizeof(FlyTexLevel));
+
+    if (level.offset > file.getSize() || level.size > file.getSize() - level.offset)
+    {
+      std::cerr << filename << " is truncated" << std::endl;
+      image = ImageView{};
+      file.close();
+      return false;
+    }
+
+    image.mips[i] = { level.width, level.height, file.getData() + level.offset, static_cast<size_t>(level.size) };
+  }
+  return true;
+}
+
+bool readCookedSourceHash(const std::string& filename, uint64_t& sourceHash)
+{
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in) return false;
+
+  // both headers start with magic, version, sourceHash
+  uint32_t magic{}, version{};
+  if (!readPod(in, magic) || !readPod(in, version) || !readPod(in, sourceHash)) return false;
+
+  if (magic == FLYMESH_MAGIC) return version == FLYMESH_VERSION;
+  if (magic == FLYTEX_MAGIC) return version == FLYTEX_VERSION;
+  return false;
+}
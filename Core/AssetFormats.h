@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef ASSET_FORMATS_H
+#define ASSET_FORMATS_H
+
+#include <stdint.h>
+#include <string>
+#include "MeshData.h"
+#include "ImageData.h"
+#include "MappedFile.h"
+
+// Runtime formats written by the offline cooker (Tools/flycook)
+// They are plain binary dumps of what we upload to the GPU, so loading them is just I/O
+//
+// .flymesh: FlyMeshHeader, library names, sections, vertices, indices
+//           (strings are stored as uint32 length + characters)
+// .flytex:  FlyTexHeader, FlyTexLevel table (one per mip), mip data. Images are already flipped for OpenGL
+
+// where the cooker puts its output. Mirrors the source tree: ./Models/crate.obj -> ./Cooked/Models/crate.flymesh
+constexpr const char* COOKED_DIRECTORY = "./Cooked/";
+
+constexpr uint32_t FLYMESH_MAGIC = 0x4D594C46; // "FLYM"
+constexpr uint32_t FLYMESH_VERSION = 1;
+
+constexpr uint32_t FLYTEX_MAGIC = 0x54594C46; // "FLYT"
+constexpr uint32_t FLYTEX_VERSION = 1;
+
+struct FlyMeshHeader
+{
+  uint32_t magic{ FLYMESH_MAGIC };
+  uint32_t version{ FLYMESH_VERSION };
+  uint64_t sourceHash{}; // hash of the source file and cooker settings. The cooker skips assets whose hash didn't change
+  uint32_t vertexCount{};
+  uint32_t indexCount{};
+  uint32_t sectionCount{};
+  uint32_t libraryCount{};
+};
+
+struct FlyTexHeader
+{
+  uint32_t magic{ FLYTEX_MAGIC };
+  uint32_t version{ FLYTEX_VERSION };
+  uint64_t sourceHash{};
+  uint32_t width{};
+  uint32_t height{};
+  uint32_t format{}; // TextureFormat
+  uint32_t mipCount{};
+};
+
+// where a mip level lives in the file
+struct FlyTexLevel
+{
+  uint32_t width{};
+  uint32_t height{};
+  uint64_t offset{}; // from the start of the file
+  uint64_t size{};   // in bytes
+};
+
+static_assert(sizeof(Vertex) == 5 * sizeof(float), "Vertex is written to .flymesh as 5 tightly packed floats");
+static_assert(sizeof(FlyMeshHeader) == 32, "FlyMeshHeader layout is part of the file format");
+static_assert(sizeof(FlyTexHeader) == 32, "FlyTexHeader layout is part of the file format");
+static_assert(sizeof(FlyTexLevel) == 24, "FlyTexLevel layout is part of the file format");
+
+// "./Textures/crate.jpg" -> "./Cooked/Textures/crate.flytex"
+// sourcePath is relative to the working directory (like all asset paths in main())
+std::string getCookedPath(const std::string& sourcePath, const std::string& cookedDirectory = COOKED_DIRECTORY);
+
+// true if cookedPath exists and isn't older than sourcePath. The runtime uses it to decide between cooked and source assets
+bool isCookedAssetUpToDate(const std::string& sourcePath, const std::string& cookedPath);
+
+bool writeFlyMesh(const std::string& filename, const MeshData& mesh, uint64_t sourceHash);
+bool readFlyMesh(const std::string& filename, MeshData& mesh);
+
+bool writeFlyTex(const std::string& filename, const ImageData& image, uint64_t sourceHash);
+bool readFlyTex(const std::string& filename, ImageData& image);
+
+// only the header, to learn the size and format without reading the levels
+bool readFlyTexHeader(const std::string& filename, FlyTexHeader& header);
+
+// map a .flytex instead of reading it. The levels of image point into file, so they are valid while file stays open
+bool mapFlyTex(const std::string& filename, MappedFile& file, ImageView& image);
+
+// read only the source hash from a cooked file. Returns false if the file is missing or has another version
+bool readCookedSourceHash(const std::string& filename, uint64_t& sourceHash);
+
+#endif // !ASSET_FORMATS_H
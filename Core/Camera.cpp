@@ -1,5 +1,6 @@
 #include "Camera.h"
 #include "glm/gtx/transform.hpp"
+#include "glm/gtc/matrix_inverse.hpp"
 
 Camera::Camera()
   :mPostion(glm::vec3(0.0f, 0.0f, 0.0f)),
@@ -9,16 +10,111 @@ Camera::Camera()
   WORLD_UP(0.0f, 1.0f, 0.0f),
   mYaw(glm::pi<float>()),
   mPitch(0.0f),
-  mFOV(45.0f)
+  mFOV(45.0f),
+  mAspect(4.0f / 3.0f),
+  mNearPlane(0.1f),
+  mFarPlane(100.0f)
 {
 
 }
 
+bool Camera::updateMatrices() const
+{
+  if (mDirty == 0) return false;
+
+  if (mDirty & VIEW_DIRTY)
+  {
+    // lookAt builds a rotation and a translation only, so the cheap affine inverse is exact
+    mView = glm::lookAt(mPostion, mTarPos, mUp);
+    mInverseView = glm::affineInverse(mView);
+  }
+
+  if (mDirty & PROJECTION_DIRTY)
+  {
+    mProjection = glm::perspective(glm::radians(mFOV), mAspect, mNearPlane, mFarPlane);
+    mInverseProjection = glm::inverse(mProjection);
+  }
+
+  mViewProjection = mProjection * mView;
+  mInverseViewProjection = mInverseView * mInverseProjection;
+  mFrustum = extractFrustum(mViewProjection);
+
+  mDirty = 0;
+  mVersion++;
+  return true;
+}
+
+const glm::mat4& Camera::getViewMatrix() const
+{
+  updateMatrices();
+  return mView;
+}
+
+const glm::mat4& Camera::getProjectionMatrix() const
+{
+  updateMatrices();
+  return mProjection;
+}
+
+const glm::mat4& Camera::getViewProjectionMatrix() const
+{
+  updateMatrices();
+  return mViewProjection;
+}
+
+const glm::mat4& Camera::getInverseViewMatrix() const
+{
+  updateMatrices();
+  return mInverseView;
+}
+
+const glm::mat4& Camera::getInverseProjectionMatrix() const
+{
+  updateMatrices();
+  return mInverseProjection;
+}
+
+const glm::mat4& Camera::getInverseViewProjectionMatrix() const
+{
+  updateMatrices();
+  return mInverseViewProjection;
+}
+
+const Frustum& Camera::getFrustum() const
+{
+  updateMatrices();
+  return mFrustum;
+}
 
-glm::mat4 Camera::getViewMatrix() const
+void Camera::setPerspective(float FOV, float aspect, float nearPlane, float farPlane)
 {
-  // just return a view matrix for the camera
-  return glm::lookAt(mPostion, mTarPos, mUp);
+  mFOV = FOV;
+  mAspect = aspect;
+  mNearPlane = nearPlane;
+  mFarPlane = farPlane;
+  invalidateProjection();
+}
+
+void Camera::setFOV(float FOV)
+{
+  if (FOV == mFOV) return;
+  mFOV = FOV;
+  invalidateProjection();
+}
+
+void Camera::setAspect(float aspect)
+{
+  // a minimized window reports 0 x 0. Keep the last aspect rather than dividing by zero
+  if (aspect == mAspect || !(aspect > 0.0f)) return;
+  mAspect = aspect;
+  invalidateProjection();
+}
+
+void Camera::setClipPlanes(float nearPlane, float farPlane)
+{
+  mNearPlane = nearPlane;
+  mFarPlane = farPlane;
+  invalidateProjection();
 }
 
 
@@ -45,11 +141,13 @@ void OrbitCamera::rotate(float yaw, float pitch)
 void OrbitCamera::setLookAt(const glm::vec3 & target)
 {
   mTarPos = target;
+  updateCameraVectors();
 }
 
 void OrbitCamera::setRadius(float radius)
 {
   mRadius = glm::clamp(radius, 2.0f, 80.0f);
+  updateCameraVectors();
 }
 
 void OrbitCamera::updateCameraVectors()
@@ -62,7 +160,7 @@ void OrbitCamera::updateCameraVectors()
   mPostion.y = mTarPos.y + mRadius * sinf(mPitch);
   mPostion.z = mTarPos.z + mRadius * cosf(mPitch) * cosf(mYaw);
 
-
+  invalidateView();
 }
 
 FPSCamera::FPSCamera(glm::vec3 position, float yaw, float pitch)
@@ -70,10 +168,16 @@ FPSCamera::FPSCamera(glm::vec3 position, float yaw, float pitch)
   mPostion = position;
   mYaw = yaw;
   mPitch = pitch;
+
+  // look, right and up are needed before the first rotate or move
+  updateCameraVectors();
 }
 
 void FPSCamera::rotate(float yaw, float pitch)
 {
+  // the cursor didn't move. Keep the cached view
+  if (yaw == 0.0f && pitch == 0.0f) return;
+
   // convert to radians first because glm supports rads only
   // and incrementally sets the postion
   mYaw += glm::radians(yaw);
@@ -91,6 +195,7 @@ void FPSCamera::rotate(float yaw, float pitch)
 void FPSCamera::setPostion(const glm::vec3 & position)
 {
   mPostion = position;
+  updateCameraVectors();
 }
 
 void FPSCamera::move(const glm::vec3 & offsetPos)
@@ -125,4 +230,23 @@ void FPSCamera::updateCameraVectors()
 
   // update Target Position based on calculations
   mTarPos = mPostion + mLook; // positon of the camera added to a camera look vector
+
+  invalidateView();
+}
+
+// Camera Set
+size_t CameraSet::add(Camera* camera)
+{
+  mCameras.push_back(camera);
+  return mCameras.size() - 1;
+}
+
+uint32_t CameraSet::update() const
+{
+  uint32_t updated{};
+  for (const Camera* camera : mCameras)
+  {
+    if (camera->updateMatrices()) updated++;
+  }
+  return updated;
 }
@@ -2,20 +2,48 @@
 
 #ifndef CAMERA_H
 #define CAMERA_H
+#include <stdint.h>
+#include <vector>
 #include "glm/glm.hpp"
 #include "glm/gtc/constants.hpp"
+#include "Culling.h"
 
 // Abstract Camera Class
 // a main purpose of this class to return a view matrix to the program
+//
+// The camera owns its projection too. View, projection, view * projection, their inverses and the frustum are
+// cached and only rebuilt when something they depend on changed: moving or rotating dirties the view, FOV,
+// aspect and clip planes dirty the projection. Getters rebuild what's dirty on first use; CameraSet::update()
+// rebuilds a batch of cameras at one point in the frame so everything after it only reads
 class Camera
 {
 public:
-  glm::mat4 getViewMatrix() const;
+  const glm::mat4& getViewMatrix() const;
+  const glm::mat4& getProjectionMatrix() const;
+  const glm::mat4& getViewProjectionMatrix() const;
+  const glm::mat4& getInverseViewMatrix() const;
+  const glm::mat4& getInverseProjectionMatrix() const;
+  const glm::mat4& getInverseViewProjectionMatrix() const;
+
+  // world space planes of what the camera sees. For culling (Culling.h)
+  const Frustum& getFrustum() const;
+
+  // rebuild the dirty matrices now. Returns true if anything was rebuilt
+  bool updateMatrices() const;
+
+  // bumped every time the matrices are rebuilt. Consumers can keep the last version they saw and skip
+  // their own work (shadow fitting, uploads) while it doesn't change
+  uint32_t getVersion() const { return mVersion; };
+
   virtual void rotate(float yaw, float pitch) {}; // in degrees
   virtual void setPostion(const glm::vec3& position) {};
   virtual void move(const glm::vec3& offsetPos) {};
 
-  void setFOV(const float FOV) { mFOV = FOV; };
+  // projection. FOV is vertical, in degrees. Aspect is width / height
+  void setPerspective(float FOV, float aspect, float nearPlane, float farPlane);
+  void setFOV(float FOV);
+  void setAspect(float aspect);
+  void setClipPlanes(float nearPlane, float farPlane);
 
   // getters
   const glm::vec3& getLook() const { return mLook; };
@@ -23,11 +51,18 @@ public:
   const glm::vec3& getUp() const { return mUp; };
   const glm::vec3& getPosition() const { return mPostion; };
   float getFOV() const { return mFOV; }; // in degrees  
+  float getAspect() const { return mAspect; };
+  float getNearPlane() const { return mNearPlane; };
+  float getFarPlane() const { return mFarPlane; };
 
 protected:
 
   Camera();
 
+  // derived cameras call these after changing the vectors or the projection parameters
+  void invalidateView() { mDirty |= VIEW_DIRTY; };
+  void invalidateProjection() { mDirty |= PROJECTION_DIRTY; };
+
   // data for lookat() that creates a 4x4 matrix for the camera
   glm::vec3 mPostion{};
   glm::vec3 mTarPos{};
@@ -42,6 +77,25 @@ protected:
 
   // camera parameters
   float mFOV{};
+  float mAspect{};
+  float mNearPlane{};
+  float mFarPlane{};
+
+private:
+
+  static constexpr uint8_t VIEW_DIRTY = 1 << 0;
+  static constexpr uint8_t PROJECTION_DIRTY = 1 << 1;
+
+  // cached results. Mutable so const getters can rebuild them lazily
+  mutable glm::mat4 mView{};
+  mutable glm::mat4 mProjection{};
+  mutable glm::mat4 mViewProjection{};
+  mutable glm::mat4 mInverseView{};
+  mutable glm::mat4 mInverseProjection{};
+  mutable glm::mat4 mInverseViewProjection{};
+  mutable Frustum mFrustum{};
+  mutable uint32_t mVersion{};
+  mutable uint8_t mDirty = VIEW_DIRTY | PROJECTION_DIRTY;
 };
 
 class FPSCamera : public Camera
@@ -80,6 +134,28 @@ private:
 
 };
 
+// Cameras that are rendered from in the same frame: the main view, shadow cascades, reflections, split screen
+// update() rebuilds the dirty ones in one pass before any of them is used, so culling and uniform uploads (possibly
+// on other threads) only read cached matrices. The set doesn't own the cameras
+class CameraSet
+{
+public:
+
+  // index of the camera in the set
+  size_t add(Camera* camera);
+  void clear() { mCameras.clear(); };
+
+  size_t size() const { return mCameras.size(); };
+  Camera& operator[](size_t index) const { return *mCameras[index]; };
+
+  // returns the number of cameras whose matrices changed
+  uint32_t update() const;
+
+private:
+
+  std::vector<Camera*> mCameras{};
+};
+
 
 
 #endif // !CAMERA_H
@@ -0,0 +1,369 @@
+#include <bitset>
+#include <cmath>
+#include <immintrin.h>
+#include "Culling.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// MSVC lets every function use AVX intrinsics. GCC and clang only compile them in functions marked for AVX
+// either way the AVX kernels only run after isCullPathSupported() said the CPU has it
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX __attribute__((target("avx")))
+#else
+#define TARGET_AVX
+#endif
+
+namespace
+{
+  constexpr int PLANE_COUNT = 6;
+
+  bool cpuHasAvx()
+  {
+#if defined(_MSC_VER)
+    // the CPU must have AVX and the OS must save the YMM registers on context switches (OSXSAVE + XCR0 bits 1 and 2)
+    int info[4]{};
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx");
+#else
+    return false;
+#endif
+  }
+
+  CullPath resolvePath(CullPath path)
+  {
+    if (path == CullPath::BEST) return isCullPathSupported(CullPath::AVX) ? CullPath::AVX : CullPath::SSE;
+    if (path == CullPath::AVX && !isCullPathSupported(CullPath::AVX)) return CullPath::SSE;
+    return path;
+  }
+
+  size_t countVisible(const std::vector<uint64_t>& visible)
+  {
+    size_t count{};
+    for (uint64_t word : visible) count += std::bitset<64>(word).count();
+    return count;
+  }
+
+  // scalar versions. The SIMD kernels use them for the objects that don't fill a whole register
+  // the sums are grouped like in the SIMD kernels, so all paths round the same way and agree on every object
+  bool isSphereVisible(const Frustum& frustum, float x, float y, float z, float radius)
+  {
+    for (const glm::vec4& plane : frustum.planes)
+    {
+      const float distance = (plane.x * x + plane.y * y) + (plane.z * z + plane.w);
+      if (!(distance >= -radius)) return false;
+    }
+    return true;
+  }
+
+  bool isAabbVisible(const Frustum& frustum, float cx, float cy, float cz, float ex, float ey, float ez)
+  {
+    // the box is outside if even its corner furthest along the normal is behind the plane
+    for (const glm::vec4& plane : frustum.planes)
+    {
+      const float distance = (plane.x * cx + plane.y * cy) + (plane.z * cz + plane.w);
+      const float extent = (fabsf(plane.x) * ex + fabsf(plane.y) * ey) + fabsf(plane.z) * ez;
+      if (!(distance + extent >= 0.0f)) return false;
+    }
+    return true;
+  }
+
+  void cullSpheresScalar(const Frustum& frustum, const SphereBounds& bounds, size_t first, uint64_t* visible)
+  {
+    for (size_t i = first; i < bounds.size(); i++)
+    {
+      if (isSphereVisible(frustum, bounds.x[i], bounds.y[i], bounds.z[i], bounds.radius[i])) visible[i >> 6] |= 1ull << (i & 63);
+    }
+  }
+
+  void cullAabbsScalar(const Frustum& frustum, const AabbBounds& bounds, size_t first, uint64_t* visible)
+  {
+    for (size_t i = first; i < bounds.size(); i++)
+    {
+      if (isAabbVisible(frustum, bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i], bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]))
+      {
+        visible[i >> 6] |= 1ull << (i & 63);
+      }
+    }
+  }
+
+  // 4 objects per iteration. Returns the first object it didn't handle
+  size_t cullSpheresSSE(const Frustum& frustum, const SphereBounds& bounds, uint64_t* visible)
+  {
+    __m128 a[PLANE_COUNT], b[PLANE_COUNT], c[PLANE_COUNT], d[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; p++)
+    {
+      a[p] = _mm_set1_ps(frustum.planes[p].x);
+      b[p] = _mm_set1_ps(frustum.planes[p].y);
+      c[p] = _mm_set1_ps(frustum.planes[p].z);
+      d[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    const size_t count = bounds.size() & ~static_cast<size_t>(3);
+    for (size_t i = 0; i < count; i += 4)
+    {
+      const __m128 x = _mm_loadu_ps(&bounds.x[i]);
+      const __m128 y = _mm_loadu_ps(&bounds.y[i]);
+      const __m128 z = _mm_loadu_ps(&bounds.z[i]);
+      const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i]));
+
+      __m128 inside = _mm_cmpeq_ps(x, x);
+      for (int p = 0; p < PLANE_COUNT; p++)
+      {
+        const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], x), _mm_mul_ps(b[p], y)), _mm_add_ps(_mm_mul_ps(c[p], z), d[p]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+      }
+
+      // i is a multiple of 4, so the 4 bits never straddle two words
+      visible[i >> 6] |= static_cast<uint64_t>(_mm_movemask_ps(inside)) << (i & 63);
+    }
+    return count;
+  }
+
+  size_t cullAabbsSSE(const Frustum& frustum, const AabbBounds& bounds, uint64_t* visible)
+  {
+    __m128 a[PLANE_COUNT], b[PLANE_COUNT], c[PLANE_COUNT], d[PLANE_COUNT];
+    __m128 absA[PLANE_COUNT], absB[PLANE_COUNT], absC[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; p++)
+    {
+      a[p] = _mm_set1_ps(frustum.planes[p].x);
+      b[p] = _mm_set1_ps(frustum.planes[p].y);
+      c[p] = _mm_set1_ps(frustum.planes[p].z);
+      d[p] = _mm_set1_ps(frustum.planes[p].w);
+      absA[p] = _mm_set1_ps(fabsf(frustum.planes[p].x));
+      absB[p] = _mm_set1_ps(fabsf(frustum.planes[p].y));
+      absC[p] = _mm_set1_ps(fabsf(frustum.planes[p].z));
+    }
+
+    const size_t count = bounds.size() & ~static_cast<size_t>(3);
+    for (size_t i = 0; i < count; i += 4)
+    {
+      const __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+      const __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+      const __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+      const __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+      const __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+      const __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+      __m128 inside = _mm_cmpeq_ps(cx, cx);
+      for (int p = 0; p < PLANE_COUNT; p++)
+      {
+        const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], cx), _mm_mul_ps(b[p], cy)), _mm_add_ps(_mm_mul_ps(c[p], cz), d[p]));
+        const __m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absA[p], ex), _mm_mul_ps(absB[p], ey)), _mm_mul_ps(absC[p], ez));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, extent), _mm_setzero_ps()));
+      }
+
+      visible[i >> 6] |= static_cast<uint64_t>(_mm_movemask_ps(inside)) << (i & 63);
+    }
+    return count;
+  }
+
+  // 8 objects per iteration
+  TARGET_AVX size_t cullSpheresAVX(const Frustum& frustum, const SphereBounds& bounds, uint64_t* visible)
+  {
+    __m256 a[PLANE_COUNT], b[PLANE_COUNT], c[PLANE_COUNT], d[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; p++)
+    {
+      a[p] = _mm256_set1_ps(frustum.planes[p].x);
+      b[p] = _mm256_set1_ps(frustum.planes[p].y);
+      c[p] = _mm256_set1_ps(frustum.planes[p].z);
+      d[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    const size_t count = bounds.size() & ~static_cast<size_t>(7);
+    for (size_t i = 0; i < count; i += 8)
+    {
+      const __m256 x = _mm256_loadu_ps(&bounds.x[i]);
+      const __m256 y = _mm256_loadu_ps(&bounds.y[i]);
+      const __m256 z = _mm256_loadu_ps(&bounds.z[i]);
+      const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&bounds.radius[i]));
+
+      __m256 inside = _mm256_cmp_ps(x, x, _CMP_EQ_OQ);
+      for (int p = 0; p < PLANE_COUNT; p++)
+      {
+        const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[p], x), _mm256_mul_ps(b[p], y)), _mm256_add_ps(_mm256_mul_ps(c[p], z), d[p]));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+      }
+
+      visible[i >> 6] |= static_cast<uint64_t>(_mm256_movemask_ps(inside)) << (i & 63);
+    }
+    return count;
+  }
+
+  TARGET_AVX size_t cullAabbsAVX(const Frustum& frustum, const AabbBounds& bounds, uint64_t* visible)
+  {
+    __m256 a[PLANE_COUNT], b[PLANE_COUNT], c[PLANE_COUNT], d[PLANE_COUNT];
+    __m256 absA[PLANE_COUNT], absB[PLANE_COUNT], absC[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; p++)
+    {
+      a[p] = _mm256_set1_ps(frustum.planes[p].x);
+      b[p] = _mm256_set1_ps(frustum.planes[p].y);
+      c[p] = _mm256_set1_ps(frustum.planes[p].z);
+      d[p] = _mm256_set1_ps(frustum.planes[p].w);
+      absA[p] = _mm256_set1_ps(fabsf(frustum.planes[p].x));
+      absB[p] = _mm256_set1_ps(fabsf(frustum.planes[p].y));
+      absC[p] = _mm256_set1_ps(fabsf(frustum.planes[p].z));
+    }
+
+    const size_t count = bounds.size() & ~static_cast<size_t>(7);
+    for (size_t i = 0; i < count; i += 8)
+    {
+      const __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+      const __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+      const __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+      const __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+      const __m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+      const __m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+      __m256 inside = _mm256_cmp_ps(cx, cx, _CMP_EQ_OQ);
+      for (int p = 0; p < PLANE_COUNT; p++)
+      {
+        const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[p], cx), _mm256_mul_ps(b[p], cy)), _mm256_add_ps(_mm256_mul_ps(c[p], cz), d[p]));
+        const __m256 extent = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absA[p], ex), _mm256_mul_ps(absB[p], ey)), _mm256_mul_ps(absC[p], ez));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, extent), _mm256_setzero_ps(), _CMP_GE_OQ));
+      }
+
+      visible[i >> 6] |= static_cast<uint64_t>(_mm256_movemask_ps(inside)) << (i & 63);
+    }
+    return count;
+  }
+}
+
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+  // glm is column major: m[column][row]. Row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+  const glm::mat4& m = viewProjection;
+  const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+  Frustum frustum{};
+  frustum.planes[0] = row3 + row0; // left
+  frustum.planes[1] = row3 - row0; // right
+  frustum.planes[2] = row3 + row1; // bottom
+  frustum.planes[3] = row3 - row1; // top
+  frustum.planes[4] = row3 + row2; // near (GL clip space z goes from -w to w)
+  frustum.planes[5] = row3 - row2; // far
+
+  // unit normals, so the plane equation gives real distances we can compare with radii
+  for (glm::vec4& plane : frustum.planes)
+  {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+void SphereBounds::clear()
+{
+  x.clear();
+  y.clear();
+  z.clear();
+  radius.clear();
+}
+
+void SphereBounds::reserve(size_t count)
+{
+  x.reserve(count);
+  y.reserve(count);
+  z.reserve(count);
+  radius.reserve(count);
+}
+
+void SphereBounds::push_back(const glm::vec3& center, float sphereRadius)
+{
+  x.push_back(center.x);
+  y.push_back(center.y);
+  z.push_back(center.z);
+  radius.push_back(sphereRadius);
+}
+
+void AabbBounds::clear()
+{
+  centerX.clear();
+  centerY.clear();
+  centerZ.clear();
+  extentX.clear();
+  extentY.clear();
+  extentZ.clear();
+}
+
+void AabbBounds::reserve(size_t count)
+{
+  centerX.reserve(count);
+  centerY.reserve(count);
+  centerZ.reserve(count);
+  extentX.reserve(count);
+  extentY.reserve(count);
+  extentZ.reserve(count);
+}
+
+void AabbBounds::push_back(const glm::vec3& center, const glm::vec3& extent)
+{
+  centerX.push_back(center.x);
+  centerY.push_back(center.y);
+  centerZ.push_back(center.z);
+  extentX.push_back(extent.x);
+  extentY.push_back(extent.y);
+  extentZ.push_back(extent.z);
+}
+
+bool isCullPathSupported(CullPath path)
+{
+  if (path != CullPath::AVX) return true;
+
+  // -1 not checked yet. cpuid is cheap, but not free
+  static int avx = -1;
+  if (avx < 0) avx = cpuHasAvx() ? 1 : 0;
+  return avx == 1;
+}
+
+const char* getCullPathName(CullPath path)
+{
+  switch (resolvePath(path))
+  {
+  case CullPath::SCALAR: return "scalar";
+  case CullPath::SSE: return "SSE";
+  case CullPath::AVX: return "AVX";
+  default: return "?";
+  }
+}
+
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint64_t>& visible, CullPath path)
+{
+  visible.assign((bounds.size() + 63) / 64, 0);
+  if (bounds.size() == 0) return 0;
+
+  size_t first = 0;
+  switch (resolvePath(path))
+  {
+  case CullPath::SSE: first = cullSpheresSSE(frustum, bounds, visible.data()); break;
+  case CullPath::AVX: first = cullSpheresAVX(frustum, bounds, visible.data()); break;
+  default: break;
+  }
+  cullSpheresScalar(frustum, bounds, first, visible.data());
+
+  return countVisible(visible);
+}
+
+size_t cullAabbs(const Frustum& frustum, const AabbBounds& bounds, std::vector<uint64_t>& visible, CullPath path)
+{
+  visible.assign((bounds.size() + 63) / 64, 0);
+  if (bounds.size() == 0) return 0;
+
+  size_t first = 0;
+  switch (resolvePath(path))
+  {
+  case CullPath::SSE: first = cullAabbsSSE(frustum, bounds, visible.data()); break;
+  case CullPath::AVX: first = cullAabbsAVX(frustum, bounds, visible.data()); break;
+  default: break;
+  }
+  cullAabbsScalar(frustum, bounds, first, visible.data());
+
+  return countVisible(visible);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <stdint.h>
+#include <vector>
+#include "glm/glm.hpp"
+
+// Frustum culling of many bounding volumes at once
+// Bounds are kept in SoA layout (one array per component), so a SIMD register holds the same component of
+// 4 (SSE) or 8 (AVX) objects and the six plane tests run on all of them together. The result is a bitmask
+// with one bit per object, set if the object may be visible
+
+// six planes facing into the frustum: xyz is the unit normal, w the distance. A point p is inside if
+// dot(xyz, p) + w >= 0 for all of them. Order: left, right, bottom, top, near, far
+struct Frustum
+{
+  glm::vec4 planes[6]{};
+};
+
+// Gribb/Hartmann: the planes are sums and differences of the rows of projection * view. Pass projection
+// alone to get them in view space
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+// bounding spheres of objects in world space
+struct SphereBounds
+{
+  std::vector<float> x{}, y{}, z{}, radius{};
+
+  size_t size() const { return x.size(); };
+  void clear();
+  void reserve(size_t count);
+  void push_back(const glm::vec3& center, float sphereRadius);
+};
+
+// axis aligned boxes as center and half size. Cheaper to test than min/max: one plane distance and one projected extent
+struct AabbBounds
+{
+  std::vector<float> centerX{}, centerY{}, centerZ{};
+  std::vector<float> extentX{}, extentY{}, extentZ{};
+
+  size_t size() const { return centerX.size(); };
+  void clear();
+  void reserve(size_t count);
+  void push_back(const glm::vec3& center, const glm::vec3& extent);
+};
+
+// which kernel to run. BEST picks AVX if the CPU and OS support it, SSE otherwise (always there on x64)
+enum class CullPath : uint8_t
+{
+  SCALAR,
+  SSE,
+  AVX,
+  BEST,
+};
+
+bool isCullPathSupported(CullPath path);
+const char* getCullPathName(CullPath path);
+
+// test all bounds against frustum. visible is resized to one bit per object (64 per word) and overwritten
+// returns the number of objects that may be visible. Boxes and spheres touching a plane count as visible
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint64_t>& visible, CullPath path = CullPath::BEST);
+size_t cullAabbs(const Frustum& frustum, const AabbBounds& bounds, std::vector<uint64_t>& visible, CullPath path = CullPath::BEST);
+
+inline bool isVisible(const std::vector<uint64_t>& visible, size_t index)
+{
+  return (visible[index >> 6] >> (index & 63)) & 1;
+}
+
+#endif // !CULLING_H
@@ -0,0 +1,151 @@
+#include "FileWatcher.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace
+{
+  // polling fallback. Often enough to feel instant, rare enough to cost nothing
+  constexpr std::chrono::milliseconds POLL_INTERVAL{ 250 };
+
+  std::filesystem::file_time_type getWriteTime(const std::string& filename)
+  {
+    std::error_code error{};
+    const std::filesystem::file_time_type time = std::filesystem::last_write_time(filename, error);
+    return error ? std::filesystem::file_time_type{} : time;
+  }
+}
+
+FileWatcher::~FileWatcher()
+{
+  clear();
+}
+
+bool FileWatcher::watch(const std::string& filename)
+{
+  for (const WatchedFile& file : mFiles)
+  {
+    if (file.filename == filename) return true;
+  }
+
+  std::filesystem::path directoryPath = std::filesystem::path(filename).parent_path();
+  if (directoryPath.empty()) directoryPath = ".";
+  const std::string directory = directoryPath.string();
+
+  size_t index = 0;
+  while (index < mDirectories.size() && mDirectories[index].path != directory) index++;
+
+  if (index == mDirectories.size())
+  {
+    WatchedDirectory watched{};
+    watched.path = directory;
+
+#ifdef _WIN32
+    // saving a file changes its write time. Renames cover editors that save through a temp file
+    const HANDLE handle = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    watched.handle = reinterpret_cast<intptr_t>(handle);
+#elif defined(__linux__)
+    if (mNotifyFd < 0) mNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mNotifyFd < 0) return false;
+    watched.handle = inotify_add_watch(mNotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (watched.handle < 0) return false;
+#endif
+
+    mDirectories.push_back(watched);
+  }
+
+  mFiles.push_back({ filename, getWriteTime(filename), index });
+  return true;
+}
+
+void FileWatcher::clear()
+{
+  for (WatchedDirectory& directory : mDirectories)
+  {
+#ifdef _WIN32
+    if (directory.handle != -1) FindCloseChangeNotification(reinterpret_cast<HANDLE>(directory.handle));
+#elif defined(__linux__)
+    if (directory.handle >= 0) inotify_rm_watch(mNotifyFd, static_cast<int>(directory.handle));
+#endif
+  }
+
+#if defined(__linux__)
+  if (mNotifyFd >= 0) ::close(mNotifyFd);
+  mNotifyFd = -1;
+#endif
+
+  mDirectories.clear();
+  mFiles.clear();
+}
+
+void FileWatcher::readNotifications()
+{
+#ifdef _WIN32
+  for (WatchedDirectory& directory : mDirectories)
+  {
+    const HANDLE handle = reinterpret_cast<HANDLE>(directory.handle);
+    if (WaitForSingleObject(handle, 0) == WAIT_OBJECT_0)
+    {
+      directory.touched = true;
+
+      // rearm. Changes until then are reported on the next call
+      FindNextChangeNotification(handle);
+    }
+  }
+#elif defined(__linux__)
+  // events are variable size (name follows the struct). We only need to know which watch they came from
+  alignas(inotify_event) char buffer[4096];
+  for (;;)
+  {
+    const ssize_t length = read(mNotifyFd, buffer, sizeof(buffer));
+    if (length <= 0) break;
+
+    for (ssize_t offset = 0; offset < length;)
+    {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+      for (WatchedDirectory& directory : mDirectories)
+      {
+        if (directory.handle == event->wd) directory.touched = true;
+      }
+      offset += sizeof(inotify_event) + event->len;
+    }
+  }
+#else
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - mLastPoll < POLL_INTERVAL) return;
+  mLastPoll = now;
+
+  for (WatchedDirectory& directory : mDirectories) directory.touched = true;
+#endif
+}
+
+bool FileWatcher::poll(std::vector<std::string>& changed)
+{
+  if (mFiles.empty()) return false;
+
+  readNotifications();
+
+  bool anyChanged = false;
+  for (WatchedFile& file : mFiles)
+  {
+    if (!mDirectories[file.directory].touched) continue;
+
+    // a file in the middle of being replaced may not exist for a moment. It's reported once it's back
+    const std::filesystem::file_time_type time = getWriteTime(file.filename);
+    if (time == std::filesystem::file_time_type{} || time == file.writeTime) continue;
+
+    file.writeTime = time;
+    changed.push_back(file.filename);
+    anyChanged = true;
+  }
+
+  for (WatchedDirectory& directory : mDirectories) directory.touched = false;
+  return anyChanged;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <stdint.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Tells which of a set of files changed on disk. For hot reloading assets while the app runs
+// The OS watches the directories (FindFirstChangeNotification on Windows, inotify on Linux) and poll()
+// only looks at the files when a directory was touched. Elsewhere poll() checks the timestamps a few times a second
+//
+// A file counts as changed when its last write time differs from what we saw before. Editors that save
+// through a temp file and a rename are covered, and so are directory events for files we don't watch
+class FileWatcher
+{
+public:
+
+  FileWatcher() = default;
+  ~FileWatcher();
+
+  // owns OS handles
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  // start watching a file. Its directory must exist. Watching a file twice does nothing
+  bool watch(const std::string& filename);
+
+  // stop watching everything
+  void clear();
+
+  // non blocking. Appends the files that changed since the last call to changed and returns true if there were any
+  bool poll(std::vector<std::string>& changed);
+
+private:
+
+  struct WatchedFile
+  {
+    std::string filename{};
+    std::filesystem::file_time_type writeTime{};
+    size_t directory{}; // index into mDirectories
+  };
+
+  struct WatchedDirectory
+  {
+    std::string path{};
+    intptr_t handle{ -1 }; // change notification HANDLE on Windows, inotify watch descriptor on Linux
+    bool touched{};        // polling: set on every check
+  };
+
+  // collects OS notifications into WatchedDirectory::touched
+  void readNotifications();
+
+  std::vector<WatchedFile> mFiles{};
+  std::vector<WatchedDirectory> mDirectories{};
+
+  // inotify instance (Linux only)
+  int mNotifyFd{ -1 };
+
+  // polling: when we last looked at the timestamps
+  std::chrono::steady_clock::time_point mLastPoll{};
+};
+
+#endif // !FILE_WATCHER_H
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 64-bit FNV-1a. Not cryptographic, but fast, tiny and good enough to tell if an asset changed
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+// hash a block of memory. Pass a previous result as seed to hash several blocks as one
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t seed = FNV_OFFSET_BASIS)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+// hash a null-terminated string. constexpr, so string literals can be hashed at compile time
+constexpr uint64_t fnv1a64(const char* str, uint64_t seed = FNV_OFFSET_BASIS)
+{
+  uint64_t hash = seed;
+  while (*str != '\0')
+  {
+    hash ^= static_cast<uint8_t>(*str++);
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+#endif // !HASH_H
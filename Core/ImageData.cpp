@@ -0,0 +1,291 @@
+#include <utility>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <emmintrin.h>
+#include "ImageData.h"
+#define STB_IMAGE_RESIZE_IMPLEMENTATION // generates the implementation of stb_image_resize in this file only
+#include "stb_image_resize/stb_image_resize.h"
+
+namespace
+{
+  struct MipFilterInfo
+  {
+    MipFilter filter;
+    const char* name;
+    stbir_filter stbFilter;
+  };
+
+  const MipFilterInfo MIP_FILTERS[] =
+  {
+    { MipFilter::BOX, "box", STBIR_FILTER_BOX },
+    { MipFilter::TRIANGLE, "triangle", STBIR_FILTER_TRIANGLE },
+    { MipFilter::CUBIC_BSPLINE, "bspline", STBIR_FILTER_CUBICBSPLINE },
+    { MipFilter::CATMULL_ROM, "catmullrom", STBIR_FILTER_CATMULLROM },
+    { MipFilter::MITCHELL, "mitchell", STBIR_FILTER_MITCHELL },
+  };
+
+  const MipFilterInfo& getMipFilterInfo(MipFilter filter)
+  {
+    for (const MipFilterInfo& info : MIP_FILTERS)
+    {
+      if (info.filter == filter) return info;
+    }
+    return MIP_FILTERS[4];
+  }
+}
+
+ImageView makeImageView(const ImageData& image)
+{
+  ImageView view{};
+  view.format = image.format;
+  view.mips.reserve(image.mips.size());
+  for (const MipLevel& mip : image.mips)
+  {
+    view.mips.push_back({ mip.width, mip.height, mip.pixels.data(), mip.pixels.size() });
+  }
+  return view;
+}
+
+ImageData copyImageView(const ImageView& view)
+{
+  ImageData image{};
+  image.format = view.format;
+  image.mips.reserve(view.mips.size());
+  for (const MipLevelView& mip : view.mips)
+  {
+    image.mips.push_back({ mip.width, mip.height, std::vector<uint8_t>(mip.pixels, mip.pixels + mip.size) });
+  }
+  return image;
+}
+
+const char* getMipFilterName(MipFilter filter)
+{
+  return getMipFilterInfo(filter).name;
+}
+
+bool parseMipFilter(const std::string& name, MipFilter& filter)
+{
+  for (const MipFilterInfo& info : MIP_FILTERS)
+  {
+    if (name == info.name)
+    {
+      filter = info.filter;
+      return true;
+    }
+  }
+  return false;
+}
+
+void flipImageVerticallyBytewise(uint8_t* pixels, int width, int height, int components)
+{
+  // flip image vertically because it loads in upside down
+  // we use a trick with a pointer arithmetic
+  // we need width in bytes to reverse bytes in the image from bottom to top by myltiplying this width in bytes
+  int widthInBytes = width * components; // for RGBA 1 pixel = 4 components of 8 bits = 32 bits or 4 bytes
+  uint8_t* top = nullptr;
+  uint8_t* bottom = nullptr;
+  uint8_t temp = 0;
+  int halfHeight = height / 2;
+  // going along a half of the texture vertically
+  for (int row = 0; row < halfHeight; row++)
+  {
+    top = pixels + row * widthInBytes; // going through top
+    bottom = pixels + (height - row - 1) * widthInBytes; // going through bottom
+    for (int col = 0; col < widthInBytes; col++)
+    {
+      // actual reversing
+      temp = *top; // store top value in a temp var. Dereference *top because temp is not a ptr
+      *top = *bottom; // reverse top and bottom values dereferencing them
+      *bottom = temp; // assign former top value to bottom
+      top++; // iterate with a loop
+      bottom++; // iterate with a loop
+    }
+  }
+}
+
+void flipImageVerticallyScratchRow(uint8_t* pixels, int width, int height, int components)
+{
+  const size_t rowBytes = static_cast<size_t>(width) * components;
+  std::vector<uint8_t> scratch(rowBytes);
+
+  // three memcpy per row pair. memcpy is vectorized by the CRT, but every row goes through the scratch buffer
+  for (int row = 0; row < height / 2; row++)
+  {
+    uint8_t* top = pixels + row * rowBytes;
+    uint8_t* bottom = pixels + (height - row - 1) * rowBytes;
+    memcpy(scratch.data(), top, rowBytes);
+    memcpy(top, bottom, rowBytes);
+    memcpy(bottom, scratch.data(), rowBytes);
+  }
+}
+
+void flipImageVertically(uint8_t* pixels, int width, int height, int components)
+{
+  const size_t rowBytes = static_cast<size_t>(width) * components;
+  const size_t vectorBytes = rowBytes & ~static_cast<size_t>(15);
+
+  // swap the two rows 16 bytes at a time in registers. Each byte is read and written once and no scratch memory is needed
+  // SSE2 is always there on x64 and is the default target of our Win32 builds too
+  for (int row = 0; row < height / 2; row++)
+  {
+    uint8_t* top = pixels + row * rowBytes;
+    uint8_t* bottom = pixels + (height - row - 1) * rowBytes;
+
+    size_t i = 0;
+    for (; i < vectorBytes; i += 16)
+    {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(top + i), b);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bottom + i), a);
+    }
+
+    // rows that aren't a multiple of 16 bytes (RGB images with odd widths)
+    for (; i < rowBytes; i++)
+    {
+      const uint8_t temp = top[i];
+      top[i] = bottom[i];
+      bottom[i] = temp;
+    }
+  }
+}
+
+void copyImageFlipped(const uint8_t* source, uint8_t* destination, int width, int height, int components)
+{
+  const size_t rowBytes = static_cast<size_t>(width) * components;
+  for (int row = 0; row < height; row++)
+  {
+    memcpy(destination + row * rowBytes, source + (height - row - 1) * rowBytes, rowBytes);
+  }
+}
+
+void buildMipChain(ImageData& image, const MipChainSettings& settings)
+{
+  if (image.mips.empty()) return;
+
+  image.mips.resize(1);
+
+  // allocate the whole chain up front. Each level is half the size of the previous one (at least 1 pixel) until we reach 1x1
+  while (image.mips.back().width > 1 || image.mips.back().height > 1)
+  {
+    MipLevel level{};
+    level.width = image.mips.back().width > 1 ? image.mips.back().width / 2 : 1;
+    level.height = image.mips.back().height > 1 ? image.mips.back().height / 2 : 1;
+    level.pixels.resize(getLevelSize(TextureFormat::RGBA8, level.width, level.height));
+    image.mips.push_back(std::move(level));
+  }
+
+  const stbir_filter filter = getMipFilterInfo(settings.filter).stbFilter;
+  const stbir_colorspace colorSpace = settings.gammaCorrect ? STBIR_COLORSPACE_SRGB : STBIR_COLORSPACE_LINEAR;
+  const unsigned threadCount = settings.threadCount == 0 ? std::max(1u, std::thread::hardware_concurrency()) : settings.threadCount;
+
+  // a level is cut into bands of rows that are filtered on different threads. stb_image_resize can only
+  // resize whole images, so every band copies its source rows plus a few rows above and below (wrapped around
+  // like GL_REPEAT), resizes that and drops the extra rows again. The kernels reach 2 rows of the level, so
+  // with 4 extra rows the bands come out bit for bit like a resize of the whole level
+  constexpr uint32_t BAND_ROWS = 64;
+  constexpr uint32_t HALO_ROWS = 4;
+
+  for (size_t i = 1; i < image.mips.size(); i++)
+  {
+    const MipLevel& source = image.mips[i - 1];
+    MipLevel& level = image.mips[i];
+
+    // bands need an exact 2:1 ratio. Odd sizes and the small levels are done in one go
+    const uint32_t bandCount = (level.height + BAND_ROWS - 1) / BAND_ROWS;
+    if (threadCount == 1 || bandCount == 1 || source.width != level.width * 2 || source.height != level.height * 2)
+    {
+      stbir_resize_uint8_generic(
+        source.pixels.data(), source.width, source.height, 0,
+        level.pixels.data(), level.width, level.height, 0,
+        4, 3, 0, STBIR_EDGE_WRAP, filter, colorSpace, nullptr);
+      continue;
+    }
+
+    const size_t sourceRowBytes = static_cast<size_t>(source.width) * 4;
+    const size_t levelRowBytes = static_cast<size_t>(level.width) * 4;
+
+    std::atomic<uint32_t> nextBand{ 0 };
+    const auto work = [&]()
+    {
+      std::vector<uint8_t> bandSource{}, bandLevel{};
+      for (uint32_t band = nextBand++; band < bandCount; band = nextBand++)
+      {
+        const uint32_t firstRow = band * BAND_ROWS;
+        const uint32_t rows = std::min(BAND_ROWS, level.height - firstRow);
+        const uint32_t paddedRows = rows + 2 * HALO_ROWS;
+
+        bandSource.resize(sourceRowBytes * paddedRows * 2);
+        bandLevel.resize(levelRowBytes * paddedRows);
+
+        const int64_t firstSourceRow = (static_cast<int64_t>(firstRow) - HALO_ROWS) * 2;
+        for (uint32_t row = 0; row < paddedRows * 2; row++)
+        {
+          const int64_t wrapped = ((firstSourceRow + row) % source.height + source.height) % source.height;
+          memcpy(bandSource.data() + row * sourceRowBytes, source.pixels.data() + wrapped * sourceRowBytes, sourceRowBytes);
+        }
+
+        stbir_resize_uint8_generic(
+          bandSource.data(), source.width, paddedRows * 2, 0,
+          bandLevel.data(), level.width, paddedRows, 0,
+          4, 3, 0, STBIR_EDGE_WRAP, filter, colorSpace, nullptr);
+
+        memcpy(level.pixels.data() + firstRow * levelRowBytes, bandLevel.data() + HALO_ROWS * levelRowBytes, rows * levelRowBytes);
+      }
+    };
+
+    // the calling thread works too
+    std::vector<std::thread> threads{};
+    const unsigned extraThreads = std::min(threadCount, bandCount) - 1;
+    for (unsigned t = 0; t < extraThreads; t++) threads.emplace_back(work);
+    work();
+    for (std::thread& thread : threads) thread.join();
+  }
+}
+
+void buildMipChainBox(ImageData& image)
+{
+  if (image.mips.empty()) return;
+
+  image.mips.resize(1);
+
+  // each level is half the size of the previous one (at least 1 pixel) until we reach 1x1
+  while (image.mips.back().width > 1 || image.mips.back().height > 1)
+  {
+    const MipLevel& source = image.mips.back();
+
+    MipLevel level{};
+    level.width = source.width > 1 ? source.width / 2 : 1;
+    level.height = source.height > 1 ? source.height / 2 : 1;
+    level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+    for (uint32_t y = 0; y < level.height; y++)
+    {
+      // clamp for odd sizes and for 1 pixel wide/high levels
+      const uint32_t y0 = y * 2 < source.height ? y * 2 : source.height - 1;
+      const uint32_t y1 = y * 2 + 1 < source.height ? y * 2 + 1 : y0;
+
+      for (uint32_t x = 0; x < level.width; x++)
+      {
+        const uint32_t x0 = x * 2 < source.width ? x * 2 : source.width - 1;
+        const uint32_t x1 = x * 2 + 1 < source.width ? x * 2 + 1 : x0;
+
+        // average 2x2 source pixels
+        for (uint32_t c = 0; c < 4; c++)
+        {
+          const uint32_t sum =
+            source.pixels[(y0 * source.width + x0) * 4 + c] +
+            source.pixels[(y0 * source.width + x1) * 4 + c] +
+            source.pixels[(y1 * source.width + x0) * 4 + c] +
+            source.pixels[(y1 * source.width + x1) * 4 + c];
+          level.pixels[(y * level.width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+      }
+    }
+
+    // push_back may reallocate, so don't touch source after this
+    image.mips.push_back(std::move(level));
+  }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef IMAGE_DATA_H
+#define IMAGE_DATA_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// CPU side image data. No OpenGL in here, so the offline cooker can use it without a GL context
+
+// pixel layout of a mip level
+enum class TextureFormat : uint32_t
+{
+  RGBA8 = 0,
+  DXT1 = 1, // S3TC/BC1: 4x4 blocks of 8 bytes, opaque
+  DXT5 = 2, // S3TC/BC3: 4x4 blocks of 16 bytes, with alpha
+};
+
+inline bool isBlockCompressed(TextureFormat format)
+{
+  return format == TextureFormat::DXT1 || format == TextureFormat::DXT5;
+}
+
+// bytes of a width x height level. Block compressed levels are padded to whole 4x4 blocks
+inline size_t getLevelSize(TextureFormat format, uint32_t width, uint32_t height)
+{
+  if (!isBlockCompressed(format)) return static_cast<size_t>(width) * height * 4;
+
+  const size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+  return blocks * (format == TextureFormat::DXT1 ? 8 : 16);
+}
+
+// one level of a mip chain. Level 0 is the full resolution image
+struct MipLevel
+{
+  uint32_t width{};
+  uint32_t height{};
+  std::vector<uint8_t> pixels{};
+};
+
+struct ImageData
+{
+  TextureFormat format{ TextureFormat::RGBA8 };
+  std::vector<MipLevel> mips{};
+};
+
+// a mip level that lives in memory somebody else owns (an ImageData or a memory mapped .flytex)
+struct MipLevelView
+{
+  uint32_t width{};
+  uint32_t height{};
+  const uint8_t* pixels{};
+  size_t size{}; // in bytes
+};
+
+// what Texture2D uploads. Lets a mapped file go to the driver without a copy into an ImageData first
+struct ImageView
+{
+  TextureFormat format{ TextureFormat::RGBA8 };
+  std::vector<MipLevelView> mips{};
+};
+
+// the view stays valid as long as image isn't changed
+ImageView makeImageView(const ImageData& image);
+
+// copy the levels of a view into an image that owns them
+ImageData copyImageView(const ImageView& view);
+
+// resampling filter of the mip chain. The values are stored in .flytex files
+enum class MipFilter : uint32_t
+{
+  BOX = 0,           // plain average. Cheapest, a bit blurry
+  TRIANGLE = 1,      // tent. Softer than box
+  CUBIC_BSPLINE = 2, // smooth and blurry, no ringing
+  CATMULL_ROM = 3,   // sharp, rings on hard edges
+  MITCHELL = 4,      // between the two above. stb_image_resize uses it for downsampling by default
+};
+
+const char* getMipFilterName(MipFilter filter);
+
+// "box", "triangle", "bspline", "catmullrom", "mitchell"
+bool parseMipFilter(const std::string& name, MipFilter& filter);
+
+struct MipChainSettings
+{
+  MipFilter filter{ MipFilter::MITCHELL };
+
+  // filter colors in linear space. Averaging sRGB values directly makes the smaller levels too dark
+  bool gammaCorrect{ true };
+
+  // the rows of each level are split between this many threads. 0 means one per core
+  unsigned threadCount{ 1 };
+};
+
+// flip image rows in place. stb_image returns the top row first but OpenGL expects the bottom row first
+// swaps whole rows with SSE2. The engine and the cooker flip with copyImageFlipped, so only flybench uses this
+void flipImageVertically(uint8_t* pixels, int width, int height, int components);
+
+// flip while copying into another buffer. Free if the pixels have to be copied anyway (the cooker does)
+void copyImageFlipped(const uint8_t* source, uint8_t* destination, int width, int height, int components);
+
+// slower variants, kept for flybench
+void flipImageVerticallyBytewise(uint8_t* pixels, int width, int height, int components);
+void flipImageVerticallyScratchRow(uint8_t* pixels, int width, int height, int components);
+
+// replace everything after level 0 with a full chain down to 1x1. RGBA8 only
+// every level is resampled from the previous one with stb_image_resize, wrapping at the edges like GL_REPEAT does
+// alpha weights the colors, so transparent pixels don't bleed into their neighbours
+void buildMipChain(ImageData& image, const MipChainSettings& settings = MipChainSettings{});
+
+// 2x2 box filter on the sRGB values, each level from the previous one. That's what glGenerateMipmap
+// does on most drivers. Kept for flybench
+void buildMipChainBox(ImageData& image);
+
+#endif // !IMAGE_DATA_H
@@ -0,0 +1,162 @@
+#include <chrono>
+#include <algorithm>
+#include "ImageDecodePool.h"
+#include "AssetFormats.h"
+#define STB_IMAGE_IMPLEMENTATION // generates implementation of STB LIB. It must be done before "include the header" It specified so by the lib creator
+// lib to load images. OpenGL doesn't have this functionality by default
+#include "stb_image/stb_image.h"
+
+bool loadImageFile(const std::string& filename, ImageData& image, bool preferCooked)
+{
+  image = ImageData{};
+
+  // prefer what the offline cooker produced. It's already flipped and has its mips, so there is nothing to decode
+  if (preferCooked)
+  {
+    const std::string cookedFilename = getCookedPath(filename);
+    if (isCookedAssetUpToDate(filename, cookedFilename) && readFlyTex(cookedFilename, image))
+    {
+      return true;
+    }
+  }
+
+  // will be passed to a method to read image from disk
+  int width{}, height{}, components{};
+
+  // stb lib will read the file from disk. Allocate array of bytes and return
+  // a pointer to that array
+  // args (filename, width, height, components(RGBA), type of image) Last enum can be found in the stb_image.h meaning RGBA image
+  // stb_image keeps its error state per thread, so this is safe on the decode workers
+  unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &components, STBI_rgb_alpha);
+  if (pixels == nullptr)
+  {
+    return false;
+  }
+
+  image.format = TextureFormat::RGBA8;
+  image.mips.resize(1);
+  image.mips[0].width = static_cast<uint32_t>(width);
+  image.mips[0].height = static_cast<uint32_t>(height);
+  image.mips[0].pixels.resize(getLevelSize(TextureFormat::RGBA8, width, height));
+
+  // flip image vertically because it loads in upside down
+  // the pixels are copied out of stb's buffer anyway, so the flip comes for free with the copy
+  copyImageFlipped(pixels, image.mips[0].pixels.data(), width, height, 4);
+
+  // free memory (args: pointer to the image data)
+  stbi_image_free(pixels);
+  return true;
+}
+
+bool readImageSize(const std::string& filename, uint32_t& width, uint32_t& height, bool preferCooked)
+{
+  if (preferCooked)
+  {
+    const std::string cookedFilename = getCookedPath(filename);
+    FlyTexHeader header{};
+    if (isCookedAssetUpToDate(filename, cookedFilename) && readFlyTexHeader(cookedFilename, header))
+    {
+      width = header.width;
+      height = header.height;
+      return true;
+    }
+  }
+
+  int w{}, h{}, components{};
+  if (!stbi_info(filename.c_str(), &w, &h, &components)) return false;
+
+  width = static_cast<uint32_t>(w);
+  height = static_cast<uint32_t>(h);
+  return true;
+}
+
+bool mapImageFile(const std::string& filename, MappedFile& file, ImageView& view, bool pageIn)
+{
+  const std::string cookedFilename = getCookedPath(filename);
+  if (!isCookedAssetUpToDate(filename, cookedFilename) || !mapFlyTex(cookedFilename, file, view)) return false;
+
+  if (pageIn) file.touchPages();
+  return true;
+}
+
+ImageDecodePool::ImageDecodePool(unsigned threadCount, bool preferCooked, bool memoryMapped)
+  : mPreferCooked(preferCooked), mMemoryMapped(memoryMapped)
+{
+  if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned i = 0; i < threadCount; i++)
+  {
+    mThreads.emplace_back(&ImageDecodePool::workerLoop, this);
+  }
+}
+
+ImageDecodePool::~ImageDecodePool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mWorkAvailable.notify_all();
+
+  for (std::thread& thread : mThreads) thread.join();
+}
+
+void ImageDecodePool::submit(const std::string& path)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending.push_back(path);
+    mOutstanding++;
+  }
+  mWorkAvailable.notify_one();
+}
+
+bool ImageDecodePool::waitNext(DecodedImage& result)
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (mOutstanding == 0) return false;
+
+  mResultAvailable.wait(lock, [this]() { return !mFinished.empty(); });
+
+  result = std::move(mFinished.front());
+  mFinished.pop_front();
+  mOutstanding--;
+  return true;
+}
+
+void ImageDecodePool::workerLoop()
+{
+  for (;;)
+  {
+    std::string path{};
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWorkAvailable.wait(lock, [this]() { return mStopping || !mPending.empty(); });
+      if (mStopping) return;
+
+      path = std::move(mPending.front());
+      mPending.pop_front();
+    }
+
+    // decode outside of the lock. This is the part that runs in parallel
+    DecodedImage decoded{};
+    decoded.path = path;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (mPreferCooked && mMemoryMapped && mapImageFile(path, decoded.mapping, decoded.view))
+    {
+      decoded.loaded = true;
+    }
+    else
+    {
+      decoded.loaded = loadImageFile(path, decoded.image, mPreferCooked);
+      decoded.view = makeImageView(decoded.image);
+    }
+    decoded.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mFinished.push_back(std::move(decoded));
+    }
+    mResultAvailable.notify_one();
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef IMAGE_DECODE_POOL_H
+#define IMAGE_DECODE_POOL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "ImageData.h"
+#include "MappedFile.h"
+
+// read an image for a texture. Prefers an up to date cooked .flytex, otherwise decodes the source
+// with stb_image into a single RGBA8 level, flipped for OpenGL. No OpenGL, so it's safe on any thread
+bool loadImageFile(const std::string& filename, ImageData& image, bool preferCooked = true);
+
+// size of an image without decoding it. Reads the header of the cooked .flytex or of the source file
+bool readImageSize(const std::string& filename, uint32_t& width, uint32_t& height, bool preferCooked = true);
+
+// map the up to date cooked .flytex of an image and page it in. Returns false if there is none
+// (the caller falls back to loadImageFile()). view points into file
+// streaming reads a few levels at a time, so it doesn't page in the whole file (pageIn false)
+bool mapImageFile(const std::string& filename, MappedFile& file, ImageView& view, bool pageIn = true);
+
+struct DecodedImage
+{
+  std::string path{};
+  ImageData image{};
+  MappedFile mapping{};
+  ImageView view{}; // what to upload. Points into image or into mapping, moving a DecodedImage keeps it valid
+  bool loaded{};
+  double milliseconds{}; // time the worker spent on it
+};
+
+// Worker threads that run loadImageFile() (or mapImageFile()) for submitted paths
+// Results come back in the order the decodes finish, so the caller (the GL thread) can upload the first
+// image while the others are still decoding
+class ImageDecodePool
+{
+public:
+
+  // threadCount 0 means one per core. memoryMapped maps cooked files instead of reading them
+  explicit ImageDecodePool(unsigned threadCount = 0, bool preferCooked = true, bool memoryMapped = false);
+  ~ImageDecodePool();
+
+  ImageDecodePool(const ImageDecodePool&) = delete;
+  ImageDecodePool& operator=(const ImageDecodePool&) = delete;
+
+  void submit(const std::string& path);
+
+  // block until the next image is done. Returns false when every submitted image has been returned
+  bool waitNext(DecodedImage& result);
+
+  unsigned getThreadCount() const { return static_cast<unsigned>(mThreads.size()); };
+
+private:
+
+  void workerLoop();
+
+  bool mPreferCooked{};
+  bool mMemoryMapped{};
+  std::vector<std::thread> mThreads{};
+
+  std::mutex mMutex{};
+  std::condition_variable mWorkAvailable{};
+  std::condition_variable mResultAvailable{};
+  std::deque<std::string> mPending{};
+  std::deque<DecodedImage> mFinished{};
+  size_t mOutstanding{}; // submitted but not returned by waitNext() yet
+  bool mStopping{};
+};
+
+#endif // !IMAGE_DECODE_POOL_H
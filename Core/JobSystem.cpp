@@ -0,0 +1,229 @@
+#include <chrono>
+#include <algorithm>
+#include "JobSystem.h"
+
+namespace
+{
+  // the worker the calling thread runs for. The thread that made a system is its worker 0 without an entry here
+  thread_local const JobSystem* tSystem{};
+  thread_local uint32_t tWorkerIndex{ UINT32_MAX };
+
+  // every thread allocates its jobs from its own pool, so creating a job never synchronizes
+  thread_local std::unique_ptr<Job[]> tJobs{};
+  thread_local uint32_t tNextJob{};
+
+  // xorshift, to pick whom to steal from
+  thread_local uint64_t tRandom{};
+
+  uint32_t nextRandom()
+  {
+    if (tRandom == 0) tRandom = reinterpret_cast<uintptr_t>(&tRandom) | 1;
+    tRandom ^= tRandom << 13;
+    tRandom ^= tRandom >> 7;
+    tRandom ^= tRandom << 17;
+    return static_cast<uint32_t>(tRandom);
+  }
+
+  // failed searches before an idle worker sleeps
+  constexpr uint32_t SPIN_COUNT = 64;
+}
+
+bool JobSystem::WorkDeque::push(Job* job)
+{
+  const int64_t bottom = mBottom.load(std::memory_order_relaxed);
+  const int64_t top = mTop.load(std::memory_order_acquire);
+  if (bottom - top >= static_cast<int64_t>(QUEUE_SIZE)) return false;
+
+  // release: a thief that sees the new bottom sees the job and what's in it
+  mJobs[bottom & (QUEUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+  mBottom.store(bottom + 1, std::memory_order_release);
+  return true;
+}
+
+Job* JobSystem::WorkDeque::pop()
+{
+  const int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+  mBottom.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t top = mTop.load(std::memory_order_relaxed);
+
+  if (top > bottom)
+  {
+    // empty
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Job* job = mJobs[bottom & (QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+  if (top == bottom)
+  {
+    // the last one. A thief may be taking it at the same time, whoever moves top gets it
+    if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+Job* JobSystem::WorkDeque::steal()
+{
+  int64_t top = mTop.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const int64_t bottom = mBottom.load(std::memory_order_acquire);
+  if (top >= bottom) return nullptr;
+
+  Job* job = mJobs[top & (QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+  if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+  return job;
+}
+
+JobSystem::JobSystem(unsigned workerCount)
+{
+  if (workerCount == 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+  mOwner = std::this_thread::get_id();
+  for (unsigned i = 0; i < workerCount; i++) mQueues.push_back(std::make_unique<WorkDeque>());
+
+  // the queues must all exist before anybody steals from them
+  for (unsigned i = 1; i < workerCount; i++) mThreads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mRunning = false;
+  }
+  mWakeUp.notify_all();
+  for (std::thread& thread : mThreads) thread.join();
+}
+
+JobSystem& JobSystem::get()
+{
+  static JobSystem system{};
+  return system;
+}
+
+Job* JobSystem::allocateJob()
+{
+  if (!tJobs) tJobs = std::make_unique<Job[]>(JOB_POOL_SIZE);
+
+  // the pool is a ring. Slots still in use (a long running parent, say) are skipped. If all are, the thread
+  // has JOB_POOL_SIZE jobs in flight, so do some of them until one comes free
+  for (;;)
+  {
+    for (uint32_t i = 0; i < JOB_POOL_SIZE; i++)
+    {
+      Job* job = &tJobs[tNextJob++ & (JOB_POOL_SIZE - 1)];
+      if (isFinished(job))
+      {
+        job->unfinished.store(1, std::memory_order_relaxed);
+        return job;
+      }
+    }
+
+    JobSystem* system = tJobs[tNextJob & (JOB_POOL_SIZE - 1)].system;
+    Job* other = system->findJob(system->getWorkerIndex());
+    if (other != nullptr) system->execute(other);
+    else std::this_thread::yield();
+  }
+}
+
+void JobSystem::run(Job* job)
+{
+  const uint32_t workerIndex = getWorkerIndex();
+  if (workerIndex == UINT32_MAX || !mQueues[workerIndex]->push(job))
+  {
+    execute(job);
+    return;
+  }
+
+  if (mSleeping.load(std::memory_order_relaxed) > 0) mWakeUp.notify_one();
+}
+
+void JobSystem::wait(const Job* job)
+{
+  const uint32_t workerIndex = getWorkerIndex();
+  while (!isFinished(job))
+  {
+    Job* other = findJob(workerIndex);
+    if (other != nullptr) execute(other);
+    else std::this_thread::yield();
+  }
+}
+
+Job* JobSystem::findJob(uint32_t workerIndex)
+{
+  if (workerIndex != UINT32_MAX)
+  {
+    Job* job = mQueues[workerIndex]->pop();
+    if (job != nullptr) return job;
+  }
+
+  // try everyone once, starting at a random victim so the thieves spread out
+  const uint32_t workerCount = getWorkerCount();
+  const uint32_t first = nextRandom() % workerCount;
+  for (uint32_t i = 0; i < workerCount; i++)
+  {
+    const uint32_t victim = (first + i) % workerCount;
+    if (victim == workerIndex) continue;
+
+    Job* job = mQueues[victim]->steal();
+    if (job != nullptr) return job;
+  }
+  return nullptr;
+}
+
+void JobSystem::execute(Job* job)
+{
+  job->function(*job);
+  finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+  // once the count is 0 the slot may be reused right away, so read the parent first
+  Job* parent = job->parent;
+  if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1 && parent != nullptr) finish(parent);
+}
+
+uint32_t JobSystem::getWorkerIndex() const
+{
+  if (tSystem == this) return tWorkerIndex;
+  return std::this_thread::get_id() == mOwner ? 0 : UINT32_MAX;
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex)
+{
+  tSystem = this;
+  tWorkerIndex = workerIndex;
+
+  uint32_t idle{};
+  while (mRunning.load(std::memory_order_relaxed))
+  {
+    Job* job = findJob(workerIndex);
+    if (job != nullptr)
+    {
+      execute(job);
+      idle = 0;
+      continue;
+    }
+
+    if (++idle < SPIN_COUNT)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // nothing for a while. Sleep until run() has something, the timeout covers a wake up we missed
+    // between the last search and the wait
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    if (!mRunning) break;
+    mSleeping++;
+    mWakeUp.wait_for(lock, std::chrono::milliseconds(1));
+    mSleeping--;
+    idle = 0;
+  }
+
+  tSystem = nullptr;
+  tWorkerIndex = UINT32_MAX;
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work stealing job system
+// One worker per core: the thread that creates the system is worker 0 and works while it waits, the others get
+// a thread each. Every worker has a Chase-Lev deque. It pushes and pops its own jobs at the bottom (LIFO, warm
+// caches) and idle workers steal the oldest ones from the top of someone else's. Only steals synchronize
+//
+// Jobs are small fixed size blocks from a per thread pool, so creating one doesn't allocate. A job counts
+// itself and its unfinished children. It's finished when the count drops to 0, which also finishes one
+// child of its parent: waiting for a parent waits for everything below it
+//
+// Threads that aren't workers may use the system too: their jobs run right away in run() and their waits
+// only steal. A job stays valid until it has finished and its thread created JOB_POOL_SIZE more jobs
+
+class JobSystem;
+
+struct alignas(64) Job
+{
+  using Function = void (*)(Job& job);
+
+  Function function{};
+  Job* parent{};
+  JobSystem* system{};
+  std::atomic<int32_t> unfinished{}; // this job and its unfinished children
+
+  // the captures of the lambda. 128 bytes per job, two cache lines
+  static constexpr size_t DATA_SIZE = 128 - sizeof(Function) - sizeof(Job*) - sizeof(JobSystem*) - sizeof(std::atomic<int32_t>) - 4;
+  alignas(8) unsigned char data[DATA_SIZE]{};
+};
+
+static_assert(sizeof(Job) == 128, "Job should be two cache lines");
+
+class JobSystem
+{
+public:
+
+  static constexpr uint32_t JOB_POOL_SIZE = 4096; // jobs per thread. Power of two
+  static constexpr uint32_t QUEUE_SIZE = 1024; // queued jobs per worker, run() does more right away. Power of two
+
+  // workerCount 0 means one per core. The calling thread counts as one of them
+  explicit JobSystem(unsigned workerCount = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  // shared instance for engine code, made on first use by the thread that calls it first
+  static JobSystem& get();
+
+  unsigned getWorkerCount() const { return static_cast<unsigned>(mQueues.size()); };
+
+  // a job that calls function(). The lambda is copied into the job, so its captures must fit in Job::DATA_SIZE
+  // and it must be trivially destructible (capture pointers and references, not containers)
+  template <typename F>
+  Job* createJob(F&& function) { return createChild(nullptr, std::forward<F>(function)); };
+
+  // same, and parent isn't finished before this job is. Create children before parent finishes running
+  template <typename F>
+  Job* createChild(Job* parent, F&& function);
+
+  // queue a job on the calling worker. Any worker may take it from there
+  void run(Job* job);
+
+  // run other jobs until job has finished. Never blocks the calling thread while there is work
+  void wait(const Job* job);
+
+  static bool isFinished(const Job* job) { return job->unfinished.load(std::memory_order_acquire) == 0; };
+
+  // function(begin, end) over [0, count) in parallel, returns when every range is done
+  // the range is split in halves until pieces have grain elements, and the halves go to the deque for others
+  // to steal. grain 0 picks count / (workers * 4), so each worker gets a few pieces to balance uneven work
+  template <typename F>
+  void parallelFor(uint32_t count, const F& function, uint32_t grain = 0);
+
+private:
+
+  // Chase-Lev deque (Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models")
+  // fixed capacity: push fails when it's full and the caller runs the job itself
+  class WorkDeque
+  {
+  public:
+    bool push(Job* job);   // owner only
+    Job* pop();            // owner only
+    Job* steal();          // any thread
+
+  private:
+    alignas(64) std::atomic<int64_t> mTop{};
+    alignas(64) std::atomic<int64_t> mBottom{};
+    alignas(64) std::atomic<Job*> mJobs[QUEUE_SIZE]{};
+  };
+
+  // a free job from the calling thread's pool
+  static Job* allocateJob();
+
+  // a job to run: our own newest, or someone else's oldest
+  Job* findJob(uint32_t workerIndex);
+  void execute(Job* job);
+  void finish(Job* job);
+
+  // index of the calling thread in this system, UINT32_MAX for threads that aren't ours
+  uint32_t getWorkerIndex() const;
+
+  void workerLoop(uint32_t workerIndex);
+
+  template <typename F>
+  static void callFunction(Job& job) { (*reinterpret_cast<F*>(job.data))(); };
+
+  template <typename F>
+  struct ParallelForRange
+  {
+    const F* function;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t grain;
+  };
+
+  template <typename F>
+  static void parallelForJob(Job& job);
+
+  std::vector<std::unique_ptr<WorkDeque>> mQueues{}; // one per worker, 0 belongs to the thread that made us
+  std::vector<std::thread> mThreads{};
+  std::thread::id mOwner{};
+  std::atomic<bool> mRunning{ true };
+
+  // workers with nothing to do sleep here. run() wakes one if anybody sleeps
+  std::mutex mSleepMutex{};
+  std::condition_variable mWakeUp{};
+  std::atomic<uint32_t> mSleeping{};
+};
+
+template <typename F>
+Job* JobSystem::createChild(Job* parent, F&& function)
+{
+  using Function = std::decay_t<F>;
+  static_assert(sizeof(Function) <= Job::DATA_SIZE, "job lambda captures too much, capture a pointer to the data instead");
+  static_assert(alignof(Function) <= 8, "job lambda captures need more than 8 byte alignment");
+  static_assert(std::is_trivially_destructible<Function>::value, "job lambdas are never destroyed, capture trivially destructible things");
+
+  if (parent != nullptr) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+
+  Job* job = allocateJob();
+  job->function = &callFunction<Function>;
+  job->parent = parent;
+  job->system = this;
+  new (job->data) Function(std::forward<F>(function));
+  return job;
+}
+
+template <typename F>
+void JobSystem::parallelForJob(Job& job)
+{
+  const ParallelForRange<F>& range = *reinterpret_cast<const ParallelForRange<F>*>(job.data);
+  uint32_t end = range.end;
+
+  // hand out the upper half until our piece is small enough. The halves go to the parallelFor job, so
+  // waiting for it waits for all of them
+  while (end - range.begin > range.grain)
+  {
+    const uint32_t middle = range.begin + (end - range.begin) / 2;
+    Job* half = allocateJob();
+    job.parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    half->function = &parallelForJob<F>;
+    half->parent = job.parent;
+    half->system = job.system;
+    new (half->data) ParallelForRange<F>{ range.function, middle, end, range.grain };
+    job.system->run(half);
+    end = middle;
+  }
+
+  (*range.function)(range.begin, end);
+}
+
+template <typename F>
+void JobSystem::parallelFor(uint32_t count, const F& function, uint32_t grain)
+{
+  if (count == 0) return;
+  if (grain == 0) grain = count / (getWorkerCount() * 4);
+  if (grain == 0) grain = 1;
+
+  // the root does nothing itself. It's finished when all ranges are
+  Job* root = createJob([]() {});
+  Job* all = allocateJob();
+  root->unfinished.fetch_add(1, std::memory_order_relaxed);
+  all->function = &parallelForJob<F>;
+  all->parent = root;
+  all->system = this;
+  new (all->data) ParallelForRange<F>{ &function, 0, count, grain };
+
+  run(all);
+  run(root);
+  wait(root);
+}
+
+#endif // !JOB_SYSTEM_H
@@ -0,0 +1,111 @@
+#include <utility>
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : mData(other.mData), mSize(other.mSize)
+{
+  other.mData = nullptr;
+  other.mSize = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    close();
+    std::swap(mData, other.mData);
+    std::swap(mSize, other.mSize);
+  }
+  return *this;
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  // the view keeps the mapping and the file open, so both handles can be closed right away
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) return false;
+
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (view == nullptr) return false;
+
+  mData = static_cast<const uint8_t*>(view);
+  mSize = static_cast<size_t>(size.QuadPart);
+#else
+  const int file = ::open(filename.c_str(), O_RDONLY);
+  if (file < 0) return false;
+
+  struct stat status{};
+  if (fstat(file, &status) != 0 || status.st_size == 0)
+  {
+    ::close(file);
+    return false;
+  }
+
+  // like on Windows the mapping keeps the file alive after the descriptor is closed
+  void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+  ::close(file);
+  if (view == MAP_FAILED) return false;
+
+  mData = static_cast<const uint8_t*>(view);
+  mSize = static_cast<size_t>(status.st_size);
+#endif
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (mData == nullptr) return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(mData);
+#else
+  munmap(const_cast<uint8_t*>(mData), mSize);
+#endif
+  mData = nullptr;
+  mSize = 0;
+}
+
+void MappedFile::touchPages() const
+{
+  // 4 KB is the smallest page size of everything we run on. Touching more often is harmless
+  constexpr size_t TOUCH_STRIDE = 4096;
+
+  // volatile, so the compiler can't drop reads whose result isn't used
+  volatile uint8_t sink = 0;
+  for (size_t offset = 0; offset < mSize; offset += TOUCH_STRIDE)
+  {
+    sink = sink + mData[offset];
+  }
+  (void)sink;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdint.h>
+#include <string>
+
+// Read only view of a whole file mapped into the address space
+// The OS pages the file in on first access and shares the pages with its file cache, so nothing
+// is copied into a heap buffer. MapViewOfFile on Windows, mmap everywhere else
+class MappedFile
+{
+public:
+
+  MappedFile() = default;
+  ~MappedFile();
+
+  // a mapping has one owner. Moving hands it over
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  // maps the file, unmapping whatever was mapped before. Empty files can't be mapped
+  bool open(const std::string& filename);
+  void close();
+
+  // read one byte of every page, so the disk reads happen now on this thread
+  // and not later in whoever reads the data (the GL thread uploading a texture)
+  void touchPages() const;
+
+  bool isOpen() const { return mData != nullptr; };
+  const uint8_t* getData() const { return mData; };
+  size_t getSize() const { return mSize; };
+
+private:
+
+  const uint8_t* mData{};
+  size_t mSize{};
+};
+
+#endif // !MAPPED_FILE_H
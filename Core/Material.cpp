@@ -0,0 +1,348 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+#include <tuple>
+#include "Material.h"
+#include "TextureCompression.h"
+
+namespace
+{
+  // strip leading/trailing spaces, tabs and '\r' (files exported on Windows)
+  std::string trim(const std::string& line)
+  {
+    const size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos) return {};
+    const size_t last = line.find_last_not_of(" \t\r");
+    return line.substr(first, last - first + 1);
+  }
+
+  // "./Models/crate.mtl" -> "./Models/"
+  std::string directoryOf(const std::string& path)
+  {
+    const size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string{} : path.substr(0, slash + 1);
+  }
+
+  // "C:\Textures\crate.jpg" -> "crate.jpg". Exporters like to keep absolute paths in map_Kd
+  std::string fileNameOf(const std::string& path)
+  {
+    const size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+  }
+
+  bool fileExists(const std::string& path)
+  {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    return file.good();
+  }
+}
+
+MaterialLibrary::MaterialLibrary(TextureManager& textures, const std::string& textureDirectory)
+  : mTextures(textures), mTextureDirectory(textureDirectory)
+{}
+
+MaterialLibrary::~MaterialLibrary()
+{}
+
+bool MaterialLibrary::loadMTL(const std::string& filename, std::map<std::string, MaterialId>& materialIds)
+{
+  std::ifstream fin(filename, std::ios::in);
+  if (!fin)
+  {
+    std::cerr << "Cannot open " << filename << std::endl;
+    return false;
+  }
+
+  std::cout << "Loading MTL file " << filename << " ..." << std::endl;
+
+  const std::string mtlDirectory = directoryOf(filename);
+
+  Material current{};
+  bool hasCurrent = false;
+
+  // push the material we've been reading into the shared table
+  auto flush = [&]()
+  {
+    if (hasCurrent)
+    {
+      materialIds[current.name] = registerMaterial(current);
+    }
+    current = Material{};
+    hasCurrent = false;
+  };
+
+  std::string lineBuffer{};
+  while (std::getline(fin, lineBuffer))
+  {
+    const std::string line = trim(lineBuffer);
+
+    if (line.substr(0, 7) == "newmtl ")
+    {
+      // a new material starts. Register the previous one
+      flush();
+      current.name = trim(line.substr(7));
+      hasCurrent = true;
+    }
+    else if (line.substr(0, 3) == "Kd ")
+    {
+      std::istringstream kd(line.substr(3));
+      kd >> current.diffuseColor.r >> current.diffuseColor.g >> current.diffuseColor.b;
+    }
+    else if (line.substr(0, 7) == "map_Kd ")
+    {
+      // look next to the .mtl file first, then in the texture directory
+      const std::string map = trim(line.substr(7));
+      if (fileExists(mtlDirectory + map))
+      {
+        current.diffuseMap = mtlDirectory + map;
+      }
+      else
+      {
+        current.diffuseMap = mTextureDirectory + fileNameOf(map);
+      }
+    }
+  }
+  flush();
+
+  fin.close();
+  return true;
+}
+
+void MaterialLibrary::buildAtlas(const AtlasSettings& settings, unsigned decodeThreads)
+{
+  TextureAtlasBuilder builder(settings);
+
+  // only the headers are read to pick the textures that fit. Large ones are left to loadTextures()
+  // materials that only differ in colour share a map. It goes into the atlas once for all of them
+  std::map<std::string, std::vector<MaterialId>> candidates{};
+  for (MaterialId id = 0; id < mMaterials.size(); id++)
+  {
+    const Material& material = mMaterials[id];
+    if (material.diffuseMap.empty() || material.diffuseTexture || material.atlasPage != NO_ATLAS_PAGE || material.textureArray != NO_TEXTURE_ARRAY) continue;
+
+    std::map<std::string, std::vector<MaterialId>>::iterator candidate = candidates.find(material.diffuseMap);
+    if (candidate != candidates.end())
+    {
+      candidate->second.push_back(id);
+      continue;
+    }
+
+    uint32_t width{}, height{};
+    if (readImageSize(material.diffuseMap, width, height) && builder.canAdd(width, height))
+    {
+      candidates[material.diffuseMap].push_back(id);
+    }
+  }
+  if (candidates.empty()) return;
+
+  ImageDecodePool pool(std::min(decodeThreads == 0 ? std::thread::hardware_concurrency() : decodeThreads, static_cast<unsigned>(candidates.size())));
+  for (const std::pair<const std::string, std::vector<MaterialId>>& candidate : candidates)
+  {
+    pool.submit(candidate.first);
+  }
+
+  std::map<std::string, uint32_t> regions{};
+  DecodedImage decoded{};
+  while (pool.waitNext(decoded))
+  {
+    if (!decoded.loaded) continue;
+
+    // cooked textures may be DXT compressed. The atlas is built from RGBA8 and gets its own mips
+    ImageData decompressed{};
+    const ImageData* image = &decoded.image;
+    if (isBlockCompressed(decoded.image.format))
+    {
+      decoded.image.mips.resize(1);
+      decompressImage(decoded.image, decompressed);
+      image = &decompressed;
+    }
+
+    uint32_t region{};
+    if (builder.add(*image, region)) regions[decoded.path] = region;
+  }
+
+  if (!builder.build()) return;
+
+  for (const ImageData& page : builder.getPages())
+  {
+    mAtlasPages.push_back(std::make_unique<Texture2D>());
+    mAtlasPages.back()->upload(page, false);
+  }
+
+  for (const std::pair<const std::string, uint32_t>& region : regions)
+  {
+    const AtlasRegion& placement = builder.getRegion(region.second);
+    for (MaterialId id : candidates[region.first])
+    {
+      Material& material = mMaterials[id];
+      material.atlasPage = placement.page;
+      material.uvTransform = glm::vec4(placement.scaleU, placement.scaleV, placement.offsetU, placement.offsetV);
+    }
+  }
+
+  mAtlasStats = builder.getStats();
+  std::cout << "Packed " << mAtlasStats.textures << " textures into " << mAtlasStats.pages << " atlas pages, "
+    << std::fixed << std::setprecision(1) << mAtlasStats.getEfficiency() * 100.0 << "% of the page area used" << std::endl;
+}
+
+void MaterialLibrary::buildTextureArrays(unsigned decodeThreads, uint32_t minLayers)
+{
+  // materials that only differ in colour share a map. It's one layer for all of them
+  std::map<std::string, std::vector<MaterialId>> byMap{};
+  for (MaterialId id = 0; id < mMaterials.size(); id++)
+  {
+    const Material& material = mMaterials[id];
+    if (material.diffuseMap.empty() || material.diffuseTexture || material.atlasPage != NO_ATLAS_PAGE || material.textureArray != NO_TEXTURE_ARRAY) continue;
+    byMap[material.diffuseMap].push_back(id);
+  }
+
+  // the size is in the header. Only sizes shared by enough maps are decoded
+  std::map<std::pair<uint32_t, uint32_t>, std::vector<std::string>> bySize{};
+  for (const std::pair<const std::string, std::vector<MaterialId>>& map : byMap)
+  {
+    uint32_t width{}, height{};
+    if (readImageSize(map.first, width, height)) bySize[{ width, height }].push_back(map.first);
+  }
+
+  std::map<std::string, std::vector<MaterialId>> candidates{};
+  for (const std::pair<const std::pair<uint32_t, uint32_t>, std::vector<std::string>>& group : bySize)
+  {
+    if (group.second.size() < minLayers) continue;
+    for (const std::string& map : group.second) candidates[map] = byMap[map];
+  }
+  if (candidates.empty()) return;
+
+  // cooked maps are mapped, so the layers go from the page cache to the driver like standalone textures
+  ImageDecodePool pool(std::min(decodeThreads == 0 ? std::thread::hardware_concurrency() : decodeThreads, static_cast<unsigned>(candidates.size())), true, true);
+  for (const std::pair<const std::string, std::vector<MaterialId>>& candidate : candidates)
+  {
+    pool.submit(candidate.first);
+  }
+
+  // the header doesn't tell about format and mips. Layers must match in those too
+  std::vector<DecodedImage> images{};
+  std::map<std::tuple<uint32_t, uint32_t, TextureFormat, size_t>, std::vector<size_t>> groups{};
+  DecodedImage decoded{};
+  while (pool.waitNext(decoded))
+  {
+    if (!decoded.loaded) continue;
+
+    const MipLevelView& top = decoded.view.mips[0];
+    groups[{ top.width, top.height, decoded.view.format, decoded.view.mips.size() }].push_back(images.size());
+    images.push_back(std::move(decoded));
+  }
+
+  uint32_t layers{};
+  for (const std::pair<const std::tuple<uint32_t, uint32_t, TextureFormat, size_t>, std::vector<size_t>>& group : groups)
+  {
+    if (group.second.size() < minLayers) continue;
+
+    std::vector<ImageView> views{};
+    for (size_t image : group.second) views.push_back(images[image].view);
+
+    std::unique_ptr<TextureArray2D> textureArray = std::make_unique<TextureArray2D>();
+    if (!textureArray->upload(views)) continue;
+
+    for (size_t layer = 0; layer < group.second.size(); layer++)
+    {
+      for (MaterialId id : candidates[images[group.second[layer]].path])
+      {
+        Material& material = mMaterials[id];
+        material.textureArray = static_cast<uint32_t>(mTextureArrays.size());
+        material.arrayLayer = static_cast<float>(layer);
+      }
+    }
+    layers += static_cast<uint32_t>(group.second.size());
+    mTextureArrays.push_back(std::move(textureArray));
+  }
+
+  if (!mTextureArrays.empty()) std::cout << "Grouped " << layers << " textures into " << mTextureArrays.size() << " texture arrays" << std::endl;
+}
+
+void MaterialLibrary::loadTextures(unsigned decodeThreads)
+{
+  std::vector<std::string> paths{};
+  std::vector<MaterialId> ids{};
+  for (MaterialId id = 0; id < mMaterials.size(); id++)
+  {
+    const Material& material = mMaterials[id];
+    if (!material.diffuseMap.empty() && !material.diffuseTexture && material.atlasPage == NO_ATLAS_PAGE && material.textureArray == NO_TEXTURE_ARRAY)
+    {
+      paths.push_back(material.diffuseMap);
+      ids.push_back(id);
+    }
+  }
+
+  // an invalid handle draws the material untextured. acquire() already reported the error
+  std::vector<TextureHandle> handles = mTextures.acquire(paths, decodeThreads);
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    mMaterials[ids[i]].diffuseTexture = std::move(handles[i]);
+  }
+}
+
+uint32_t MaterialLibrary::getBindKey(MaterialId id) const
+{
+  if (id >= mMaterials.size()) return UINT32_MAX;
+
+  // pages first, then arrays, then one key per texture set with its own texture. Materials that only differ
+  // in colour bind the same texture, so they take the key of the first material with their texture set
+  const Material& material = mMaterials[id];
+  const uint32_t pages = static_cast<uint32_t>(mAtlasPages.size());
+  if (material.atlasPage != NO_ATLAS_PAGE) return material.atlasPage;
+  if (material.textureArray != NO_TEXTURE_ARRAY) return pages + material.textureArray;
+  return pages + static_cast<uint32_t>(mTextureArrays.size()) + mMaterialsByTextureSet.at(material.diffuseMap);
+}
+
+void MaterialLibrary::bind(MaterialId id, GLint texUnit)
+{
+  if (id >= mMaterials.size()) return;
+
+  const Material& material = mMaterials[id];
+  if (material.atlasPage != NO_ATLAS_PAGE) mAtlasPages[material.atlasPage]->bind(texUnit);
+  else if (material.textureArray != NO_TEXTURE_ARRAY) mTextureArrays[material.textureArray]->bind(TEXTURE_ARRAY_UNIT);
+  else material.diffuseTexture.bind(texUnit);
+}
+
+void MaterialLibrary::unbind(MaterialId id, GLint texUnit)
+{
+  if (id >= mMaterials.size()) return;
+
+  const Material& material = mMaterials[id];
+  if (material.atlasPage != NO_ATLAS_PAGE) mAtlasPages[material.atlasPage]->unbind(texUnit);
+  else if (material.textureArray != NO_TEXTURE_ARRAY) mTextureArrays[material.textureArray]->unbind(TEXTURE_ARRAY_UNIT);
+  else material.diffuseTexture.unbind(texUnit);
+}
+
+void MaterialLibrary::requestPixelsPerUV(MaterialId id, float pixelsPerUV)
+{
+  if (id >= mMaterials.size()) return;
+
+  // atlas pages and texture arrays are loaded in full
+  const Material& material = mMaterials[id];
+  if (material.atlasPage == NO_ATLAS_PAGE && material.textureArray == NO_TEXTURE_ARRAY) material.diffuseTexture.requestPixelsPerUV(pixelsPerUV);
+}
+
+MaterialId MaterialLibrary::registerMaterial(const Material& material)
+{
+  // materials with the same texture set and the same constant colour look the same, so they share an id
+  // only diffuse maps are supported for now. Names don't count, they're only unique inside one file
+  std::ostringstream key{};
+  key << material.diffuseMap << '|' << std::setprecision(9)
+    << material.diffuseColor.r << ' ' << material.diffuseColor.g << ' ' << material.diffuseColor.b;
+
+  std::map<std::string, MaterialId>::iterator it = mMaterialsByKey.find(key.str());
+  if (it != mMaterialsByKey.end())
+  {
+    return it->second;
+  }
+
+  const MaterialId id = static_cast<MaterialId>(mMaterials.size());
+  mMaterials.push_back(material);
+  mMaterialsByKey[key.str()] = id;
+  mMaterialsByTextureSet.emplace(material.diffuseMap, id); // keeps the first one
+  return id;
+}
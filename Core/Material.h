@@ -0,0 +1,121 @@
+#pragma once
+
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+#include "TextureManager.h"
+#include "TextureAtlas.h"
+#include "TextureArray2D.h"
+
+// id of a material in the MaterialLibrary. Meshes loaded without a library use INVALID_MATERIAL
+using MaterialId = uint32_t;
+constexpr MaterialId INVALID_MATERIAL = UINT32_MAX;
+
+constexpr uint32_t NO_ATLAS_PAGE = UINT32_MAX;
+constexpr uint32_t NO_TEXTURE_ARRAY = UINT32_MAX;
+
+// texture arrays are sampled with a sampler2DArray, which can't share a unit with the sampler2D of the other maps
+constexpr GLint TEXTURE_ARRAY_UNIT = 2;
+
+// surface description read from a Wavefront .mtl file
+struct Material
+{
+  std::string name{};
+  glm::vec3 diffuseColor{ 1.0f }; // Kd
+  std::string diffuseMap{};       // map_Kd resolved to a path we can load
+  TextureHandle diffuseTexture{}; // invalid if the material has no map_Kd or it failed to load
+
+  // set if the diffuse map was packed into an atlas page instead of getting its own texture
+  uint32_t atlasPage{ NO_ATLAS_PAGE };
+
+  // where the diffuse map is in the bound texture. xy scale, zw offset. The shader wraps the UVs into it
+  glm::vec4 uvTransform{ 1.0f, 1.0f, 0.0f, 0.0f };
+
+  // set if the diffuse map is a layer of a texture array. The shader gets the layer, -1 means no array
+  uint32_t textureArray{ NO_TEXTURE_ARRAY };
+  float arrayLayer{ -1.0f };
+};
+
+// Shared table of materials for all meshes in the scene
+// Materials are deduplicated by their texture set and colour, so two .mtl entries with the same map_Kd and Kd
+// end up with the same MaterialId. Materials that only differ in colour keep their ids, but share the bind key
+// (and the atlas region or array layer) of their texture, so the draw loop still binds it once for all of them
+class MaterialLibrary
+{
+public:
+
+  // textures are shared through the manager, so other systems loading the same file get the same texture
+  // textureDirectory is the fallback folder for map_Kd entries that aren't found next to the .mtl file
+  MaterialLibrary(TextureManager& textures, const std::string& textureDirectory = "./Textures/");
+  ~MaterialLibrary();
+
+  MaterialLibrary(const MaterialLibrary&) = delete;
+  MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+  // parse a .mtl file and register its materials
+  // names are only unique inside one file, so the name -> id table for this file is returned through materialIds
+  // textures aren't loaded here. Call loadTextures() once all .mtl files are in
+  bool loadMTL(const std::string& filename, std::map<std::string, MaterialId>& materialIds);
+
+  // pack the small diffuse maps of the registered materials into atlas pages. Materials sharing a page
+  // share a bind. Call it before loadTextures(), which then only loads what didn't go into the atlas
+  // the pages are owned by the library and don't count against the TextureManager budget
+  void buildAtlas(const AtlasSettings& settings = AtlasSettings{}, unsigned decodeThreads = 0);
+
+  // put the diffuse maps that didn't go into the atlas into texture arrays, one per size, format and mip count
+  // shared by at least minLayers maps. Materials in the same array share a bind. Call it before loadTextures()
+  // the arrays are owned by the library and don't count against the TextureManager budget
+  void buildTextureArrays(unsigned decodeThreads = 0, uint32_t minLayers = 2);
+
+  // load the textures of all registered materials in one batch, so they are decoded in parallel
+  // decodeThreads 0 = one per core
+  void loadTextures(unsigned decodeThreads = 0);
+
+  // materials with the same key bind the same texture. The draw loop sorts by it
+  uint32_t getBindKey(MaterialId id) const;
+
+  const AtlasStats& getAtlasStats() const { return mAtlasStats; };
+  size_t getTextureArrayCount() const { return mTextureArrays.size(); };
+
+  // bind textures of the material. Texture unit arg works as in Texture2D::bind()
+  // a texture array is bound to TEXTURE_ARRAY_UNIT instead
+  void bind(MaterialId id, GLint texUnit = 0);
+  void unbind(MaterialId id, GLint texUnit = 0);
+
+  // texture streaming feedback for the material's textures. See TextureHandle::requestPixelsPerUV()
+  void requestPixelsPerUV(MaterialId id, float pixelsPerUV);
+
+  const Material& getMaterial(MaterialId id) const { return mMaterials[id]; };
+  size_t getMaterialCount() const { return mMaterials.size(); };
+
+private:
+
+  // add a material to the table or return the id of the one with the same texture set and colour
+  MaterialId registerMaterial(const Material& material);
+
+  TextureManager& mTextures;
+
+  std::string mTextureDirectory{};
+
+  std::vector<Material> mMaterials{};
+
+  std::vector<std::unique_ptr<Texture2D>> mAtlasPages{};
+  AtlasStats mAtlasStats{};
+
+  std::vector<std::unique_ptr<TextureArray2D>> mTextureArrays{};
+
+  // texture set and colour -> material id. Used for deduplication
+  std::map<std::string, MaterialId> mMaterialsByKey{};
+
+  // texture set -> first material with it. Its id is the bind key of all of them
+  std::map<std::string, MaterialId> mMaterialsByTextureSet{};
+};
+
+#endif // !MATERIAL_H
@@ -1,8 +1,10 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <map>
 #include "Mesh.h"
-#include "Containers/FVector.h"
+#include "AssetFormats.h"
+#include "RenderState.h"
 
 
 Mesh::Mesh()
@@ -13,130 +15,162 @@ Mesh::~Mesh()
 {
   // clean up on dtr
 
+  // the pool owns the VAO of pooled meshes
   // delete vertex array object
   // args (number of arrays, address of the array)
-  glDeleteVertexArrays(1, &mVAO);
+  if (mPool == nullptr) RenderState::get().deleteVertexArray(mVAO);
 
   // delete position vertex buffer object (separate buffer layout)
   // args (number of buffers, address of the buffer)
-  glDeleteBuffers(1, &mVBO);
+  RenderState::get().deleteBuffer(mVBO);
+
+  // delete index buffer object
+  RenderState::get().deleteBuffer(mIBO);
 }
 
-bool Mesh::loadOBJ(const std::string & filename)
+bool Mesh::loadOBJ(const std::string & filename, MaterialLibrary* materials, MeshPool* pool)
 {
-  // temp containers to hold data while reading obj files
-  FVector<unsigned int> vertexIndices, uvIndices{};
-  FVector<glm::vec3> tempVertices{};
-  FVector<glm::vec2> tempUVs{};
+  // prefer what the offline cooker produced. It's already indexed and optimized for the vertex cache
+  const std::string cookedFilename = getCookedPath(filename);
+  if (isCookedAssetUpToDate(filename, cookedFilename) && loadCooked(cookedFilename, filename, materials, pool))
+  {
+    return true;
+  }
 
-  // check if the file has obj extention
-  if (filename.find(".obj") != std::string::npos)
+  MeshData data{};
+  if (!parseOBJ(filename, data))
   {
-    std::ifstream fin(filename, std::ios::in); // open a file with input file stream
-    if (!fin)
-    {
-      // failed to open
-      std::cerr << "Cannot open " << filename << std::endl;
-      return false;
-    }
+    return false;
+  }
 
-    // if the file found we display a message
-    std::cout << "Loading OBJ file " << filename << " ..." << std::endl;
+  return upload(data, filename, materials, pool);
+}
+
+bool Mesh::loadCooked(const std::string& filename, const std::string& sourceFilename, MaterialLibrary* materials, MeshPool* pool)
+{
+  MeshData data{};
+  if (!readFlyMesh(filename, data))
+  {
+    return false;
+  }
 
-    std::string lineBuffer{};
+  std::cout << "Loading cooked mesh " << filename << " ..." << std::endl;
+  return upload(data, sourceFilename, materials, pool);
+}
 
-    // reading obj file
-    while (std::getline(fin, lineBuffer)) // getting a line by line from the file if found
+bool Mesh::upload(const MeshData& data, const std::string& sourceFilename, MaterialLibrary* materials, MeshPool* pool)
+{
+  // material names are only unique inside one .mtl file. Load the libraries of this mesh and map names to ids
+  std::map<std::string, MaterialId> fileMaterials{};
+  if (materials != nullptr)
+  {
+    // "mtllib" paths are relative to the OBJ file
+    const size_t slash = sourceFilename.find_last_of("/\\");
+    const std::string directory = slash == std::string::npos ? std::string{} : sourceFilename.substr(0, slash + 1);
+
+    for (const std::string& library : data.materialLibraries)
     {
-      if (lineBuffer.substr(0, 2) == "v ") // looking for a "v " (vertex data) in the file (0, 2) - look for 2 characters from the begining of the each line
-      {
-        std::istringstream v(lineBuffer.substr(2)); // input string stream reads the line after substr 2
-        glm::vec3 vertex;
-        v >> vertex.x; v >> vertex.y; v >> vertex.z; // write data from the file after substring 2 into vec3 in sequence
-        tempVertices.Add(vertex); // add vertex data into temp container
-      }
-      else if (lineBuffer.substr(0, 2) == "vt") // looking for a "vt" (vertex texture data) in the file (0, 2) - look for 2 characters from the begining of the each line
-      {
-        std::istringstream vt(lineBuffer.substr(3)); // the same algorithm goes here as above. Write uv data into vec2 and add into a temp container
-        glm::vec2 uv; // ignore w
-        vt >> uv.s; vt >> uv.t; // look at obj file to understand this process how it reads and writes
-        tempUVs.Add(uv);
-      }
-      else if (lineBuffer.substr(0, 2) == "f ") // looking for a "f " (faces data) in the file (0, 2) - look for 2 characters from the begining of the each line
-      {
-        int p1, p2, p3; //to store mesh index
-        int t1, t2, t3; //to store texture index
-        int n1, n2, n3;
-        const char* face = lineBuffer.c_str();
-        int match = sscanf_s(face, "f %i/%i/%i %i/%i/%i %i/%i/%i", // read triangles by 3 point and writes them into vars below
-          &p1, &t1, &n1,
-          &p2, &t2, &n2,
-          &p3, &t3, &n3);
-        if (match != 9) // sscanf has to return int with 9 elements (triangle has 3 points) each point = position (p1), texture coords (t1), normal(n1). See vars above
-          std::cout << "Failed to parse OBJ file using our very simple OBJ loader" << std::endl;
-
-        // We are ignoring normals (for now)
-        // fill indices list from gotten data above
-        vertexIndices.Add(p1);
-        vertexIndices.Add(p2);
-        vertexIndices.Add(p3);
-        // fill UV indices list from gotten data above
-        uvIndices.Add(t1);
-        uvIndices.Add(t2);
-        uvIndices.Add(t3);
-      }
+      materials->loadMTL(directory + library, fileMaterials);
     }
+  }
 
-    // Close the file
-    fin.close();
-
+  mSubMeshes.clear();
+  for (const MeshSection& section : data.sections)
+  {
+    SubMesh subMesh{};
+    subMesh.firstIndex = section.firstIndex;
+    subMesh.indexCount = section.indexCount;
+    subMesh.uvDensity = computeUVDensity(data, section.firstIndex, section.indexCount);
 
-    // For each vertex of each triangle
-    // process data from temp containers and create data that VBO is going to use
-    for (unsigned int i = 0; i < vertexIndices.Size(); i++)
+    std::map<std::string, MaterialId>::iterator it = fileMaterials.find(section.material);
+    if (it != fileMaterials.end())
     {
-      // Get the attributes using the indices
-      // intermediate step before creating final data
-      // back to vertex and uv data
-      glm::vec3 vertex = tempVertices[vertexIndices[i] - 1];
-      glm::vec2 uv = tempUVs[uvIndices[i] - 1];
-
-      // assign final values
-      Vertex meshVertex;
-      meshVertex.position = vertex;
-      meshVertex.texCoords = uv;
-
-      VertexBuffer.Add(meshVertex);
+      subMesh.material = it->second;
+    }
+    else if (materials != nullptr && !section.material.empty())
+    {
+      std::cout << "Material " << section.material << " is not declared in any mtllib of " << sourceFilename << std::endl;
     }
 
-    // Create and initialize the buffers
-    initBuffers();
+    mSubMeshes.push_back(subMesh);
+  }
 
-    return (mLoaded = true);
+  computeBoundingSphere(data, mBoundsCenter, mBoundsRadius);
+
+  // Create and initialize the buffers, or append to the shared ones of the pool
+  if (pool != nullptr)
+  {
+    const MeshPool::Allocation allocation = pool->add(data);
+    mPool = pool;
+    mVAO = pool->getVertexArray();
+    mBaseVertex = allocation.baseVertex;
+    mFirstIndex = allocation.firstIndex;
+    mIndexCount = static_cast<GLsizei>(data.indices.size());
+    for (SubMesh& subMesh : mSubMeshes) subMesh.firstIndex += allocation.firstIndex;
+  }
+  else
+  {
+    initBuffers(data);
   }
 
-  // We shouldn't get here so return failure
-  return false;
+  return (mLoaded = true);
 }
 
 void Mesh::draw()
 {
   if (!mLoaded) return;
 
-  // we do this every time we draw our array
-  glBindVertexArray(mVAO);
+  // we do this every time we draw our array. The state cache skips it when the VAO is bound already
+  RenderState::get().bindVertexArray(mVAO);
 
-  // draw array
-  // args (type of what we draw, first element (vertex in the array), last element (vertex) in the array)
-  glDrawArrays(GL_TRIANGLES, 0, VertexBuffer.Size());
+  // draw indexed triangles
+  // args (type of what we draw, number of indices, type of indices, offset in the index buffer)
+  glDrawElementsBaseVertex(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, (GLvoid*)(mFirstIndex * sizeof(uint32_t)), mBaseVertex);
 
-  // unbinding. Close it down by passing 0 as an argument
-  // by this (0 arg) we tell OpenGL we're done with our vertex array object and other code won't have an access to it
-  // OpenGL closes this vertex array object not to allow errors through code (inadvertent remove or something like this)
-  glBindVertexArray(0);
+  // no unbinding. Everything that binds a VAO or an element buffer goes through the state cache,
+  // so nobody changes our VAO by accident and the next draw of this mesh doesn't rebind it
+}
+
+void Mesh::drawSubMesh(size_t index)
+{
+  if (!mLoaded || index >= mSubMeshes.size()) return;
+
+  const SubMesh& subMesh = mSubMeshes[index];
+
+  RenderState::get().bindVertexArray(mVAO);
+
+  // args (type of what we draw, number of indices in the material range, type of indices, byte offset of the range,
+  // where our vertices start. Indices are relative to it)
+  glDrawElementsBaseVertex(GL_TRIANGLES, subMesh.indexCount, GL_UNSIGNED_INT, (GLvoid*)(subMesh.firstIndex * sizeof(uint32_t)), mBaseVertex);
+}
+
+void Mesh::drawSubMeshInstanced(size_t index, GLuint instanceBuffer, GLintptr instanceOffset, GLsizei instanceCount)
+{
+  if (!mLoaded || index >= mSubMeshes.size() || instanceCount <= 0) return;
+
+  const SubMesh& subMesh = mSubMeshes[index];
+
+  RenderState::get().bindVertexArray(mVAO);
+
+  // attribute pointers read GL_ARRAY_BUFFER when they're set. A mat4 attribute is 4 vec4 columns, each
+  // advancing once per instance (divisor 1) instead of once per vertex
+  RenderState::get().bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  for (GLuint column = 0; column < 4; column++)
+  {
+    const GLuint location = INSTANCE_MODEL_LOCATION + column;
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(instanceOffset + column * sizeof(glm::vec4)));
+    if (!mInstanceAttributes)
+    {
+      glEnableVertexAttribArray(location);
+      glVertexAttribDivisor(location, 1);
+    }
+  }
+  mInstanceAttributes = true;
+
+  glDrawElementsInstancedBaseVertex(GL_TRIANGLES, subMesh.indexCount, GL_UNSIGNED_INT, (GLvoid*)(subMesh.firstIndex * sizeof(uint32_t)), instanceCount, mBaseVertex);
 }
 
-void Mesh::initBuffers()
+void Mesh::initBuffers(const MeshData& data)
 {
   // NOW WE'RE GOING TO GENERATE BUFFER AND ARRAY HERE, NOT IN THE MAIN.CPP
   // WE JUST COPIED CODE FROM THERE
@@ -146,14 +180,14 @@ void Mesh::initBuffers()
   glGenBuffers(1, &mVBO); //args: number of buffers, it returns back an identifer for the buffer through the variable vbo
 
   // makes a created buffer as a current buffer. Only one buffer at a time can be active in OpenGL
-  glBindBuffer(GL_ARRAY_BUFFER, mVBO); // args: kind of buffer we wanna make active (array buffer because we have an array), its identifier) 
+  RenderState::get().bindBuffer(GL_ARRAY_BUFFER, mVBO); // args: kind of buffer we wanna make active (array buffer because we have an array), its identifier) 
 
   // fill our buffer with data
   // after these 3 calls above we created a buffer in GPU and copied our triangle data (vertices) to it
-  // VertexBuffer.size() * sizeof(Vertex) we get the size of the buffer in bytes we need VertexBuffer.size() = number of elements in the container
+  // data.vertices.size() * sizeof(Vertex) we get the size of the buffer in bytes we need data.vertices.size() = number of elements in the container
   // sizeof(Vertex) = size of one element in the container
-  // &VertexBuffer[0] = ptr to the first element. Arg = address of data
-  glBufferData(GL_ARRAY_BUFFER, VertexBuffer.Size() * sizeof(Vertex), &VertexBuffer[0], GL_STATIC_DRAW); // args: kind of buffer, its size, actural data, type of drawing (STATIC/DYNAMIC/STREAM)
+  // data.vertices.data() = ptr to the first element. Arg = address of data
+  glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(Vertex), data.vertices.data(), GL_STATIC_DRAW); // args: kind of buffer, its size, actural data, type of drawing (STATIC/DYNAMIC/STREAM)
 
   //// generate actual vertext buffer object
   //// it creates a chunk of memory in the graphics card for us
@@ -174,7 +208,7 @@ void Mesh::initBuffers()
   glGenVertexArrays(1, &mVAO); // number, bind identifier
 
   // make it an active vertex array object by binding it
-  glBindVertexArray(mVAO);
+  RenderState::get().bindVertexArray(mVAO);
 
   //// call it agian because only 1 buufer might be active at a given time. We ensure we work with an appropriate buffer next call
   //glBindBuffer(GL_ARRAY_BUFFER, vbo_position); // args: kind of buffer we wanna make active (array buffer because we have an array), its identifier) 
@@ -205,7 +239,13 @@ void Mesh::initBuffers()
   // as before enable our array vertex attribute for UV data (1)
   glEnableVertexAttribArray(1);
 
+  // index buffer object. GL_ELEMENT_ARRAY_BUFFER binding is stored in the VAO, so it has to be bound while the VAO is
+  glGenBuffers(1, &mIBO);
+  RenderState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(uint32_t), data.indices.data(), GL_STATIC_DRAW);
+  mIndexCount = static_cast<GLsizei>(data.indices.size());
+
   // by this (0 arg) we tell OpenGL we're done with our vertex array object and other code won't have an access to it
   // OpenGL closes this vertex array object not to allow errors through code (inadvertent remove or something like this)
-  glBindVertexArray(0);
+  RenderState::get().bindVertexArray(0);
 }
@@ -4,16 +4,20 @@
 #define MESH_H
 
 #include <string>
+#include <vector>
 #include "GL/glew.h"
 #include "glm/glm.hpp"
-#include "Containers/FVector.h"
+#include "MeshData.h"
+#include "Material.h"
+#include "MeshPool.h"
 
-
-// a custom data type that's gonna hold vertex data
-struct Vertex
+// a range of indices drawn with one material (one "usemtl" block of the OBJ file)
+struct SubMesh
 {
-  glm::vec3 position{};
-  glm::vec2 texCoords{};
+  uint32_t firstIndex{}; // in the index buffer the mesh draws from (the pool's one for pooled meshes)
+  uint32_t indexCount{};
+  MaterialId material{ INVALID_MATERIAL };
+  float uvDensity{}; // UV units per object space unit. Texture streaming picks mips with it
 };
 
 class Mesh
@@ -25,24 +29,71 @@ public:
 public:
 
   // method to load OBJ files
-  bool loadOBJ(const std::string& filename);
+  // with a material library "mtllib"/"usemtl" are honored and the mesh is split into one sub-mesh per material
+  // if flycook has produced an up to date .flymesh for the file, that one is loaded instead
+  // with a pool the geometry goes into the pool's shared buffers instead of buffers of our own
+  bool loadOBJ(const std::string& filename, MaterialLibrary* materials = nullptr, MeshPool* pool = nullptr);
+
+  // load a .flymesh written by the offline cooker. sourceFilename is used to resolve "mtllib" paths
+  bool loadCooked(const std::string& filename, const std::string& sourceFilename, MaterialLibrary* materials = nullptr, MeshPool* pool = nullptr);
 
   // draw vertices
   void draw();
 
+  // draw only one material range. Used by the draw loop to batch sub-meshes by material
+  void drawSubMesh(size_t index);
+
+  // draw one material range instanceCount times. Each instance reads its model matrix (a mat4, 64 bytes)
+  // from instanceBuffer starting at instanceOffset. The attributes are re-pointed on every call, so the
+  // matrices can live in a ring buffer that moves each frame
+  void drawSubMeshInstanced(size_t index, GLuint instanceBuffer, GLintptr instanceOffset, GLsizei instanceCount);
+
+  // first of the 4 attribute locations of the per instance model matrix. Shaders declare it with this location
+  static constexpr GLuint INSTANCE_MODEL_LOCATION = 2;
+
+  // pooled meshes share their VAO and buffers with the other meshes of the pool. Multi-draw batches
+  // are built from getSubMesh() ranges and getBaseVertex()
+  MeshPool* getPool() const { return mPool; };
+  GLint getBaseVertex() const { return mBaseVertex; };
+
+  size_t getSubMeshCount() const { return mSubMeshes.size(); };
+  const SubMesh& getSubMesh(size_t index) const { return mSubMeshes[index]; };
+
+  // bounding sphere in object space
+  const glm::vec3& getBoundsCenter() const { return mBoundsCenter; };
+  float getBoundsRadius() const { return mBoundsRadius; };
+
 private:
 
-  // create buffers VBO and VAO to send vertices to a video card and draw them 
-  void initBuffers();
+  // resolve materials of the sections and upload the data
+  bool upload(const MeshData& data, const std::string& sourceFilename, MaterialLibrary* materials, MeshPool* pool);
+
+  // create buffers VBO, IBO and VAO to send vertices to a video card and draw them 
+  void initBuffers(const MeshData& data);
 
   // flag for internal use to check if we successfully read OBJ before creating buffers
   bool mLoaded{};
 
-  // container that holds vertices of a mesh
-  FVector<Vertex> VertexBuffer{};
+  // our range of the IBO
+  uint32_t mFirstIndex{};
+  GLsizei mIndexCount{};
+
+  // where our vertices start in the VBO. 0 unless the mesh is in a pool
+  MeshPool* mPool{};
+  GLint mBaseVertex{};
+
+  // material ranges of the index buffer. Indices are sorted so each material is contiguous
+  std::vector<SubMesh> mSubMeshes{};
+
+  glm::vec3 mBoundsCenter{};
+  float mBoundsRadius{};
+
+  // our VAO, VBO and IBO that contain vertices of mesh to draw them on the video card
+  // pooled meshes use the pool's VAO and have no buffers of their own
+  GLuint mVBO{}, mIBO{}, mVAO{};
 
-  // our VAO and VBO that contain vertices of mesh to draw them on the video card
-  GLuint mVBO{}, mVAO{};
+  // the instance attributes are enabled on the first instanced draw, when there is a buffer to point them at
+  bool mInstanceAttributes{};
 };
 
 
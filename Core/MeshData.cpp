@@ -0,0 +1,423 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+#include "MeshData.h"
+
+namespace
+{
+  // OBJ indices start at 1, negative ones count back from the last element read so far (-1 is the last)
+  // returns the 0 based index, or -1 if it doesn't name an element
+  int resolveOBJIndex(int index, size_t count)
+  {
+    const int64_t resolved = index > 0 ? static_cast<int64_t>(index) - 1 : static_cast<int64_t>(count) + index;
+    if (index == 0 || resolved < 0 || resolved >= static_cast<int64_t>(count)) return -1;
+    return static_cast<int>(resolved);
+  }
+}
+
+bool parseOBJ(const std::string& filename, MeshData& mesh)
+{
+  // temp containers to hold data while reading obj files
+  std::vector<glm::vec3> tempVertices{};
+  std::vector<glm::vec2> tempUVs{};
+
+  // triangles as indices into mesh.vertices and the material (index into materialNames) of each triangle
+  std::vector<uint32_t> faceIndices{};
+  std::vector<uint32_t> faceMaterials{};
+  std::vector<std::string> materialNames{ std::string{} }; // 0 = faces before any "usemtl"
+  uint32_t currentMaterial = 0;
+
+  // a position/uv pair we've already turned into a vertex. Key = position index << 32 | uv index
+  std::unordered_map<uint64_t, uint32_t> uniqueVertices{};
+
+  mesh = MeshData{};
+
+  // check if the file has obj extention
+  if (filename.find(".obj") == std::string::npos)
+  {
+    return false;
+  }
+
+  std::ifstream fin(filename, std::ios::in); // open a file with input file stream
+  if (!fin)
+  {
+    // failed to open
+    std::cerr << "Cannot open " << filename << std::endl;
+    return false;
+  }
+
+  // if the file found we display a message
+  std::cout << "Loading OBJ file " << filename << " ..." << std::endl;
+
+  std::string lineBuffer{};
+
+  // reading obj file
+  while (std::getline(fin, lineBuffer)) // getting a line by line from the file if found
+  {
+    if (lineBuffer.substr(0, 7) == "mtllib ") // material file. Its path is relative to the OBJ file
+    {
+      std::istringstream mtl(lineBuffer.substr(7));
+      std::string mtlName{};
+      mtl >> mtlName;
+      mesh.materialLibraries.push_back(mtlName);
+    }
+    else if (lineBuffer.substr(0, 7) == "usemtl ") // all next faces use this material
+    {
+      std::istringstream mtl(lineBuffer.substr(7));
+      std::string mtlName{};
+      mtl >> mtlName;
+
+      std::vector<std::string>::iterator it = std::find(materialNames.begin(), materialNames.end(), mtlName);
+      currentMaterial = static_cast<uint32_t>(it - materialNames.begin());
+      if (it == materialNames.end())
+      {
+        materialNames.push_back(mtlName);
+      }
+    }
+    else if (lineBuffer.substr(0, 2) == "v ") // looking for a "v " (vertex data) in the file (0, 2) - look for 2 characters from the begining of the each line
+    {
+      std::istringstream v(lineBuffer.substr(2)); // input string stream reads the line after substr 2
+      glm::vec3 vertex;
+      v >> vertex.x; v >> vertex.y; v >> vertex.z; // write data from the file after substring 2 into vec3 in sequence
+      tempVertices.push_back(vertex); // add vertex data into temp container
+    }
+    else if (lineBuffer.substr(0, 2) == "vt") // looking for a "vt" (vertex texture data) in the file (0, 2) - look for 2 characters from the begining of the each line
+    {
+      std::istringstream vt(lineBuffer.substr(3)); // the same algorithm goes here as above. Write uv data into vec2 and add into a temp container
+      glm::vec2 uv; // ignore w
+      vt >> uv.s; vt >> uv.t; // look at obj file to understand this process how it reads and writes
+      tempUVs.push_back(uv);
+    }
+    else if (lineBuffer.substr(0, 2) == "f ") // looking for a "f " (faces data) in the file (0, 2) - look for 2 characters from the begining of the each line
+    {
+      int p[3]; //to store mesh index
+      int t[3]; //to store texture index
+      int n[3];
+      const char* face = lineBuffer.c_str();
+      int match = sscanf_s(face, "f %i/%i/%i %i/%i/%i %i/%i/%i", // read triangles by 3 point and writes them into vars below
+        &p[0], &t[0], &n[0],
+        &p[1], &t[1], &n[1],
+        &p[2], &t[2], &n[2]);
+      if (match != 9) // sscanf has to return int with 9 elements (triangle has 3 points) each point = position (p1), texture coords (t1), normal(n1). See vars above
+      {
+        std::cout << "Failed to parse OBJ file using our very simple OBJ loader" << std::endl;
+        continue;
+      }
+
+      // We are ignoring normals (for now)
+      // turn every position/uv pair into a vertex. Pairs we've seen before reuse their vertex
+      for (int corner = 0; corner < 3; corner++)
+      {
+        p[corner] = resolveOBJIndex(p[corner], tempVertices.size());
+        t[corner] = resolveOBJIndex(t[corner], tempUVs.size());
+        if (p[corner] < 0 || t[corner] < 0)
+        {
+          std::cerr << "Face with an invalid vertex index in " << filename << ": " << lineBuffer << std::endl;
+          mesh = MeshData{};
+          return false;
+        }
+
+        const uint64_t key = (static_cast<uint64_t>(p[corner]) << 32) | static_cast<uint32_t>(t[corner]);
+        std::unordered_map<uint64_t, uint32_t>::iterator it = uniqueVertices.find(key);
+        if (it != uniqueVertices.end())
+        {
+          faceIndices.push_back(it->second);
+          continue;
+        }
+
+        // Get the attributes using the resolved indices
+        Vertex meshVertex;
+        meshVertex.position = tempVertices[p[corner]];
+        meshVertex.texCoords = tempUVs[t[corner]];
+
+        const uint32_t index = static_cast<uint32_t>(mesh.vertices.size());
+        mesh.vertices.push_back(meshVertex);
+        uniqueVertices[key] = index;
+        faceIndices.push_back(index);
+      }
+
+      // remember which material this triangle uses to sort triangles by material below
+      faceMaterials.push_back(currentMaterial);
+    }
+  }
+
+  // Close the file
+  fin.close();
+
+  // triangles are grouped by material, so every material becomes one contiguous section
+  for (uint32_t material = 0; material < materialNames.size(); material++)
+  {
+    MeshSection section{};
+    section.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+    section.material = materialNames[material];
+
+    for (size_t face = 0; face < faceMaterials.size(); face++)
+    {
+      if (faceMaterials[face] != material) continue;
+      mesh.indices.push_back(faceIndices[face * 3 + 0]);
+      mesh.indices.push_back(faceIndices[face * 3 + 1]);
+      mesh.indices.push_back(faceIndices[face * 3 + 2]);
+    }
+
+    section.indexCount = static_cast<uint32_t>(mesh.indices.size()) - section.firstIndex;
+    if (section.indexCount > 0)
+    {
+      mesh.sections.push_back(section);
+    }
+  }
+
+  return !mesh.indices.empty();
+}
+
+namespace
+{
+  // tuning values from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+  constexpr int CACHE_SIZE = 32;
+  constexpr float CACHE_DECAY_POWER = 1.5f;
+  constexpr float LAST_TRI_SCORE = 0.75f;
+  constexpr float VALENCE_BOOST_SCALE = 2.0f;
+  constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+  float vertexScore(int cachePosition, uint32_t remainingTriangles)
+  {
+    // nothing left to draw with this vertex
+    if (remainingTriangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+      if (cachePosition < 3)
+      {
+        // used by the last triangle. Fixed score, so we don't prefer one of its vertices over another
+        score = LAST_TRI_SCORE;
+      }
+      else
+      {
+        const float scaler = 1.0f / (CACHE_SIZE - 3);
+        score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+      }
+    }
+
+    // vertices with few triangles left get a boost, so we finish them off and don't leave lonely triangles
+    score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+    return score;
+  }
+
+  // reorder the triangles of indices[first, first + count)
+  void optimizeSection(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t first, uint32_t count)
+  {
+    const uint32_t triangleCount = count / 3;
+    if (triangleCount < 2) return;
+
+    const uint32_t* source = indices.data() + first;
+
+    // vertex -> triangles that use it
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t i = 0; i < count; i++) remaining[source[i]]++;
+
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+    std::vector<uint32_t> adjacency(count);
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (uint32_t tri = 0; tri < triangleCount; tri++)
+    {
+      for (int corner = 0; corner < 3; corner++)
+      {
+        const uint32_t v = source[tri * 3 + corner];
+        adjacency[fill[v]++] = tri;
+      }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount, 0.0f);
+    for (size_t v = 0; v < vertexCount; v++) score[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount, 0.0f);
+    std::vector<bool> emitted(triangleCount, false);
+    for (uint32_t tri = 0; tri < triangleCount; tri++)
+    {
+      triangleScore[tri] = score[source[tri * 3]] + score[source[tri * 3 + 1]] + score[source[tri * 3 + 2]];
+    }
+
+    std::vector<uint32_t> result{};
+    result.reserve(count);
+
+    // simulated LRU cache. +3 because the new triangle pushes up to 3 vertices before we trim
+    std::vector<uint32_t> cache{};
+    cache.reserve(CACHE_SIZE + 3);
+
+    uint32_t linearCursor = 0;
+    int bestTriangle = -1;
+
+    for (uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+      if (bestTriangle < 0)
+      {
+        // nothing in the cache is useful. Take the best remaining triangle
+        // this happens rarely (start and disconnected pieces), so a linear scan is fine
+        float bestScore = -1.0f;
+        for (uint32_t tri = linearCursor; tri < triangleCount; tri++)
+        {
+          if (emitted[tri]) continue;
+          if (triangleScore[tri] > bestScore)
+          {
+            bestScore = triangleScore[tri];
+            bestTriangle = static_cast<int>(tri);
+          }
+        }
+        while (linearCursor < triangleCount && emitted[linearCursor]) linearCursor++;
+      }
+
+      const uint32_t tri = static_cast<uint32_t>(bestTriangle);
+      emitted[tri] = true;
+
+      // emit and move its vertices to the front of the cache
+      for (int corner = 0; corner < 3; corner++)
+      {
+        const uint32_t v = source[tri * 3 + corner];
+        result.push_back(v);
+
+        // the vertex has one less triangle to draw
+        for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v] + remaining[v]; a++)
+        {
+          if (adjacency[a] == tri)
+          {
+            std::swap(adjacency[a], adjacency[adjacencyOffset[v] + remaining[v] - 1]);
+            break;
+          }
+        }
+        remaining[v]--;
+
+        std::vector<uint32_t>::iterator it = std::find(cache.begin(), cache.end(), v);
+        if (it != cache.end()) cache.erase(it);
+        cache.insert(cache.begin(), v);
+      }
+
+      // update scores of everything in the cache and of vertices that just fell out of it
+      for (size_t i = 0; i < cache.size(); i++)
+      {
+        const uint32_t v = cache[i];
+        cachePosition[v] = i < CACHE_SIZE ? static_cast<int>(i) : -1;
+        score[v] = vertexScore(cachePosition[v], remaining[v]);
+      }
+
+      // and of their triangles. The best one is our next candidate
+      bestTriangle = -1;
+      float bestScore = -1.0f;
+      for (size_t i = 0; i < cache.size(); i++)
+      {
+        const uint32_t v = cache[i];
+        for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v] + remaining[v]; a++)
+        {
+          const uint32_t candidate = adjacency[a];
+          const float candidateScore = score[source[candidate * 3]] + score[source[candidate * 3 + 1]] + score[source[candidate * 3 + 2]];
+          triangleScore[candidate] = candidateScore;
+          if (candidateScore > bestScore)
+          {
+            bestScore = candidateScore;
+            bestTriangle = static_cast<int>(candidate);
+          }
+        }
+      }
+
+      if (cache.size() > CACHE_SIZE) cache.resize(CACHE_SIZE);
+    }
+
+    std::copy(result.begin(), result.end(), indices.begin() + first);
+  }
+}
+
+void optimizeMeshData(MeshData& mesh)
+{
+  // vertex cache: sections keep their ranges, only triangles inside a section move
+  for (const MeshSection& section : mesh.sections)
+  {
+    optimizeSection(mesh.indices, mesh.vertices.size(), section.firstIndex, section.indexCount);
+  }
+
+  // vertex fetch: store vertices in the order the index buffer touches them
+  std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+  std::vector<Vertex> vertices{};
+  vertices.reserve(mesh.vertices.size());
+
+  for (uint32_t& index : mesh.indices)
+  {
+    if (remap[index] == UINT32_MAX)
+    {
+      remap[index] = static_cast<uint32_t>(vertices.size());
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  // vertices no triangle uses are dropped
+  mesh.vertices.swap(vertices);
+}
+
+float computeACMR(const MeshData& mesh, uint32_t cacheSize)
+{
+  const size_t triangleCount = mesh.indices.size() / 3;
+  if (triangleCount == 0) return 0.0f;
+
+  // FIFO like the fixed function post-transform caches
+  std::vector<uint32_t> cache(cacheSize, UINT32_MAX);
+  size_t head = 0;
+  size_t misses = 0;
+
+  for (uint32_t index : mesh.indices)
+  {
+    if (std::find(cache.begin(), cache.end(), index) == cache.end())
+    {
+      misses++;
+      cache[head] = index;
+      head = (head + 1) % cacheSize;
+    }
+  }
+
+  return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+float computeUVDensity(const MeshData& mesh, uint32_t firstIndex, uint32_t indexCount)
+{
+  double surfaceArea{}, uvArea{};
+  for (uint32_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3)
+  {
+    const Vertex& a = mesh.vertices[mesh.indices[i]];
+    const Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+    const Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+
+    surfaceArea += 0.5 * glm::length(glm::cross(b.position - a.position, c.position - a.position));
+
+    const glm::vec2 uv0 = b.texCoords - a.texCoords;
+    const glm::vec2 uv1 = c.texCoords - a.texCoords;
+    uvArea += 0.5 * std::abs(uv0.x * uv1.y - uv0.y * uv1.x);
+  }
+
+  return surfaceArea > 0.0 ? static_cast<float>(std::sqrt(uvArea / surfaceArea)) : 0.0f;
+}
+
+void computeBoundingSphere(const MeshData& mesh, glm::vec3& center, float& radius)
+{
+  center = glm::vec3(0.0f);
+  radius = 0.0f;
+  if (mesh.vertices.empty()) return;
+
+  glm::vec3 minimum = mesh.vertices[0].position;
+  glm::vec3 maximum = mesh.vertices[0].position;
+  for (const Vertex& vertex : mesh.vertices)
+  {
+    minimum = glm::min(minimum, vertex.position);
+    maximum = glm::max(maximum, vertex.position);
+  }
+
+  center = (minimum + maximum) * 0.5f;
+  for (const Vertex& vertex : mesh.vertices)
+  {
+    radius = std::max(radius, glm::length(vertex.position - center));
+  }
+}
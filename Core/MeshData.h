@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef MESH_DATA_H
+#define MESH_DATA_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+// CPU side mesh data. No OpenGL in here, so the offline cooker can use it without a GL context
+
+// a custom data type that's gonna hold vertex data
+struct Vertex
+{
+  glm::vec3 position{};
+  glm::vec2 texCoords{};
+};
+
+// a range of indices drawn with one material (one "usemtl" block of the OBJ file)
+struct MeshSection
+{
+  uint32_t firstIndex{};
+  uint32_t indexCount{};
+  std::string material{}; // name from "usemtl". Empty if the faces had no material
+};
+
+struct MeshData
+{
+  std::vector<Vertex> vertices{};
+  std::vector<uint32_t> indices{};        // triangle list
+  std::vector<MeshSection> sections{};    // indices are sorted so every material is contiguous
+  std::vector<std::string> materialLibraries{}; // "mtllib" file names, relative to the OBJ file
+};
+
+// read an OBJ file into an indexed triangle list
+// position/uv pairs that appear several times are shared by one vertex
+bool parseOBJ(const std::string& filename, MeshData& mesh);
+
+// reorder triangles of each section for the post-transform vertex cache (Tom Forsyth's linear-speed algorithm)
+// and then vertices in the order they are first used, so the vertex fetch walks memory linearly
+void optimizeMeshData(MeshData& mesh);
+
+// average cache miss ratio: transformed vertices per triangle with a FIFO cache of cacheSize entries
+// 3.0 is the worst (no reuse), ~0.5-0.7 is very good for regular meshes
+float computeACMR(const MeshData& mesh, uint32_t cacheSize = 16);
+
+// UV units per object space unit over a range of triangles: sqrt(uv area / surface area)
+// texture streaming uses it to know how large one texture repeat is on screen
+float computeUVDensity(const MeshData& mesh, uint32_t firstIndex, uint32_t indexCount);
+
+// sphere around all vertices (center of the bounding box). radius is 0 for an empty mesh
+void computeBoundingSphere(const MeshData& mesh, glm::vec3& center, float& radius);
+
+#endif // !MESH_DATA_H
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <stddef.h>
+#include "MeshPool.h"
+#include "RenderState.h"
+
+MeshPool::MeshPool()
+{}
+
+MeshPool::~MeshPool()
+{
+  RenderState::get().deleteVertexArray(mVAO);
+  RenderState::get().deleteBuffer(mVBO);
+  RenderState::get().deleteBuffer(mIBO);
+}
+
+MeshPool::Allocation MeshPool::add(const MeshData& data)
+{
+  const uint32_t vertexCount = static_cast<uint32_t>(data.vertices.size());
+  const uint32_t indexCount = static_cast<uint32_t>(data.indices.size());
+  reserve(mVertexCount + vertexCount, mIndexCount + indexCount);
+
+  // GL_COPY_WRITE_BUFFER doesn't touch the VAO state, GL_ELEMENT_ARRAY_BUFFER would
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mVBO);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, mVertexCount * sizeof(Vertex), vertexCount * sizeof(Vertex), data.vertices.data());
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mIBO);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, mIndexCount * sizeof(uint32_t), indexCount * sizeof(uint32_t), data.indices.data());
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  const Allocation allocation{ static_cast<GLint>(mVertexCount), mIndexCount };
+  mVertexCount += vertexCount;
+  mIndexCount += indexCount;
+  return allocation;
+}
+
+void MeshPool::reserve(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+  if (vertexCapacity <= mVertexCapacity && indexCapacity <= mIndexCapacity && mVAO != 0) return;
+
+  // double, so appending n meshes copies O(total) bytes
+  const uint32_t newVertexCapacity = std::max(vertexCapacity, std::max(mVertexCapacity * 2, 4096u));
+  const uint32_t newIndexCapacity = std::max(indexCapacity, std::max(mIndexCapacity * 2, 16384u));
+
+  if (vertexCapacity > mVertexCapacity || mVBO == 0)
+  {
+    mVBO = growBuffer(mVBO, mVertexCount * sizeof(Vertex), newVertexCapacity * sizeof(Vertex));
+    mVertexCapacity = newVertexCapacity;
+  }
+  if (indexCapacity > mIndexCapacity || mIBO == 0)
+  {
+    mIBO = growBuffer(mIBO, mIndexCount * sizeof(uint32_t), newIndexCapacity * sizeof(uint32_t));
+    mIndexCapacity = newIndexCapacity;
+  }
+
+  // point the VAO at the (new) buffers. Same layout as Mesh::initBuffers(): position at 0, UV at 1
+  if (mVAO == 0) glGenVertexArrays(1, &mVAO);
+  RenderState::get().bindVertexArray(mVAO);
+  RenderState::get().bindBuffer(GL_ARRAY_BUFFER, mVBO);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, position));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoords));
+  glEnableVertexAttribArray(1);
+  RenderState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+  RenderState::get().bindVertexArray(0);
+}
+
+GLuint MeshPool::growBuffer(GLuint buffer, GLsizeiptr usedSize, GLsizeiptr newSize)
+{
+  GLuint grown{};
+  glGenBuffers(1, &grown);
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, grown);
+  glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+
+  if (buffer != 0 && usedSize > 0)
+  {
+    // GPU to GPU copy. Nothing comes back to the CPU
+    RenderState::get().bindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedSize);
+    RenderState::get().bindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  RenderState::get().deleteBuffer(buffer);
+  return grown;
+}
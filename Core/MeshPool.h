@@ -0,0 +1,53 @@
+#pragma once
+
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include <stdint.h>
+#include "GL/glew.h"
+#include "MeshData.h"
+
+// One vertex buffer, one index buffer and one VAO shared by many meshes
+// Meshes in the same pool can be drawn without switching the VAO, and many of them with one
+// glMultiDrawElementsBaseVertex call. Indices stay relative to their own mesh. Draws pass the mesh's
+// base vertex, so a mesh's index data doesn't have to be rewritten when it's appended
+//
+// The buffers grow (doubling, copied on the GPU) when a mesh doesn't fit. The VAO stays the same
+class MeshPool
+{
+public:
+
+  // where a mesh went in the shared buffers
+  struct Allocation
+  {
+    GLint baseVertex{};
+    uint32_t firstIndex{};
+  };
+
+  MeshPool();
+  ~MeshPool();
+
+  MeshPool(const MeshPool&) = delete;
+  MeshPool& operator=(const MeshPool&) = delete;
+
+  // append the vertices and indices of data
+  Allocation add(const MeshData& data);
+
+  GLuint getVertexArray() const { return mVAO; };
+  uint32_t getVertexCount() const { return mVertexCount; };
+  uint32_t getIndexCount() const { return mIndexCount; };
+
+private:
+
+  // make room for at least this many vertices and indices
+  void reserve(uint32_t vertexCapacity, uint32_t indexCapacity);
+
+  // new buffer of newSize bytes with the first usedSize bytes of buffer copied over. Deletes buffer
+  static GLuint growBuffer(GLuint buffer, GLsizeiptr usedSize, GLsizeiptr newSize);
+
+  GLuint mVBO{}, mIBO{}, mVAO{};
+  uint32_t mVertexCount{}, mVertexCapacity{};
+  uint32_t mIndexCount{}, mIndexCapacity{};
+};
+
+#endif // !MESH_POOL_H
@@ -0,0 +1,376 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "Profiler.h"
+
+namespace
+{
+  // the ring of the calling thread, taken on its first scope. Threads give it back when they exit,
+  // so threads that come and go don't pile up rings
+  struct RingOwner
+  {
+    void* ring{};
+    std::atomic<bool>* inUse{};
+
+    ~RingOwner()
+    {
+      if (inUse != nullptr) inUse->store(false, std::memory_order_release);
+    }
+  };
+  thread_local RingOwner tRing{};
+
+  // names come from code, but quotes would still break the file
+  void writeJsonString(std::ostream& out, const std::string& text)
+  {
+    out << '"';
+    for (char c : text)
+    {
+      if (c == '"' || c == '\\') out << '\\' << c;
+      else if (static_cast<unsigned char>(c) < 0x20) out << ' ';
+      else out << c;
+    }
+    out << '"';
+  }
+}
+
+Profiler& Profiler::get()
+{
+  static Profiler profiler{};
+  return profiler;
+}
+
+Profiler::Profiler()
+{
+  // spans from one newFrame() to the next
+  mGpuFrameScope = registerScope("frame", true);
+}
+
+ProfileScopeId Profiler::registerScope(const char* name, bool gpu)
+{
+  std::lock_guard<std::mutex> lock(mScopeMutex);
+
+  const size_t count = mScopeCount.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (mScopes[i].stats.gpu == gpu && mScopes[i].stats.name == name) return static_cast<ProfileScopeId>(i);
+  }
+
+  if (count == MAX_SCOPES)
+  {
+    std::cerr << "Too many profile scopes, " << name << " isn't timed" << std::endl;
+    return INVALID_PROFILE_SCOPE;
+  }
+
+  mScopes[count].stats.name = name;
+  mScopes[count].stats.gpu = gpu;
+  mScopeCount.store(count + 1, std::memory_order_release);
+  return static_cast<ProfileScopeId>(count);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+  ThreadRing* ring = getThreadRing();
+  std::lock_guard<std::mutex> lock(mRingMutex);
+  ring->name = name;
+}
+
+uint64_t Profiler::now()
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+Profiler::ThreadRing* Profiler::getThreadRing()
+{
+  if (tRing.ring == nullptr)
+  {
+    std::lock_guard<std::mutex> lock(mRingMutex);
+
+    // a ring of a thread that has exited keeps its id and its events that weren't collected yet
+    ThreadRing* ring{};
+    for (const std::unique_ptr<ThreadRing>& free : mRings)
+    {
+      bool inUse = false;
+      if (free->inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+      {
+        ring = free.get();
+        break;
+      }
+    }
+
+    if (ring == nullptr)
+    {
+      mRings.push_back(std::make_unique<ThreadRing>());
+      ring = mRings.back().get();
+      ring->id = static_cast<uint32_t>(mRings.size()); // 0 is the GPU
+      ring->inUse = true;
+    }
+    ring->name = "thread " + std::to_string(ring->id);
+    tRing.ring = ring;
+    tRing.inUse = &ring->inUse;
+  }
+  return static_cast<ThreadRing*>(tRing.ring);
+}
+
+void Profiler::recordCpu(ProfileScopeId scope, uint64_t begin, uint64_t end)
+{
+  if (scope == INVALID_PROFILE_SCOPE) return;
+
+  // full means newFrame() hasn't run for a long time. Drop rather than wait for it
+  ThreadRing* ring = getThreadRing();
+  const uint64_t written = ring->written.load(std::memory_order_relaxed);
+  if (written - ring->read.load(std::memory_order_acquire) >= THREAD_EVENTS)
+  {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  ring->events[written & (THREAD_EVENTS - 1)] = { begin, end, scope };
+  ring->written.store(written + 1, std::memory_order_release);
+}
+
+void Profiler::beginGpu(ProfileScopeId scope)
+{
+  // scopes we don't time still go on the stack, so endGpu() stays balanced
+  GpuFrame& frame = mGpuFrames[mFrame % GPU_LATENCY];
+  if (!mGpuSupported || scope == INVALID_PROFILE_SCOPE || !frame.pending)
+  {
+    mGpuStack.push_back(UINT32_MAX);
+    return;
+  }
+
+  GpuEvent event{};
+  event.scope = scope;
+  glQueryCounter(getQuery(frame), GL_TIMESTAMP);
+  event.beginQuery = frame.usedQueries - 1;
+
+  mGpuStack.push_back(static_cast<uint32_t>(frame.events.size()));
+  frame.events.push_back(event);
+}
+
+void Profiler::endGpu()
+{
+  if (mGpuStack.empty()) return;
+
+  const uint32_t index = mGpuStack.back();
+  mGpuStack.pop_back();
+  if (index == UINT32_MAX) return;
+
+  GpuFrame& frame = mGpuFrames[mFrame % GPU_LATENCY];
+  glQueryCounter(getQuery(frame), GL_TIMESTAMP);
+  frame.events[index].endQuery = frame.usedQueries - 1;
+}
+
+GLuint Profiler::getQuery(GpuFrame& frame)
+{
+  if (frame.usedQueries == frame.queries.size())
+  {
+    GLuint query{};
+    glGenQueries(1, &query);
+    frame.queries.push_back(query);
+  }
+  return frame.queries[frame.usedQueries++];
+}
+
+void Profiler::newFrame()
+{
+  // the first call is the first one with a context
+  if (!mGpuInitialized)
+  {
+    mGpuInitialized = true;
+    mGpuSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+  }
+
+  collectCpu();
+
+  // close the frame scope and whatever was left open
+  while (!mGpuStack.empty()) endGpu();
+
+  mFrame++;
+
+  if (mGpuSupported)
+  {
+    // oldest first. The slot of this frame holds the oldest one, mFrame - GPU_LATENCY
+    for (uint32_t i = 0; i < GPU_LATENCY; i++)
+    {
+      if (!resolveGpu(mGpuFrames[(mFrame + i) % GPU_LATENCY])) break;
+    }
+
+    // still not done after GPU_LATENCY frames. Waiting for it would stall, so its results are lost
+    GpuFrame& frame = mGpuFrames[mFrame % GPU_LATENCY];
+    if (frame.pending) mDroppedGpuFrames++;
+
+    frame.frame = mFrame;
+    frame.pending = true;
+    frame.usedQueries = 0;
+    frame.events.clear();
+    glGetInteger64v(GL_TIMESTAMP, &frame.gpuStart);
+    frame.cpuStart = now();
+
+    beginGpu(mGpuFrameScope);
+  }
+
+  // the last captured frame has been collected and its GPU results had their chance
+  if (isCapturing() && mFrame >= mCaptureEnd + GPU_LATENCY)
+  {
+    writeCapture();
+    mCaptureFilename.clear();
+    mCaptureEvents.clear();
+    mCaptureEvents.shrink_to_fit();
+  }
+}
+
+void Profiler::collectCpu()
+{
+  // the scopes that finished since the last call. They count for the frame that ends now
+  const bool capture = isCapturing() && mFrame >= mCaptureFirst && mFrame < mCaptureEnd;
+  {
+    std::lock_guard<std::mutex> lock(mRingMutex);
+    for (const std::unique_ptr<ThreadRing>& ring : mRings)
+    {
+      const uint64_t read = ring->read.load(std::memory_order_relaxed);
+      const uint64_t written = ring->written.load(std::memory_order_acquire);
+      for (uint64_t i = read; i < written; i++)
+      {
+        const CpuEvent& event = ring->events[i & (THREAD_EVENTS - 1)];
+        mScopes[event.scope].frameNs += event.end - event.begin;
+        if (capture) mCaptureEvents.push_back({ event.begin, event.end, event.scope, ring->id });
+      }
+      ring->read.store(written, std::memory_order_release);
+      mDroppedEvents += ring->dropped.exchange(0, std::memory_order_relaxed);
+    }
+  }
+
+  const size_t count = getScopeCount();
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!mScopes[i].stats.gpu && mScopes[i].frameNs > 0) addSample(mScopes[i], mScopes[i].frameNs);
+  }
+}
+
+bool Profiler::resolveGpu(GpuFrame& frame)
+{
+  if (!frame.pending) return true;
+
+  // timestamps finish in order, so the last one being there means all are
+  if (frame.usedQueries > 0)
+  {
+    GLint available{};
+    glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_FALSE) return false;
+  }
+
+  std::vector<GLuint64> times(frame.usedQueries);
+  for (uint32_t i = 0; i < frame.usedQueries; i++) glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+
+  const bool capture = isCapturing() && frame.frame >= mCaptureFirst && frame.frame < mCaptureEnd;
+  for (const GpuEvent& event : frame.events)
+  {
+    const GLuint64 begin = times[event.beginQuery];
+    const GLuint64 end = std::max(times[event.endQuery], begin);
+    mScopes[event.scope].frameNs += end - begin;
+
+    if (capture)
+    {
+      const int64_t offset = static_cast<int64_t>(begin) - frame.gpuStart;
+      const uint64_t cpuBegin = static_cast<uint64_t>(static_cast<int64_t>(frame.cpuStart) + offset);
+      mCaptureEvents.push_back({ cpuBegin, cpuBegin + (end - begin), event.scope, 0 });
+    }
+  }
+
+  for (const GpuEvent& event : frame.events)
+  {
+    Scope& scope = mScopes[event.scope];
+    if (scope.frameNs > 0) addSample(scope, scope.frameNs);
+  }
+
+  frame.pending = false;
+  return true;
+}
+
+void Profiler::addSample(Scope& scope, uint64_t ns)
+{
+  scope.frameNs = 0;
+  scope.history[scope.next] = static_cast<float>(ns / 1e6);
+  scope.next = (scope.next + 1) % HISTORY_FRAMES;
+  scope.stats.samples = std::min(scope.stats.samples + 1, HISTORY_FRAMES);
+
+  ScopeStats& stats = scope.stats;
+  stats.minMs = stats.maxMs = scope.history[0];
+  float sum{};
+  for (uint32_t i = 0; i < stats.samples; i++)
+  {
+    stats.minMs = std::min(stats.minMs, scope.history[i]);
+    stats.maxMs = std::max(stats.maxMs, scope.history[i]);
+    sum += scope.history[i];
+  }
+  stats.avgMs = sum / stats.samples;
+}
+
+void Profiler::startCapture(uint32_t frameCount, const std::string& filename)
+{
+  if (isCapturing() || frameCount == 0 || filename.empty()) return;
+
+  // from the next frame on
+  mCaptureFilename = filename;
+  mCaptureFirst = mFrame + 1;
+  mCaptureEnd = mCaptureFirst + frameCount;
+  mCaptureEvents.clear();
+}
+
+bool Profiler::writeCapture()
+{
+  std::ofstream file(mCaptureFilename);
+  if (!file)
+  {
+    std::cerr << "Failed to write the trace " << mCaptureFilename << std::endl;
+    return false;
+  }
+
+  // trace_event format, "X" (complete) events in microseconds from the first event
+  uint64_t origin = UINT64_MAX;
+  for (const TraceEvent& event : mCaptureEvents) origin = std::min(origin, event.begin);
+
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+  {
+    std::lock_guard<std::mutex> lock(mRingMutex);
+    for (const std::unique_ptr<ThreadRing>& ring : mRings)
+    {
+      file << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->id << ",\"args\":{\"name\":";
+      writeJsonString(file, ring->name);
+      file << "}}";
+    }
+  }
+
+  file << std::fixed << std::setprecision(3);
+  for (const TraceEvent& event : mCaptureEvents)
+  {
+    file << "," << std::endl << "{\"name\":";
+    writeJsonString(file, mScopes[event.scope].stats.name);
+    file << ",\"cat\":\"" << (event.thread == 0 ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+      << ",\"ts\":" << (event.begin - origin) / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+  }
+  file << std::endl << "]}" << std::endl;
+
+  if (!file)
+  {
+    std::cerr << "Failed to write the trace " << mCaptureFilename << std::endl;
+    return false;
+  }
+
+  std::cout << "Wrote " << mCaptureEvents.size() << " profile events of " << (mCaptureEnd - mCaptureFirst) << " frames to " << mCaptureFilename << std::endl;
+  return true;
+}
+
+void Profiler::release()
+{
+  for (GpuFrame& frame : mGpuFrames)
+  {
+    if (!frame.queries.empty()) glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+    frame = GpuFrame{};
+  }
+  mGpuStack.clear();
+  mGpuSupported = false;
+}
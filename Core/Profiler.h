@@ -0,0 +1,219 @@
+#pragma once
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+
+// CPU and GPU frame profiler
+//
+// CPU scopes are timed with PROFILE_SCOPE("name") on any thread. A finished scope goes into a ring of its thread:
+// one writer, one reader (newFrame() on the GL thread), so recording never takes a lock. Nested scopes nest in
+// time, which is all the trace viewer needs to draw the hierarchy
+//
+// GPU scopes (PROFILE_GPU_SCOPE, GL thread only) put a GL_TIMESTAMP query before and after their commands.
+// GL_TIME_ELAPSED queries can't be nested, timestamps can. Queries of a frame are read GPU_LATENCY frames later
+// and only if the GPU is done with them, so reading never waits. A frame whose results aren't there in time is dropped
+//
+// Every scope keeps min/avg/max of its time per frame (all its occurrences summed) over the last HISTORY_FRAMES
+// frames it ran in. startCapture() records everything for some frames and writes a Chrome trace_event JSON file
+// (chrome://tracing, ui.perfetto.dev)
+
+using ProfileScopeId = uint16_t;
+constexpr ProfileScopeId INVALID_PROFILE_SCOPE = UINT16_MAX;
+
+class Profiler
+{
+public:
+
+  static constexpr uint32_t MAX_SCOPES = 256;
+  static constexpr uint32_t THREAD_EVENTS = 8192;  // ring size per thread. Power of two
+  static constexpr uint32_t HISTORY_FRAMES = 120;
+  static constexpr uint32_t GPU_LATENCY = 4;       // frames of queries in flight
+
+  struct ScopeStats
+  {
+    std::string name{};
+    bool gpu{};
+    uint32_t samples{}; // frames in the history
+    float minMs{};
+    float avgMs{};
+    float maxMs{};
+  };
+
+  static Profiler& get();
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  // an id per name and kind. The macros do this once per call site
+  ProfileScopeId registerScope(const char* name, bool gpu);
+
+  // name of the calling thread in traces. Others are "thread N"
+  void setThreadName(const char* name);
+
+  // once per frame on the GL thread, before its scopes. Collects the scopes that finished since the last call,
+  // reads GPU results that are ready and starts the GPU "frame" scope, which ends at the next call
+  void newFrame();
+
+  // nanoseconds on the profiler clock
+  static uint64_t now();
+
+  // any thread, lock free
+  void recordCpu(ProfileScopeId scope, uint64_t begin, uint64_t end);
+
+  // GL thread only
+  void beginGpu(ProfileScopeId scope);
+  void endGpu();
+
+  size_t getScopeCount() const { return mScopeCount.load(std::memory_order_acquire); };
+  const ScopeStats& getScopeStats(ProfileScopeId scope) const { return mScopes[scope].stats; };
+
+  // events that didn't fit a thread ring and GPU frames whose results came too late. Never shrink
+  uint64_t getDroppedEvents() const { return mDroppedEvents; };
+  uint64_t getDroppedGpuFrames() const { return mDroppedGpuFrames; };
+
+  // record the next frameCount frames and write them to filename once their GPU results are in
+  void startCapture(uint32_t frameCount, const std::string& filename);
+  bool isCapturing() const { return !mCaptureFilename.empty(); };
+
+  // delete the GL queries. Call before the context goes away
+  void release();
+
+private:
+
+  Profiler();
+
+  struct CpuEvent
+  {
+    uint64_t begin{};
+    uint64_t end{};
+    ProfileScopeId scope{};
+  };
+
+  struct ThreadRing
+  {
+    std::atomic<uint64_t> written{};
+    std::atomic<uint64_t> read{};
+    std::atomic<uint64_t> dropped{};
+    std::atomic<bool> inUse{}; // by a running thread
+    CpuEvent events[THREAD_EVENTS]{};
+    uint32_t id{};
+    std::string name{};
+  };
+
+  struct GpuEvent
+  {
+    ProfileScopeId scope{};
+    uint32_t beginQuery{}; // in the frame's queries
+    uint32_t endQuery{};
+  };
+
+  struct GpuFrame
+  {
+    uint64_t frame{};
+    bool pending{};
+    std::vector<GLuint> queries{}; // grows to the most a frame needed, then reused
+    uint32_t usedQueries{};
+    std::vector<GpuEvent> events{};
+
+    // the two clocks at the start of the frame. GPU times are moved onto the CPU clock with them
+    uint64_t cpuStart{};
+    GLint64 gpuStart{};
+  };
+
+  // a trace event. GPU events are already on the CPU clock. thread 0 is the GPU
+  struct TraceEvent
+  {
+    uint64_t begin{};
+    uint64_t end{};
+    ProfileScopeId scope{};
+    uint32_t thread{};
+  };
+
+  struct Scope
+  {
+    ScopeStats stats{};
+    float history[HISTORY_FRAMES]{};
+    uint32_t next{};
+    uint64_t frameNs{}; // summed over the frame being collected
+  };
+
+  ThreadRing* getThreadRing();
+
+  // drain the rings into the scope sums and the capture
+  void collectCpu();
+  // read the results of a frame if the GPU is done with it. Returns false if it isn't
+  bool resolveGpu(GpuFrame& frame);
+  void addSample(Scope& scope, uint64_t ns);
+  GLuint getQuery(GpuFrame& frame);
+
+  bool writeCapture();
+
+  Scope mScopes[MAX_SCOPES]{};
+  std::atomic<size_t> mScopeCount{};
+  std::mutex mScopeMutex{};
+
+  std::vector<std::unique_ptr<ThreadRing>> mRings{};
+  std::mutex mRingMutex{};
+  uint64_t mDroppedEvents{};
+
+  uint64_t mFrame{};
+  bool mGpuInitialized{};
+  bool mGpuSupported{};
+  GpuFrame mGpuFrames[GPU_LATENCY]{};
+  std::vector<uint32_t> mGpuStack{}; // open GPU events of the current frame
+  ProfileScopeId mGpuFrameScope{};
+  uint64_t mDroppedGpuFrames{};
+
+  // capture of frames [mCaptureFirst, mCaptureEnd)
+  std::string mCaptureFilename{};
+  uint64_t mCaptureFirst{};
+  uint64_t mCaptureEnd{};
+  std::vector<TraceEvent> mCaptureEvents{};
+};
+
+// times the rest of the enclosing block
+class ProfileScope
+{
+public:
+  explicit ProfileScope(ProfileScopeId scope) : mScope(scope), mBegin(Profiler::now()) {};
+  ~ProfileScope() { Profiler::get().recordCpu(mScope, mBegin, Profiler::now()); };
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  ProfileScopeId mScope{};
+  uint64_t mBegin{};
+};
+
+// GPU time of the commands issued in the rest of the enclosing block
+class GpuProfileScope
+{
+public:
+  explicit GpuProfileScope(ProfileScopeId scope) { Profiler::get().beginGpu(scope); };
+  ~GpuProfileScope() { Profiler::get().endGpu(); };
+
+  GpuProfileScope(const GpuProfileScope&) = delete;
+  GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#define PROFILE_SCOPE(name) \
+  static const ProfileScopeId PROFILE_CONCAT(profileScopeId, __LINE__) = Profiler::get().registerScope(name, false); \
+  const ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileScopeId, __LINE__))
+
+#define PROFILE_GPU_SCOPE(name) \
+  static const ProfileScopeId PROFILE_CONCAT(profileGpuScopeId, __LINE__) = Profiler::get().registerScope(name, true); \
+  const GpuProfileScope PROFILE_CONCAT(profileGpuScope, __LINE__)(PROFILE_CONCAT(profileGpuScopeId, __LINE__))
+
+#endif // !PROFILER_H
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include "RenderQueue.h"
+
+namespace
+{
+  constexpr uint32_t RADIX_BITS = 8;
+  constexpr uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+  constexpr uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+
+  uint64_t clampField(uint32_t value, uint32_t bits)
+  {
+    return std::min<uint64_t>(value, (1ull << bits) - 1);
+  }
+}
+
+uint32_t RenderQueue::makeMesh(uint32_t mesh, uint32_t subMesh)
+{
+  return static_cast<uint32_t>((clampField(mesh, MESH_BITS - SUB_MESH_BITS) << SUB_MESH_BITS) | clampField(subMesh, SUB_MESH_BITS));
+}
+
+uint64_t RenderQueue::makeKey(uint32_t layer, uint32_t program, uint32_t texture, uint32_t material, uint32_t mesh, uint32_t depth)
+{
+  return (clampField(layer, LAYER_BITS) << LAYER_SHIFT)
+    | (clampField(program, PROGRAM_BITS) << PROGRAM_SHIFT)
+    | (clampField(texture, TEXTURE_BITS) << TEXTURE_SHIFT)
+    | (clampField(material, MATERIAL_BITS) << MATERIAL_SHIFT)
+    | (clampField(mesh, MESH_BITS) << MESH_SHIFT)
+    | (clampField(depth, DEPTH_BITS) << DEPTH_SHIFT);
+}
+
+uint32_t RenderQueue::quantizeDepth(float distance, float nearPlane, float farPlane)
+{
+  if (!(farPlane > nearPlane)) return 0;
+
+  const float t = std::clamp((distance - nearPlane) / (farPlane - nearPlane), 0.0f, 1.0f);
+  return static_cast<uint32_t>(t * static_cast<float>((1u << DEPTH_BITS) - 1) + 0.5f);
+}
+
+void RenderQueue::reserve(size_t count)
+{
+  mPackets.reserve(count);
+  mScratch.reserve(count);
+}
+
+void RenderQueue::sort()
+{
+  const size_t count = mPackets.size();
+  mScratch.resize(count);
+
+  // histograms of all passes in one read of the keys
+  uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS]{};
+  for (const Packet& packet : mPackets)
+  {
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+    {
+      histograms[pass][(packet.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+  }
+
+  Packet* source = mPackets.data();
+  Packet* target = mScratch.data();
+  for (uint32_t pass = 0; pass < RADIX_PASSES && count > 1; pass++)
+  {
+    // all keys have the same byte here. The pass wouldn't move anything
+    const uint32_t shift = pass * RADIX_BITS;
+    uint32_t* histogram = histograms[pass];
+    if (histogram[(source[0].key >> shift) & (RADIX_BUCKETS - 1)] == count) continue;
+
+    // bucket counts to the offsets where each bucket starts
+    uint32_t offset = 0;
+    for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++)
+    {
+      const uint32_t bucketCount = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucketCount;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      target[histogram[(source[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = source[i];
+    }
+    std::swap(source, target);
+  }
+
+  // an odd number of passes ran, the result is in the scratch buffer
+  if (source != mPackets.data()) mPackets.swap(mScratch);
+
+  countChanges();
+}
+
+void RenderQueue::countChanges()
+{
+  const size_t count = mPackets.size();
+  mStats = {};
+  mStats.packets = static_cast<uint32_t>(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    const uint64_t key = mPackets[i].key;
+    const bool first = i == 0;
+    const uint64_t previous = first ? 0 : mPackets[i - 1].key;
+    if (first || getProgram(key) != getProgram(previous)) mStats.programChanges++;
+    if (first || getTexture(key) != getTexture(previous)) mStats.textureChanges++;
+    if (first || getMesh(key) != getMesh(previous)) mStats.meshChanges++;
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+
+// Draw packets of one frame, ordered by a 64-bit sort key
+// The key packs everything the order should follow, most significant first:
+//
+//   layer 4 | program 8 | texture 14 | material 10 | mesh 12 (mesh 8, sub-mesh 4) | depth 16
+//
+// so sorting the keys as plain integers groups draws by layer, then by program, then by texture and so on,
+// and neighbours share as much state as possible. Depth is last: inside a group opaque draws go front to back
+// so early depth test rejects more. Fields that don't fit are clamped to their maximum
+//
+// Keys are sorted with an LSD radix sort, 8 bits per pass. Passes where all keys have the same byte are skipped,
+// so a frame with few programs and textures only pays for the bytes that differ
+class RenderQueue
+{
+public:
+
+  static constexpr uint32_t LAYER_BITS = 4;
+  static constexpr uint32_t PROGRAM_BITS = 8;
+  static constexpr uint32_t TEXTURE_BITS = 14;
+  static constexpr uint32_t MATERIAL_BITS = 10;
+  static constexpr uint32_t MESH_BITS = 12;
+  static constexpr uint32_t SUB_MESH_BITS = 4;  // low bits of the mesh field, see makeMesh()
+  static constexpr uint32_t DEPTH_BITS = 16;
+
+  static constexpr uint32_t DEPTH_SHIFT = 0;
+  static constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+  static constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+  static constexpr uint32_t TEXTURE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+  static constexpr uint32_t PROGRAM_SHIFT = TEXTURE_SHIFT + TEXTURE_BITS;
+  static constexpr uint32_t LAYER_SHIFT = PROGRAM_SHIFT + PROGRAM_BITS;
+  static_assert(LAYER_SHIFT + LAYER_BITS == 64, "sort key fields must fill 64 bits");
+
+  // state changes between neighbouring packets after sort(). What submitting in this order costs at most
+  struct Stats
+  {
+    uint32_t packets{};
+    uint32_t programChanges{};
+    uint32_t textureChanges{};
+    uint32_t meshChanges{}; // mesh or sub-mesh. A VAO bind per change of mesh unless the meshes share a MeshPool
+  };
+
+  // the mesh field of a key. The sub-mesh goes into it too, so packets that draw the same sub-mesh with the same
+  // material end up next to each other and can be instanced. Both parts are clamped
+  static uint32_t makeMesh(uint32_t mesh, uint32_t subMesh);
+
+  static uint64_t makeKey(uint32_t layer, uint32_t program, uint32_t texture, uint32_t material, uint32_t mesh, uint32_t depth);
+
+  // view space distance to DEPTH_BITS, 0 at the near plane. Linear, the order only has to be roughly right
+  static uint32_t quantizeDepth(float distance, float nearPlane, float farPlane);
+
+  static uint32_t getProgram(uint64_t key) { return getField(key, PROGRAM_SHIFT, PROGRAM_BITS); };
+  static uint32_t getTexture(uint64_t key) { return getField(key, TEXTURE_SHIFT, TEXTURE_BITS); };
+  static uint32_t getMesh(uint64_t key) { return getField(key, MESH_SHIFT, MESH_BITS); };
+
+  void clear() { mPackets.clear(); };
+  void reserve(size_t count);
+
+  // payload is whatever the caller needs to find the draw again (an index into its draw list)
+  void push(uint64_t key, uint32_t payload) { mPackets.push_back({ key, payload }); };
+
+  // order the packets by key. Packets with equal keys keep the order they were pushed in
+  void sort();
+
+  size_t size() const { return mPackets.size(); };
+  uint64_t getKey(size_t index) const { return mPackets[index].key; };
+  uint32_t getPayload(size_t index) const { return mPackets[index].payload; };
+
+  // counted by the last sort()
+  const Stats& getStats() const { return mStats; };
+
+private:
+
+  struct Packet
+  {
+    uint64_t key{};
+    uint32_t payload{};
+  };
+
+  // fills mStats from the sorted packets
+  void countChanges();
+
+  static uint32_t getField(uint64_t key, uint32_t shift, uint32_t bits) { return static_cast<uint32_t>(key >> shift) & ((1u << bits) - 1); };
+
+  std::vector<Packet> mPackets{};
+  std::vector<Packet> mScratch{}; // the other buffer of the radix passes. Kept so frames don't allocate
+  Stats mStats{};
+};
+
+#endif // !RENDER_QUEUE_H
@@ -0,0 +1,243 @@
+#include "RenderState.h"
+
+uint32_t RenderState::Stats::getIssued() const
+{
+  uint32_t total{};
+  for (uint32_t count : issued) total += count;
+  return total;
+}
+
+uint32_t RenderState::Stats::getElided() const
+{
+  uint32_t total{};
+  for (uint32_t count : elided) total += count;
+  return total;
+}
+
+RenderState& RenderState::get()
+{
+  static RenderState state{};
+  return state;
+}
+
+RenderState::RenderState()
+{
+  invalidate();
+}
+
+int RenderState::getTextureTargetIndex(GLenum target)
+{
+  switch (target)
+  {
+  case GL_TEXTURE_2D: return 0;
+  case GL_TEXTURE_2D_ARRAY: return 1;
+  case GL_TEXTURE_BUFFER: return 2;
+  default: return -1;
+  }
+}
+
+int RenderState::getBufferTargetIndex(GLenum target)
+{
+  switch (target)
+  {
+  case GL_ARRAY_BUFFER: return 0;
+  case GL_ELEMENT_ARRAY_BUFFER: return 1;
+  case GL_COPY_WRITE_BUFFER: return 2;
+  case GL_UNIFORM_BUFFER: return 3;
+  case GL_TEXTURE_BUFFER: return 4;
+  case GL_DRAW_INDIRECT_BUFFER: return 5;
+  default: return -1;
+  }
+}
+
+bool RenderState::change(GLuint& cached, GLuint value, Call call)
+{
+  if (cached == value)
+  {
+    mStats.elided[static_cast<size_t>(call)]++;
+    return false;
+  }
+
+  cached = value;
+  mStats.issued[static_cast<size_t>(call)]++;
+  return true;
+}
+
+void RenderState::useProgram(GLuint program)
+{
+  if (change(mProgram, program, Call::PROGRAM)) glUseProgram(program);
+}
+
+void RenderState::bindVertexArray(GLuint vertexArray)
+{
+  if (!change(mVertexArray, vertexArray, Call::VERTEX_ARRAY)) return;
+
+  glBindVertexArray(vertexArray);
+
+  // the element buffer binding is part of the VAO we just switched to
+  mBuffers[getBufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+}
+
+void RenderState::bindBuffer(GLenum target, GLuint buffer)
+{
+  const int index = getBufferTargetIndex(target);
+  if (index < 0)
+  {
+    mStats.issued[static_cast<size_t>(Call::BUFFER)]++;
+    glBindBuffer(target, buffer);
+    return;
+  }
+
+  if (change(mBuffers[index], buffer, Call::BUFFER)) glBindBuffer(target, buffer);
+}
+
+void RenderState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+  if (target == GL_UNIFORM_BUFFER && index < MAX_UNIFORM_BINDINGS)
+  {
+    BufferRange& range = mUniformRanges[index];
+    if (range.buffer == buffer && range.offset == offset && range.size == size)
+    {
+      mStats.elided[static_cast<size_t>(Call::BUFFER)]++;
+      return;
+    }
+    range = { buffer, offset, size };
+  }
+
+  mStats.issued[static_cast<size_t>(Call::BUFFER)]++;
+  glBindBufferRange(target, index, buffer, offset, size);
+
+  const int generic = getBufferTargetIndex(target);
+  if (generic >= 0) mBuffers[generic] = buffer;
+}
+
+void RenderState::bindTexture(GLint texUnit, GLenum target, GLuint texture)
+{
+  const int index = getTextureTargetIndex(target);
+  if (index < 0 || texUnit < 0 || texUnit >= static_cast<GLint>(MAX_TEXTURE_UNITS))
+  {
+    setActiveTexture(texUnit);
+    mStats.issued[static_cast<size_t>(Call::TEXTURE)]++;
+    glBindTexture(target, texture);
+    return;
+  }
+
+  // the unit only has to be active if we actually bind
+  if (mTextures[texUnit][index] == texture)
+  {
+    mStats.elided[static_cast<size_t>(Call::TEXTURE)]++;
+    return;
+  }
+
+  setActiveTexture(texUnit);
+  change(mTextures[texUnit][index], texture, Call::TEXTURE);
+  glBindTexture(target, texture);
+}
+
+void RenderState::bindTexture(GLenum target, GLuint texture)
+{
+  if (mActiveTexture == UNKNOWN) setActiveTexture(0);
+  bindTexture(static_cast<GLint>(mActiveTexture), target, texture);
+}
+
+void RenderState::setActiveTexture(GLint texUnit)
+{
+  if (change(mActiveTexture, static_cast<GLuint>(texUnit), Call::ACTIVE_TEXTURE)) glActiveTexture(GL_TEXTURE0 + texUnit);
+}
+
+void RenderState::setPolygonMode(GLenum mode)
+{
+  if (change(mPolygonMode, mode, Call::POLYGON_MODE)) glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void RenderState::setDepthTest(bool enabled)
+{
+  if (!change(mDepthTest, enabled ? GL_TRUE : GL_FALSE, Call::DEPTH)) return;
+
+  if (enabled) glEnable(GL_DEPTH_TEST);
+  else glDisable(GL_DEPTH_TEST);
+}
+
+void RenderState::setDepthWrite(bool enabled)
+{
+  if (change(mDepthWrite, enabled ? GL_TRUE : GL_FALSE, Call::DEPTH)) glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void RenderState::setDepthFunc(GLenum func)
+{
+  if (change(mDepthFunc, func, Call::DEPTH)) glDepthFunc(func);
+}
+
+void RenderState::deleteProgram(GLuint program)
+{
+  if (program == 0) return;
+
+  glDeleteProgram(program);
+
+  // a program in use is only deleted once it's not in use anymore. We don't know when that is
+  if (mProgram == program) mProgram = UNKNOWN;
+}
+
+void RenderState::deleteVertexArray(GLuint vertexArray)
+{
+  if (vertexArray == 0) return;
+
+  glDeleteVertexArrays(1, &vertexArray);
+  if (mVertexArray == vertexArray)
+  {
+    mVertexArray = 0;
+    mBuffers[getBufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+  }
+}
+
+void RenderState::deleteBuffer(GLuint buffer)
+{
+  if (buffer == 0) return;
+
+  glDeleteBuffers(1, &buffer);
+  for (GLuint& bound : mBuffers)
+  {
+    if (bound == buffer) bound = 0;
+  }
+  for (BufferRange& range : mUniformRanges)
+  {
+    if (range.buffer == buffer) range = BufferRange{};
+  }
+}
+
+void RenderState::deleteTexture(GLuint texture)
+{
+  if (texture == 0) return;
+
+  glDeleteTextures(1, &texture);
+  for (GLuint (&unit)[TEXTURE_TARGET_COUNT] : mTextures)
+  {
+    for (GLuint& bound : unit)
+    {
+      if (bound == texture) bound = 0;
+    }
+  }
+}
+
+void RenderState::invalidate()
+{
+  mProgram = UNKNOWN;
+  mVertexArray = UNKNOWN;
+  for (GLuint& buffer : mBuffers) buffer = UNKNOWN;
+  for (BufferRange& range : mUniformRanges) range = { UNKNOWN, 0, 0 };
+  for (GLuint (&unit)[TEXTURE_TARGET_COUNT] : mTextures)
+  {
+    for (GLuint& texture : unit) texture = UNKNOWN;
+  }
+  mActiveTexture = UNKNOWN;
+  mPolygonMode = UNKNOWN;
+  mDepthTest = UNKNOWN;
+  mDepthWrite = UNKNOWN;
+  mDepthFunc = UNKNOWN;
+}
+
+void RenderState::beginFrame()
+{
+  mLastFrameStats = mStats;
+  mStats = Stats{};
+}
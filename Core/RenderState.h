@@ -0,0 +1,121 @@
+#pragma once
+
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <stdint.h>
+#include "GL/glew.h"
+
+// Shadow copy of the GL state we change all the time: program, VAO, buffer bindings, texture units,
+// polygon mode and depth state. Engine classes set state through it and calls that wouldn't change
+// anything never reach the driver
+//
+// There is one GL context, so there is one cache. Everything that binds or deletes GL objects must go
+// through it, otherwise the cache lies. Code that can't (third party) calls invalidate() afterwards
+class RenderState
+{
+public:
+
+  // kinds of calls we count
+  enum class Call : uint8_t
+  {
+    PROGRAM,
+    VERTEX_ARRAY,
+    BUFFER,
+    TEXTURE,
+    ACTIVE_TEXTURE,
+    POLYGON_MODE,
+    DEPTH,
+    COUNT,
+  };
+
+  struct Stats
+  {
+    uint32_t issued[static_cast<size_t>(Call::COUNT)]{}; // reached GL
+    uint32_t elided[static_cast<size_t>(Call::COUNT)]{}; // skipped, GL already had that state
+
+    uint32_t getIssued() const;
+    uint32_t getElided() const;
+  };
+
+  static RenderState& get();
+
+  RenderState(const RenderState&) = delete;
+  RenderState& operator=(const RenderState&) = delete;
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vertexArray);
+
+  // GL_ELEMENT_ARRAY_BUFFER belongs to the bound VAO. The cache forgets it when the VAO changes
+  void bindBuffer(GLenum target, GLuint buffer);
+
+  // indexed binding (uniform block binding points). Also binds the buffer to the generic target like GL does
+  void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+  // bind to a texture unit (activates the unit first if needed)
+  void bindTexture(GLint texUnit, GLenum target, GLuint texture);
+
+  // bind to the unit that is active right now. For uploads, where the unit doesn't matter
+  void bindTexture(GLenum target, GLuint texture);
+  void setActiveTexture(GLint texUnit);
+
+  void setPolygonMode(GLenum mode);
+  void setDepthTest(bool enabled);
+  void setDepthWrite(bool enabled);
+  void setDepthFunc(GLenum func);
+
+  // GL unbinds deleted objects and may reuse their names. Call these instead of glDelete* directly
+  void deleteProgram(GLuint program);
+  void deleteVertexArray(GLuint vertexArray);
+  void deleteBuffer(GLuint buffer);
+  void deleteTexture(GLuint texture);
+
+  // forget everything. The next call of every kind goes to GL
+  void invalidate();
+
+  // start counting a new frame. getStats() returns the counts of the frame before
+  void beginFrame();
+  const Stats& getStats() const { return mLastFrameStats; };
+
+private:
+
+  RenderState();
+
+  // bindings we cache. Other targets go straight to GL
+  static constexpr uint32_t MAX_TEXTURE_UNITS = 32;
+  static constexpr uint32_t TEXTURE_TARGET_COUNT = 3;  // 2D, 2D array, buffer
+  static constexpr uint32_t BUFFER_TARGET_COUNT = 6;   // array, element array, copy write, uniform, texture, draw indirect
+  static constexpr uint32_t MAX_UNIFORM_BINDINGS = 16;  // GL 3.3 guarantees at least 36 (12 per stage). We use the first few
+
+  // value of an entry we know nothing about. No GL name or enum has it
+  static constexpr GLuint UNKNOWN = UINT32_MAX;
+
+  static int getTextureTargetIndex(GLenum target);
+  static int getBufferTargetIndex(GLenum target);
+
+  // true if the call has to go to GL. Counts it either way
+  bool change(GLuint& cached, GLuint value, Call call);
+
+  GLuint mProgram{};
+  GLuint mVertexArray{};
+  GLuint mBuffers[BUFFER_TARGET_COUNT]{};
+
+  struct BufferRange
+  {
+    GLuint buffer{};
+    GLintptr offset{};
+    GLsizeiptr size{};
+  };
+  BufferRange mUniformRanges[MAX_UNIFORM_BINDINGS]{};
+  GLuint mTextures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT]{};
+  GLuint mActiveTexture{};
+  GLuint mPolygonMode{};
+  GLuint mDepthTest{};
+  GLuint mDepthWrite{};
+  GLuint mDepthFunc{};
+
+  Stats mStats{};
+  Stats mLastFrameStats{};
+};
+
+#endif // !RENDER_STATE_H
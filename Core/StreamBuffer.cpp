@@ -0,0 +1,275 @@
+#include <iostream>
+#include "StreamBuffer.h"
+#include "RenderState.h"
+
+StreamBuffer::StreamBuffer()
+  : mBuffer{},
+  mTarget{},
+  mMode(Mode::ORPHANING)
+{}
+
+StreamBuffer::~StreamBuffer()
+{
+  release();
+}
+
+bool StreamBuffer::init(GLenum target, GLsizeiptr frameSize, uint8_t framesInFlight)
+{
+  // pick the fastest path the driver gives us
+  Mode mode = Mode::ORPHANING;
+  if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+  {
+    mode = Mode::PERSISTENT;
+  }
+  else if (GLEW_VERSION_3_2 || GLEW_ARB_sync)
+  {
+    mode = Mode::UNSYNCHRONIZED;
+  }
+  return init(target, frameSize, framesInFlight, mode);
+}
+
+bool StreamBuffer::init(GLenum target, GLsizeiptr frameSize, uint8_t framesInFlight, Mode mode)
+{
+  release();
+
+  if (frameSize <= 0)
+  {
+    std::cerr << "StreamBuffer: frame size must be positive" << std::endl;
+    return false;
+  }
+
+  mTarget = target;
+  mMode = mode;
+  mFrameSize = frameSize;
+
+  // orphaning doesn't need segments. The driver gives us fresh storage every frame
+  mFramesInFlight = (mMode == Mode::ORPHANING) ? 1 : framesInFlight;
+  if (mFramesInFlight < 1) mFramesInFlight = 1;
+  if (mFramesInFlight > MAX_FRAMES_IN_FLIGHT) mFramesInFlight = MAX_FRAMES_IN_FLIGHT;
+
+  const GLsizeiptr totalSize = mFrameSize * mFramesInFlight;
+
+  // we never bind to the real target here. Binding GL_ELEMENT_ARRAY_BUFFER would change whatever VAO is bound
+  // GL_COPY_WRITE_BUFFER is a neutral target that doesn't affect drawing state
+  glGenBuffers(1, &mBuffer);
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+  if (mMode == Mode::PERSISTENT)
+  {
+    // immutable storage mapped once. Coherent means we don't need explicit flushes
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, nullptr, flags);
+    mPersistentPtr = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags));
+
+    if (mPersistentPtr == nullptr)
+    {
+      // the extension is advertised but mapping failed. Try the GL 3.3 path instead
+      std::cerr << "StreamBuffer: persistent mapping failed, falling back to unsynchronized mapping" << std::endl;
+      RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      return init(target, frameSize, framesInFlight, Mode::UNSYNCHRONIZED);
+    }
+  }
+  else
+  {
+    // mutable storage. GL_STREAM_DRAW hints the driver that we write once and draw a few times
+    glBufferData(GL_COPY_WRITE_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+  }
+
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  // start on the last segment so the first beginFrame() moves to segment 0
+  mSegment = mFramesInFlight - 1;
+  mCursor = mSegmentEnd = 0;
+  mStats = {};
+  return true;
+}
+
+void StreamBuffer::beginFrame()
+{
+  if (mBuffer == 0) return;
+
+  // anything left mapped from the last frame has to be committed first
+  commit();
+
+  mSegment = (mSegment + 1) % mFramesInFlight;
+  mCursor = mSegment * mFrameSize;
+  mSegmentEnd = mCursor + mFrameSize;
+  mStats.frameBytes = 0;
+  mStats.frameAllocations = 0;
+
+  if (mMode == Mode::ORPHANING)
+  {
+    // detach the old storage from the buffer. The GPU keeps reading the old one while we write the new one
+    RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, mFrameSize, nullptr, GL_STREAM_DRAW);
+    RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    mStats.orphans++;
+  }
+  else
+  {
+    // the segment we are about to write was last used mFramesInFlight frames ago
+    waitForSegment(mSegment);
+  }
+}
+
+StreamAllocation StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+  StreamAllocation allocation{};
+  if (mBuffer == 0 || size <= 0) return allocation;
+
+  if (alignment < 1) alignment = 1;
+  GLintptr offset = (mCursor + alignment - 1) / alignment * alignment;
+
+  if (offset + size > mSegmentEnd)
+  {
+    // with orphaning we can just take fresh storage again. Draws issued before keep the old one
+    if (mMode == Mode::ORPHANING && size <= mFrameSize)
+    {
+      commit();
+      RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+      glBufferData(GL_COPY_WRITE_BUFFER, mFrameSize, nullptr, GL_STREAM_DRAW);
+      RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      mStats.orphans++;
+      offset = 0;
+    }
+    else
+    {
+      mStats.overflows++;
+      return allocation;
+    }
+  }
+
+  if (mMode == Mode::PERSISTENT)
+  {
+    allocation.data = mPersistentPtr + offset;
+  }
+  else
+  {
+    // map lazily, so allocating after commit() in the same frame works too
+    if (mMappedPtr == nullptr && !mapRemaining(offset))
+    {
+      return allocation;
+    }
+    allocation.data = mMappedPtr + (offset - mMappedOffset);
+  }
+
+  allocation.offset = offset;
+  allocation.size = size;
+
+  mCursor = offset + size;
+  mStats.bytesStreamed += size;
+  mStats.frameBytes += size;
+  mStats.frameAllocations++;
+  return allocation;
+}
+
+void StreamBuffer::commit()
+{
+  // coherent persistent mapping makes writes visible without any call
+  if (mMappedPtr == nullptr) return;
+
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+  // we mapped with explicit flush. Only flush what was actually written (offset is relative to the mapped range)
+  if (mCursor > mMappedOffset)
+  {
+    glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, 0, mCursor - mMappedOffset);
+  }
+  glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  mMappedPtr = nullptr;
+  mMappedOffset = 0;
+}
+
+void StreamBuffer::endFrame()
+{
+  if (mBuffer == 0) return;
+
+  commit();
+
+  if (mMode == Mode::ORPHANING) return;
+
+  // remember when the GPU is done with this segment
+  if (mFences[mSegment] != nullptr)
+  {
+    glDeleteSync(mFences[mSegment]);
+  }
+  mFences[mSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool StreamBuffer::mapRemaining(GLintptr offset)
+{
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+  // the fence already told us the GPU doesn't read this range, so don't let the driver synchronize
+  // with orphaning the storage is brand new, so there is nothing to synchronize with either
+  const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+  mMappedPtr = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, mSegmentEnd - offset, flags));
+  RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  if (mMappedPtr == nullptr)
+  {
+    std::cerr << "StreamBuffer: failed to map buffer range" << std::endl;
+    return false;
+  }
+  mMappedOffset = offset;
+  return true;
+}
+
+void StreamBuffer::waitForSegment(uint8_t segment)
+{
+  GLsync fence = mFences[segment];
+  if (fence == nullptr) return;
+
+  // poll first. If the GPU is already done we don't count it as a stall
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED)
+  {
+    mStats.stalls++;
+
+    // flush on wait so the fence is guaranteed to be submitted. Wait 1 ms at a time
+    while (result == GL_TIMEOUT_EXPIRED)
+    {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+  }
+
+  if (result == GL_WAIT_FAILED)
+  {
+    std::cerr << "StreamBuffer: waiting for a fence failed" << std::endl;
+  }
+
+  glDeleteSync(fence);
+  mFences[segment] = nullptr;
+}
+
+void StreamBuffer::release()
+{
+  for (GLsync& fence : mFences)
+  {
+    if (fence != nullptr)
+    {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  if (mBuffer != 0)
+  {
+    if (mPersistentPtr != nullptr || mMappedPtr != nullptr)
+    {
+      RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      RenderState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    RenderState::get().deleteBuffer(mBuffer);
+  }
+
+  mBuffer = 0;
+  mPersistentPtr = nullptr;
+  mMappedPtr = nullptr;
+  mMappedOffset = 0;
+  mCursor = mSegmentEnd = 0;
+}
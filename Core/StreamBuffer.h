@@ -0,0 +1,106 @@
+#pragma once
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <stdint.h>
+#include "GL/glew.h"
+
+// a chunk of the stream buffer handed out for the current frame
+// write vertices/indices through data and draw from offset in the GL buffer
+struct StreamAllocation
+{
+  void* data{};
+  GLintptr offset{};
+  GLsizeiptr size{};
+};
+
+// Ring buffer for geometry that changes every frame (debug lines, particles, UI)
+// The buffer is split into one segment per frame in flight. Each frame writes into its own segment
+// and a fence tells us when the GPU is done reading the segment we are about to reuse
+class StreamBuffer
+{
+public:
+  StreamBuffer();
+  ~StreamBuffer();
+
+  // how we get a CPU pointer into the GPU buffer
+  enum class Mode : uint8_t
+  {
+    PERSISTENT,     // GL_ARB_buffer_storage: mapped once for the whole lifetime
+    UNSYNCHRONIZED, // GL 3.3: glMapBufferRange with GL_MAP_UNSYNCHRONIZED_BIT guarded by fences
+    ORPHANING,      // last fallback: glBufferData(nullptr) every frame and let the driver rename the storage
+  };
+
+  struct Stats
+  {
+    uint64_t bytesStreamed{};  // total bytes handed out since init
+    uint64_t frameBytes{};     // bytes handed out in the current frame
+    uint32_t frameAllocations{};
+    uint32_t stalls{};         // times we had to wait for the GPU to release a segment
+    uint32_t orphans{};        // times the storage was orphaned
+    uint32_t overflows{};      // allocations that didn't fit into a frame segment
+  };
+
+  // args: (target the buffer is going to be bound to for drawing, bytes available per frame, number of frames the GPU may lag behind)
+  // the best mode supported by the driver is picked automatically. Pass a mode to force a slower path (for testing)
+  bool init(GLenum target, GLsizeiptr frameSize, uint8_t framesInFlight = 3);
+  bool init(GLenum target, GLsizeiptr frameSize, uint8_t framesInFlight, Mode mode);
+
+  // switch to the next segment. Must be called once per frame before any allocate()
+  void beginFrame();
+
+  // get a write pointer for size bytes. Offset is aligned to alignment (use 4 for indices, vertex stride for vertices)
+  // returns an empty allocation (data == nullptr) if the segment is full
+  StreamAllocation allocate(GLsizeiptr size, GLsizeiptr alignment = 4);
+
+  // make writes visible to the GPU. Must be called after writing and before drawing from the buffer
+  void commit();
+
+  // place a fence after the last draw that used this frame's segment
+  void endFrame();
+
+  GLuint getBuffer() const { return mBuffer; };
+  GLenum getTarget() const { return mTarget; };
+  Mode getMode() const { return mMode; };
+  const Stats& getStats() const { return mStats; };
+
+private:
+
+  // frees GL objects. Called on dtr and on re-init
+  void release();
+
+  // maps [offset, segment end) for the non-persistent modes
+  bool mapRemaining(GLintptr offset);
+
+  // blocks until the GPU has finished with the given segment
+  void waitForSegment(uint8_t segment);
+
+  // the frames in flight can't exceed this
+  static constexpr uint8_t MAX_FRAMES_IN_FLIGHT = 4;
+
+  GLuint mBuffer{};
+  GLenum mTarget{};
+  Mode mMode{};
+
+  GLsizeiptr mFrameSize{};
+  uint8_t mFramesInFlight{};
+  uint8_t mSegment{};
+
+  // write position inside the buffer (absolute offset) and where the current segment ends
+  GLintptr mCursor{};
+  GLintptr mSegmentEnd{};
+
+  // persistent mode keeps the whole buffer mapped here
+  uint8_t* mPersistentPtr{};
+
+  // non-persistent modes map a range at a time
+  uint8_t* mMappedPtr{};
+  GLintptr mMappedOffset{};
+
+  GLsync mFences[MAX_FRAMES_IN_FLIGHT]{};
+
+  Stats mStats{};
+};
+
+#endif // !STREAM_BUFFER_H
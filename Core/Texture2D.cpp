@@ -1,8 +1,10 @@
 #include "Texture2D.h"
-#define STB_IMAGE_IMPLEMENTATION // generates implementation of STB LIB. It must be done before "include the header" It specified so by the lib creator
-// lib to load images. OpenGL doesn't have this functionality by default
-#include "stb_image/stb_image.h"
 #include <iostream>
+#include <algorithm>
+#include "AssetFormats.h"
+#include "TextureCompression.h"
+#include "ImageDecodePool.h"
+#include "RenderState.h"
 
 Texture2D::Texture2D()
   : mTexture(0)
@@ -11,59 +13,206 @@ Texture2D::Texture2D()
 
 Texture2D::~Texture2D()
 {
+  release();
+}
 
+void Texture2D::release()
+{
+  // the GL object lives in VRAM until it's deleted. Without this every texture leaks
+  if (mTexture != 0)
+  {
+    RenderState::get().deleteTexture(mTexture);
+    mTexture = 0;
+  }
+  mMemorySize = 0;
+  mBaseLevel = 0;
+  mLevelCount = 0;
 }
 
-bool Texture2D::loadTexture(const string & filename, bool generateMipMaps)
+bool Texture2D::loadTexture(const string & filename, bool generateMipMaps, bool memoryMapped)
 {
-  // will be passed to a method to read image from disk
-  int width{}, height{}, components{};
+  MappedFile file{};
+  ImageView view{};
+  if (memoryMapped && mapImageFile(filename, file, view))
+  {
+    return upload(view, generateMipMaps);
+  }
 
-  // stb lib will read the file from disk. Allocate array of bytes and return
-  // a pointer to that array
-  // c_str() means C string because of a method returns a char pointer
-  // args (filename, width, height, components(RGBA), type of image) Last enum can be found in the stb_image.h meaning RGBA image
-  // 4 components type of image to read
-  unsigned char* imageData = stbi_load(filename.c_str(), &width, &height, &components, STBI_rgb_alpha);
-  if (imageData == nullptr)
+  // decoding (or reading the cooked file) is GL free and lives in ImageDecodePool.cpp,
+  // so the decode pool can run it on worker threads. Here we only upload
+  ImageData image{};
+  if (!loadImageFile(filename, image))
   {
     std::cerr << "Error loading texture '" << filename << "'" << std::endl;
     return false;
   }
 
-  // flip image vertically because it loads in upside down
-  // we use a trick with a pointer arithmetic
-  // we could also do it in any place like in a shader itself but decided to flip it right on loading image
-  // we need width in bytes to reverse bytes in the image from bottom to top by myltiplying this width in bytes
-  int widthInBytes = width * 4; // because 1 pixel = 8 bits. 8 * 4 = 32 bits or 4 bytes
-  unsigned char* top = nullptr;
-  unsigned char* bottom = nullptr;
-  unsigned char temp = 0;
-  int halfHeight = height / 2;
-  // going along a half of the texture vertically
-  for (int row = 0; row < halfHeight; row++)
-  {
-    top = imageData + row * widthInBytes; // going through top 
-    bottom = imageData + (height - row - 1) * widthInBytes; // going through bottom
-    for (int col = 0; col < widthInBytes; col++)
+  return upload(image, generateMipMaps);
+}
+
+bool Texture2D::loadCooked(const string& filename, bool memoryMapped)
+{
+  if (memoryMapped)
+  {
+    MappedFile file{};
+    ImageView view{};
+    if (!mapFlyTex(filename, file, view))
     {
-      // actual reversing
-      temp = *top; // store top value in a temp var. Dereference *top because temp is not a ptr
-      *top = *bottom; // reverse top and bottom values dereferencing them
-      *bottom = temp; // assign former top value to bottom
-      top++; // iterate with a loop
-      bottom++; // iterate with a loop
+      std::cerr << "Error loading cooked texture '" << filename << "'" << std::endl;
+      return false;
     }
 
+    std::cout << "Loading cooked texture " << filename << " (mapped) ..." << std::endl;
+    return upload(view);
+  }
+
+  ImageData image{};
+  if (!readFlyTex(filename, image))
+  {
+    std::cerr << "Error loading cooked texture '" << filename << "'" << std::endl;
+    return false;
+  }
+
+  std::cout << "Loading cooked texture " << filename << " ..." << std::endl;
+  return upload(image);
+}
+
+bool Texture2D::upload(const ImageData& image, bool generateMipMaps)
+{
+  return upload(makeImageView(image), generateMipMaps);
+}
+
+bool Texture2D::upload(const ImageView& image, bool generateMipMaps)
+{
+  if (image.mips.empty()) return false;
+
+  // loading into a texture that's already loaded replaces it
+  release();
+
+  // block compressed textures stay compressed in VRAM (4 or 8 times smaller than RGBA8)
+  // drivers without S3TC get them decoded on the CPU instead
+  const ImageView* source = &image;
+  ImageData decompressed{};
+  ImageView decompressedView{};
+  if (isBlockCompressed(image.format) && !GLEW_EXT_texture_compression_s3tc)
+  {
+    std::cout << "EXT_texture_compression_s3tc is not supported. Decompressing the texture" << std::endl;
+    decompressImage(copyImageView(image), decompressed);
+    decompressedView = makeImageView(decompressed);
+    source = &decompressedView;
+  }
+
+  createTexture(*source, 0, source->mips.size() > 1 || generateMipMaps);
+
+  // next we're gonna map bits from the image we loaded to the OpenGL texture (convert a loaded image to the OpenGL texture)
+  // cooked images bring their whole mip chain, so we upload it level by level
+  for (uint32_t level = 0; level < source->mips.size(); level++)
+  {
+    uploadLevel(level, source->mips[level]);
+  }
+
+  if (source->mips.size() == 1 && generateMipMaps)
+  {
+    // OpenGL does this work for us. It doesn't modify an original image
+    // It modifies internal OpenGL GL_TEXTURE_2D object to generate mipmaps 
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // the driver allocated the rest of the chain down to 1x1
+    for (uint32_t w = source->mips[0].width, h = source->mips[0].height; w > 1 || h > 1;)
+    {
+      w = w > 1 ? w / 2 : 1;
+      h = h > 1 ? h / 2 : 1;
+      mMemorySize += getLevelSize(source->format, w, h);
+    }
   }
 
+  // unbind the texture because we're done. We did all work and don't want to affect
+  // the texture somehow. We unbind the texture by passing the second 0 argument
+  // it stops tracking any action on our texture
+  RenderState::get().bindTexture(GL_TEXTURE_2D, 0);
+  return true;
+}
+
+bool Texture2D::uploadStreamed(const ImageView& image, uint32_t firstLevel)
+{
+  if (image.mips.empty()) return false;
+
+  // without S3TC upload() has to decompress everything anyway
+  if (image.mips.size() == 1 || (isBlockCompressed(image.format) && !GLEW_EXT_texture_compression_s3tc))
+  {
+    return upload(image, false);
+  }
+
+  release();
+
+  firstLevel = std::min(firstLevel, static_cast<uint32_t>(image.mips.size()) - 1);
+  createTexture(image, firstLevel, true);
+  for (uint32_t level = firstLevel; level < image.mips.size(); level++)
+  {
+    uploadLevel(level, image.mips[level]);
+  }
+
+  RenderState::get().bindTexture(GL_TEXTURE_2D, 0);
+  return true;
+}
+
+bool Texture2D::streamInLevel(const ImageView& image)
+{
+  if (mTexture == 0 || mBaseLevel == 0 || mBaseLevel > image.mips.size()) return false;
+
+  // the new level is complete before the sampler is allowed to use it
+  RenderState::get().bindTexture(GL_TEXTURE_2D, mTexture);
+  uploadLevel(mBaseLevel - 1, image.mips[mBaseLevel - 1]);
+  mBaseLevel--;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(mBaseLevel));
+  RenderState::get().bindTexture(GL_TEXTURE_2D, 0);
+  return true;
+}
+
+bool Texture2D::dropBaseLevel()
+{
+  if (mTexture == 0 || mBaseLevel + 1 >= mLevelCount) return false;
+
+  // stop sampling the level first, then respecify it as 0x0. That's how GL 3.3 lets the driver free a level
+  // levels below the base level don't count for completeness, so the texture stays usable
+  RenderState::get().bindTexture(GL_TEXTURE_2D, mTexture);
+  const uint32_t level = mBaseLevel++;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(mBaseLevel));
+  if (mCompressedFormat != 0)
+  {
+    glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), mCompressedFormat, 0, 0, 0, 0, nullptr);
+  }
+  else
+  {
+    glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+  RenderState::get().bindTexture(GL_TEXTURE_2D, 0);
+
+  const uint32_t width = std::max(mWidth >> level, 1u);
+  const uint32_t height = std::max(mHeight >> level, 1u);
+  mMemorySize -= getLevelSize(mFormat, width, height);
+  return true;
+}
+
+void Texture2D::createTexture(const ImageView& image, uint32_t baseLevel, bool hasMips)
+{
+  mFormat = image.format;
+  mCompressedFormat = 0;
+  if (isBlockCompressed(image.format))
+  {
+    mCompressedFormat = (image.format == TextureFormat::DXT1) ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  }
+  mWidth = image.mips[0].width;
+  mHeight = image.mips[0].height;
+  mLevelCount = static_cast<uint32_t>(image.mips.size());
+  mBaseLevel = baseLevel;
 
   // Generate textures like we generated buffers
   // args (number of texture, texture handler which will store a generated texture
   glGenTextures(1, &mTexture);
 
   // bind texture args (what kind of texture to bind, handler that holds a texture
-  glBindTexture(GL_TEXTURE_2D, mTexture);
+  RenderState::get().bindTexture(GL_TEXTURE_2D, mTexture);
 
   // next we are going to assign parameters of the generated texture
   // wrapping mode, filtering
@@ -78,38 +227,36 @@ bool Texture2D::loadTexture(const string & filename, bool generateMipMaps)
   // filtering mode if the texture is bigger than the polygon (GL_TEXTURE_MIN_FILTER) - MIN = Minification
   // we minimize the texture. We are going to use Linear Filtering (average the pixel between the pixel nearest to the fragment and surrounding pixels) More smooth
   // GL_NEREST = filter mode that selects a nereast to the fragment pixel color. It's more sharp
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  // with a mip chain we blend the two nearest levels too (trilinear). Without one the mips would never be sampled
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, hasMips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 
   // filtering mode if the texture is smaller than the polygon (GL_TEXTURE_MAG_FILTER) - MAG = Magnification
   // we maximize the texture
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  // next we're gonna map bits from the image we loaded to the OpenGL texture (convert a loaded image to the OpenGL texture)
+  // tell OpenGL which levels there are, so a chain that stops early (or starts late while streaming) is still complete
+  if (mLevelCount > 1)
+  {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(mBaseLevel));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(mLevelCount) - 1);
+  }
+}
+
+void Texture2D::uploadLevel(uint32_t level, const MipLevelView& mip)
+{
   // args (type of texture, particular level of detail 0 = full resolution of the texture,
   // internal format of the texture, width, height, width of border 0 = no border,
   // resulting texture format, type of data we're passing in to create this OpenGL texture,
-  // OpenGL needs to know what size of data we're passing in, data itself (pointer to
-  // array of bytes we loaded with stbi loader))
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
-
-  if (generateMipMaps)
+  // OpenGL needs to know what size of data we're passing in, data itself)
+  mMemorySize += mip.size;
+  if (mCompressedFormat != 0)
   {
-    // OpenGL does this work for us. It doesn't modify an original image
-    // It modifies internal OpenGL GL_TEXTURE_2D object to generate mipmaps 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), mCompressedFormat, mip.width, mip.height, 0, static_cast<GLsizei>(mip.size), mip.pixels);
+  }
+  else
+  {
+    glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels);
   }
-
-  // we need to clean our memory because we are done
-  // once we called glTexImage2D() and passed in imagData array of data OpenGL generated a texture
-  // we don't need to allocate memory anymore for unsigned char* imageData
-  // free memory (args: pointer to the image data)
-  stbi_image_free(imageData);
-
-  // unbind the texture because we're done. We did all work and don't want to affect
-  // the texture somehow. We unbind the texture by passing the second 0 argument
-  // it stops tracking any action on our texture
-  glBindTexture(GL_TEXTURE_2D, 0);
-  return true;
 }
 
 void Texture2D::bind(GLint texUnit)
@@ -119,18 +266,14 @@ void Texture2D::bind(GLint texUnit)
   // (number is determined by a specific video card) that allows using blending of multiple textures
   // GL_TEXTURE0 is the first texture unit
   // + texUnit we use different tex units passed by an arg. We handle using multiple tex units by this way
-  glActiveTexture(GL_TEXTURE0 + texUnit);
-
-  // args: (type of texture we deal, texture handler)
-  // bind to listen to actions on the texture
-  glBindTexture(GL_TEXTURE_2D, mTexture);
+  // args: (texture unit, type of texture we deal, texture handler)
+  // bind to listen to actions on the texture. The state cache skips it if the unit has it already
+  RenderState::get().bindTexture(texUnit, GL_TEXTURE_2D, mTexture);
 }
 
 void Texture2D::unbind(GLint texUnit)
 {
   // do the same as in the method above
-  glActiveTexture(GL_TEXTURE0 + texUnit);
-
-  // but just pass in 0 as a second argument to unbind
-  glBindTexture(GL_TEXTURE_2D, 0);
+  // but just pass in 0 as a texture to unbind
+  RenderState::get().bindTexture(texUnit, GL_TEXTURE_2D, 0);
 }
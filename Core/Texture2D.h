@@ -5,6 +5,7 @@
 
 #include "GL\glew.h"
 #include <string>
+#include "ImageData.h"
 using std::string;
 
 class Texture2D
@@ -14,7 +15,32 @@ public:
   Texture2D();
   virtual ~Texture2D();
 
-  bool loadTexture(const string& filename, bool generateMipMaps = true);
+  // a texture owns its GL object, so copies would delete it twice
+  Texture2D(const Texture2D&) = delete;
+  Texture2D& operator=(const Texture2D&) = delete;
+
+  // if flycook has produced an up to date .flytex for the file, that one is loaded instead
+  // memoryMapped uploads the .flytex straight from a mapping of the file instead of reading it into memory first
+  bool loadTexture(const string& filename, bool generateMipMaps = true, bool memoryMapped = false);
+
+  // load a .flytex written by the offline cooker. It is already flipped and contains its mip chain
+  bool loadCooked(const string& filename, bool memoryMapped = false);
+
+  // create the GL texture from a decoded image (see loadImageFile()). Images with a single level
+  // get their mips from the driver if generateMipMaps is set
+  bool upload(const ImageData& image, bool generateMipMaps = true);
+  bool upload(const ImageView& image, bool generateMipMaps = true);
+
+  // streaming: create the texture with only the levels from firstLevel down to 1x1. The finer ones
+  // come later through streamInLevel(). image must stay valid for as long as levels are streamed from it
+  // a single level, or DXT without driver support, is uploaded in full
+  bool uploadStreamed(const ImageView& image, uint32_t firstLevel);
+
+  // upload the next finer level (getBaseLevel() - 1) and start sampling from it
+  bool streamInLevel(const ImageView& image);
+
+  // stop sampling the finest resident level and give its memory back. The coarsest level always stays
+  bool dropBaseLevel();
 
   // binding texture. Texture unit arg is being used by a sampler. It's being used for multiple textures
   // and allow that a single texture is bound to different texture units for blending multiple textures
@@ -24,12 +50,39 @@ public:
 
   void unbind(GLint texUnit = 0);
 
+  // delete the GL texture. The object can be loaded again afterwards
+  void release();
+
+  bool isLoaded() const { return mTexture != 0; };
+
+  // bytes of VRAM the texture takes, all mip levels included
+  size_t getMemorySize() const { return mMemorySize; };
+
+  // finest level that is resident. 0 unless the texture is streamed
+  uint32_t getBaseLevel() const { return mBaseLevel; };
+  uint32_t getLevelCount() const { return mLevelCount; };
+
 private:
 
+  // generate the GL object, set its parameters and leave it bound
+  void createTexture(const ImageView& image, uint32_t baseLevel, bool hasMips);
+
+  // glTexImage2D or glCompressedTexImage2D for one level. The texture must be bound
+  void uploadLevel(uint32_t level, const MipLevelView& mip);
+
   // Like many other OpenGL objects OpenGL holds a texture itself
   // but we need to have a handle to it
   GLuint mTexture{};
 
+  size_t mMemorySize{};
+
+  // what createTexture() set up. Streaming needs it to add and drop levels later
+  TextureFormat mFormat{ TextureFormat::RGBA8 };
+  GLenum mCompressedFormat{};
+  uint32_t mWidth{};
+  uint32_t mHeight{};
+  uint32_t mBaseLevel{};
+  uint32_t mLevelCount{};
 
 };
 
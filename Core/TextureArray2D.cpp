@@ -0,0 +1,131 @@
+#include "TextureArray2D.h"
+#include <iostream>
+#include "TextureCompression.h"
+#include "RenderState.h"
+
+TextureArray2D::~TextureArray2D()
+{
+  release();
+}
+
+void TextureArray2D::release()
+{
+  if (mTexture != 0)
+  {
+    RenderState::get().deleteTexture(mTexture);
+    mTexture = 0;
+  }
+  mLayerCount = 0;
+  mMemorySize = 0;
+}
+
+bool TextureArray2D::upload(const std::vector<ImageView>& layers, bool generateMipMaps)
+{
+  if (layers.empty() || layers[0].mips.empty()) return false;
+
+  // every layer of an array has the same size and levels
+  const ImageView& first = layers[0];
+  for (const ImageView& layer : layers)
+  {
+    if (layer.format != first.format || layer.mips.size() != first.mips.size() ||
+      layer.mips[0].width != first.mips[0].width || layer.mips[0].height != first.mips[0].height)
+    {
+      std::cerr << "Texture array layers must have the same size, format and mip levels" << std::endl;
+      return false;
+    }
+  }
+
+  release();
+
+  // same as Texture2D::upload(). DXT stays compressed unless the driver can't sample it
+  const std::vector<ImageView>* source = &layers;
+  std::vector<ImageData> decompressed{};
+  std::vector<ImageView> decompressedViews{};
+  if (isBlockCompressed(first.format) && !GLEW_EXT_texture_compression_s3tc)
+  {
+    std::cout << "EXT_texture_compression_s3tc is not supported. Decompressing the texture array" << std::endl;
+    decompressed.resize(layers.size());
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+      decompressImage(copyImageView(layers[i]), decompressed[i]);
+      decompressedViews.push_back(makeImageView(decompressed[i]));
+    }
+    source = &decompressedViews;
+  }
+
+  const ImageView& image = (*source)[0];
+  const GLsizei layerCount = static_cast<GLsizei>(source->size());
+  const GLenum compressedFormat = !isBlockCompressed(image.format) ? 0 :
+    (image.format == TextureFormat::DXT1) ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  const bool hasMips = image.mips.size() > 1 || generateMipMaps;
+
+  glGenTextures(1, &mTexture);
+  RenderState::get().bindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+
+  // the same sampling as our 2D textures: repeat and trilinear
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, hasMips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // allocate each level for all layers at once, then fill it layer by layer
+  for (uint32_t level = 0; level < image.mips.size(); level++)
+  {
+    const MipLevelView& mip = image.mips[level];
+    if (compressedFormat != 0)
+    {
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), compressedFormat, mip.width, mip.height, layerCount, 0,
+        static_cast<GLsizei>(mip.size * layerCount), nullptr);
+    }
+    else
+    {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), GL_RGBA, mip.width, mip.height, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    for (GLsizei layer = 0; layer < layerCount; layer++)
+    {
+      const MipLevelView& layerMip = (*source)[layer].mips[level];
+      if (compressedFormat != 0)
+      {
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, layer, layerMip.width, layerMip.height, 1,
+          compressedFormat, static_cast<GLsizei>(layerMip.size), layerMip.pixels);
+      }
+      else
+      {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, layer, layerMip.width, layerMip.height, 1,
+          GL_RGBA, GL_UNSIGNED_BYTE, layerMip.pixels);
+      }
+    }
+    mMemorySize += mip.size * layerCount;
+  }
+
+  if (image.mips.size() > 1)
+  {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.mips.size()) - 1);
+  }
+  else if (generateMipMaps)
+  {
+    // each layer gets its own chain
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    for (uint32_t w = image.mips[0].width, h = image.mips[0].height; w > 1 || h > 1;)
+    {
+      w = w > 1 ? w / 2 : 1;
+      h = h > 1 ? h / 2 : 1;
+      mMemorySize += getLevelSize(image.format, w, h) * layerCount;
+    }
+  }
+
+  RenderState::get().bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  mLayerCount = static_cast<uint32_t>(layerCount);
+  return true;
+}
+
+void TextureArray2D::bind(GLint texUnit)
+{
+  RenderState::get().bindTexture(texUnit, GL_TEXTURE_2D_ARRAY, mTexture);
+}
+
+void TextureArray2D::unbind(GLint texUnit)
+{
+  RenderState::get().bindTexture(texUnit, GL_TEXTURE_2D_ARRAY, 0);
+}
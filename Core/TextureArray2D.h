@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef TEXTURE_ARRAY_2D_H
+#define TEXTURE_ARRAY_2D_H
+
+#include "GL\glew.h"
+#include <stdint.h>
+#include <vector>
+#include "ImageData.h"
+
+// GL_TEXTURE_2D_ARRAY made of images with the same size, format and number of mips
+// One bind makes every layer available. The shader picks the layer with the third texture coordinate,
+// so objects with different textures from the same array are drawn without rebinding
+class TextureArray2D
+{
+public:
+
+  TextureArray2D() = default;
+  ~TextureArray2D();
+
+  // a texture owns its GL object, so copies would delete it twice
+  TextureArray2D(const TextureArray2D&) = delete;
+  TextureArray2D& operator=(const TextureArray2D&) = delete;
+
+  // one layer per image, in order. Fails if the images don't match each other
+  // images with a single level get their mips from the driver if generateMipMaps is set
+  bool upload(const std::vector<ImageView>& layers, bool generateMipMaps = true);
+
+  // works as Texture2D::bind()
+  void bind(GLint texUnit = 0);
+  void unbind(GLint texUnit = 0);
+
+  // delete the GL texture. The object can be loaded again afterwards
+  void release();
+
+  bool isLoaded() const { return mTexture != 0; };
+  uint32_t getLayerCount() const { return mLayerCount; };
+
+  // bytes of VRAM the texture takes, all layers and mip levels included
+  size_t getMemorySize() const { return mMemorySize; };
+
+private:
+
+  GLuint mTexture{};
+  uint32_t mLayerCount{};
+  size_t mMemorySize{};
+};
+
+#endif // !TEXTURE_ARRAY_2D_H
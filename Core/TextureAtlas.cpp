@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cstring>
+#include "TextureAtlas.h"
+#include "stb_image_resize/stb_image_resize.h" // implemented in ImageData.cpp
+#define STB_RECT_PACK_IMPLEMENTATION // generates the implementation of stb_rect_pack in this file only
+#include "stb_rect_pack/stb_rect_pack.h"
+
+namespace
+{
+  uint32_t roundUp(uint32_t value, uint32_t multiple)
+  {
+    return (value + multiple - 1) / multiple * multiple;
+  }
+
+  // copy a texture level into a page level at (x, y) with border texels around it, wrapped like GL_REPEAT
+  // border is never larger than the level, so one wrap is enough
+  void blitWrapped(const MipLevel& source, MipLevel& page, uint32_t x, uint32_t y, uint32_t border)
+  {
+    const size_t sourceRowBytes = static_cast<size_t>(source.width) * 4;
+    const size_t borderBytes = static_cast<size_t>(border) * 4;
+
+    for (uint32_t row = 0; row < source.height + 2 * border; row++)
+    {
+      const uint32_t sourceRow = (row + source.height - border) % source.height;
+      const uint8_t* from = source.pixels.data() + sourceRow * sourceRowBytes;
+      uint8_t* to = page.pixels.data() + ((static_cast<size_t>(y) + row) * page.width + x) * 4;
+
+      // right end of the row, the row, left end of the row
+      memcpy(to, from + sourceRowBytes - borderBytes, borderBytes);
+      memcpy(to + borderBytes, from, sourceRowBytes);
+      memcpy(to + borderBytes + sourceRowBytes, from, borderBytes);
+    }
+  }
+}
+
+TextureAtlasBuilder::TextureAtlasBuilder(const AtlasSettings& settings)
+  : mSettings(settings)
+{
+  // largest power of two that isn't bigger than the requested gutter. Level k then has a border of gutter >> k
+  // texels and we keep the levels where that's at least one texel
+  mGutter = 1;
+  mMipCount = 1;
+  while (mGutter * 2 <= mSettings.gutter)
+  {
+    mGutter *= 2;
+    mMipCount++;
+  }
+}
+
+bool TextureAtlasBuilder::canAdd(uint32_t width, uint32_t height) const
+{
+  if (width == 0 || height == 0 || width > mSettings.maxTextureSize || height > mSettings.maxTextureSize) return false;
+
+  return roundUp(width, mGutter) + 2 * mGutter <= mSettings.pageSize && roundUp(height, mGutter) + 2 * mGutter <= mSettings.pageSize;
+}
+
+bool TextureAtlasBuilder::add(const ImageData& image, uint32_t& id)
+{
+  if (image.mips.empty() || image.format != TextureFormat::RGBA8) return false;
+
+  const MipLevel& source = image.mips[0];
+  if (!canAdd(source.width, source.height)) return false;
+
+  ImageData copy{};
+  copy.mips.resize(1);
+  MipLevel& level = copy.mips[0];
+  level.width = roundUp(source.width, mGutter);
+  level.height = roundUp(source.height, mGutter);
+
+  if (level.width == source.width && level.height == source.height)
+  {
+    level.pixels = source.pixels;
+  }
+  else
+  {
+    level.pixels.resize(getLevelSize(TextureFormat::RGBA8, level.width, level.height));
+    stbir_resize_uint8_generic(
+      source.pixels.data(), source.width, source.height, 0,
+      level.pixels.data(), level.width, level.height, 0,
+      4, 3, 0, STBIR_EDGE_WRAP, STBIR_FILTER_DEFAULT,
+      mSettings.mips.gammaCorrect ? STBIR_COLORSPACE_SRGB : STBIR_COLORSPACE_LINEAR, nullptr);
+  }
+
+  id = static_cast<uint32_t>(mImages.size());
+  mImages.push_back(std::move(copy));
+  mRegions.emplace_back();
+  return true;
+}
+
+bool TextureAtlasBuilder::build()
+{
+  mPages.clear();
+  mStats = AtlasStats{};
+  if (mImages.empty()) return false;
+
+  // every texture gets its own chain first. The page levels are copies of those, so a filter never
+  // reaches into a neighbour and a texture looks the same in the atlas as on its own
+  for (ImageData& image : mImages)
+  {
+    buildMipChain(image, mSettings.mips);
+    image.mips.resize(std::min<size_t>(image.mips.size(), mMipCount));
+
+    mStats.texturePixels += static_cast<uint64_t>(image.mips[0].width) * image.mips[0].height;
+  }
+  mStats.textures = static_cast<uint32_t>(mImages.size());
+
+  // pack in units of the gutter. Then every position and size stays a whole number of texels on every level we keep
+  std::vector<stbrp_rect> pending(mImages.size());
+  for (size_t i = 0; i < mImages.size(); i++)
+  {
+    pending[i].id = static_cast<int>(i);
+    pending[i].w = static_cast<stbrp_coord>(mImages[i].mips[0].width / mGutter + 2);
+    pending[i].h = static_cast<stbrp_coord>(mImages[i].mips[0].height / mGutter + 2);
+  }
+
+  const int pageUnits = static_cast<int>(mSettings.pageSize / mGutter);
+  std::vector<stbrp_node> nodes(pageUnits);
+
+  // fill a page, start a new one with whatever didn't fit
+  while (!pending.empty())
+  {
+    stbrp_context context{};
+    stbrp_init_target(&context, pageUnits, pageUnits, nodes.data(), pageUnits);
+    stbrp_pack_rects(&context, pending.data(), static_cast<int>(pending.size()));
+
+    std::vector<stbrp_rect> packed{}, left{};
+    uint32_t pageWidth{}, pageHeight{};
+    for (const stbrp_rect& rect : pending)
+    {
+      if (!rect.was_packed)
+      {
+        left.push_back(rect);
+        continue;
+      }
+
+      packed.push_back(rect);
+      pageWidth = std::max(pageWidth, static_cast<uint32_t>(rect.x + rect.w) * mGutter);
+      pageHeight = std::max(pageHeight, static_cast<uint32_t>(rect.y + rect.h) * mGutter);
+    }
+
+    // canAdd() makes sure every texture fits an empty page
+    if (packed.empty()) return false;
+
+    // cropped to what the page holds. Both sides are multiples of the gutter, so every level we keep halves exactly
+    ImageData page{};
+    page.mips.resize(mMipCount);
+    for (uint32_t k = 0; k < mMipCount; k++)
+    {
+      page.mips[k].width = pageWidth >> k;
+      page.mips[k].height = pageHeight >> k;
+      page.mips[k].pixels.resize(getLevelSize(TextureFormat::RGBA8, page.mips[k].width, page.mips[k].height));
+    }
+
+    const uint32_t pageIndex = static_cast<uint32_t>(mPages.size());
+    for (const stbrp_rect& rect : packed)
+    {
+      const ImageData& image = mImages[rect.id];
+      const uint32_t x = static_cast<uint32_t>(rect.x) * mGutter;
+      const uint32_t y = static_cast<uint32_t>(rect.y) * mGutter;
+
+      for (uint32_t k = 0; k < mMipCount; k++)
+      {
+        blitWrapped(image.mips[k], page.mips[k], x >> k, y >> k, mGutter >> k);
+      }
+
+      // pages are flipped for OpenGL like every other image, so y counts from the bottom just like v
+      AtlasRegion& region = mRegions[rect.id];
+      region.page = pageIndex;
+      region.scaleU = static_cast<float>(image.mips[0].width) / pageWidth;
+      region.scaleV = static_cast<float>(image.mips[0].height) / pageHeight;
+      region.offsetU = static_cast<float>(x + mGutter) / pageWidth;
+      region.offsetV = static_cast<float>(y + mGutter) / pageHeight;
+    }
+
+    mStats.pagePixels += static_cast<uint64_t>(pageWidth) * pageHeight;
+    mPages.push_back(std::move(page));
+    pending = std::move(left);
+  }
+
+  mStats.pages = static_cast<uint32_t>(mPages.size());
+
+  // the copies aren't needed anymore
+  mImages.clear();
+  return true;
+}
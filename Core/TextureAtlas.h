@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <stdint.h>
+#include <vector>
+#include "ImageData.h"
+
+// Packs small RGBA8 textures into large atlas pages with stb_rect_pack, so objects with different
+// textures can be drawn with one bind. No OpenGL in here, the caller uploads the pages
+//
+// Our textures repeat (GL_REPEAT), so the shader wraps the UVs itself: atlasUV = offset + fract(uv) * scale
+// Every texture gets a border (gutter) of its own texels wrapped around, so bilinear filtering across
+// the edge blends with the other side of the same texture and never with a neighbour
+
+struct AtlasSettings
+{
+  // largest page. Pages are cropped to what they hold
+  uint32_t pageSize{ 2048 };
+
+  // textures larger than this on either side stay standalone
+  uint32_t maxTextureSize{ 512 };
+
+  // texels of border around each texture at level 0, rounded down to a power of two
+  // it halves with every mip level, so it also decides how many levels the pages get (8 -> 4 levels)
+  uint32_t gutter{ 8 };
+
+  MipChainSettings mips{};
+};
+
+// where a texture ended up
+struct AtlasRegion
+{
+  uint32_t page{};
+
+  // UV rectangle of the texture in its page (gutter excluded)
+  float scaleU{ 1.0f };
+  float scaleV{ 1.0f };
+  float offsetU{};
+  float offsetV{};
+};
+
+struct AtlasStats
+{
+  uint32_t textures{};
+  uint32_t pages{};
+  uint64_t texturePixels{}; // level 0 texels of the packed textures
+  uint64_t pagePixels{};    // level 0 texels of all pages, gutters and empty space included
+
+  double getEfficiency() const { return pagePixels == 0 ? 0.0 : static_cast<double>(texturePixels) / pagePixels; };
+};
+
+class TextureAtlasBuilder
+{
+public:
+
+  explicit TextureAtlasBuilder(const AtlasSettings& settings = AtlasSettings{});
+
+  // true if an image of this size goes into the atlas
+  bool canAdd(uint32_t width, uint32_t height) const;
+
+  // take level 0 of an RGBA8 image. id addresses its region after build()
+  // sizes that aren't a multiple of the gutter are resampled up to the next multiple, so every mip level
+  // of the texture starts and ends on whole texels
+  bool add(const ImageData& image, uint32_t& id);
+
+  // pack everything added so far and fill the pages with their (shortened) mip chains
+  bool build();
+
+  const std::vector<ImageData>& getPages() const { return mPages; };
+  const AtlasRegion& getRegion(uint32_t id) const { return mRegions[id]; };
+  const AtlasStats& getStats() const { return mStats; };
+
+private:
+
+  AtlasSettings mSettings{};
+  uint32_t mGutter{};
+  uint32_t mMipCount{};
+
+  std::vector<ImageData> mImages{};
+  std::vector<AtlasRegion> mRegions{};
+  std::vector<ImageData> mPages{};
+  AtlasStats mStats{};
+};
+
+#endif // !TEXTURE_ATLAS_H
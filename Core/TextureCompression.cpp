@@ -0,0 +1,247 @@
+#include <cstring> // stb_dxt uses memcpy without including it itself
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "TextureCompression.h"
+
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt/stb_dxt.h"
+
+namespace
+{
+  // one row of 4x4 blocks of one level. The unit of work shared between threads
+  struct BlockRow
+  {
+    uint32_t level;
+    uint32_t row;
+  };
+
+  // copy a 4x4 block out of a level. Blocks that stick out of the level (small mips, odd sizes) repeat the edge pixels
+  void fetchBlock(const MipLevel& level, uint32_t blockX, uint32_t blockY, bool opaque, uint8_t block[64])
+  {
+    for (uint32_t y = 0; y < 4; y++)
+    {
+      const uint32_t sourceY = std::min(blockY * 4 + y, level.height - 1);
+      for (uint32_t x = 0; x < 4; x++)
+      {
+        const uint32_t sourceX = std::min(blockX * 4 + x, level.width - 1);
+        const uint8_t* pixel = &level.pixels[(static_cast<size_t>(sourceY) * level.width + sourceX) * 4];
+        uint8_t* target = &block[(y * 4 + x) * 4];
+        target[0] = pixel[0];
+        target[1] = pixel[1];
+        target[2] = pixel[2];
+        // stb_dxt wants a constant alpha when it doesn't store alpha
+        target[3] = opaque ? 255 : pixel[3];
+      }
+    }
+  }
+
+  void decodeColor565(uint16_t color, uint8_t rgb[3])
+  {
+    // expand 5 and 6 bit channels to 8 bits by repeating the high bits
+    const uint32_t r = (color >> 11) & 31;
+    const uint32_t g = (color >> 5) & 63;
+    const uint32_t b = color & 31;
+    rgb[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+    rgb[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+    rgb[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+  }
+
+  // 8 byte color block -> 16 RGBA pixels. DXT5 color blocks always use the 4 color mode
+  void decodeColorBlock(const uint8_t* block, bool allowPunchThrough, uint8_t pixels[64])
+  {
+    const uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+    const uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+
+    uint8_t palette[4][4]{};
+    decodeColor565(color0, palette[0]);
+    decodeColor565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+    if (color0 > color1 || !allowPunchThrough)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+        palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+      }
+    }
+    else
+    {
+      // 3 colors + transparent black
+      for (int c = 0; c < 3; c++)
+      {
+        palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+        palette[3][c] = 0;
+      }
+      palette[3][3] = 0;
+    }
+
+    const uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+    for (uint32_t i = 0; i < 16; i++)
+    {
+      const uint8_t* color = palette[(indices >> (i * 2)) & 3];
+      pixels[i * 4 + 0] = color[0];
+      pixels[i * 4 + 1] = color[1];
+      pixels[i * 4 + 2] = color[2];
+      pixels[i * 4 + 3] = color[3];
+    }
+  }
+
+  // 8 byte DXT5 alpha block -> alpha of 16 RGBA pixels
+  void decodeAlphaBlock(const uint8_t* block, uint8_t pixels[64])
+  {
+    uint32_t palette[8]{};
+    palette[0] = block[0];
+    palette[1] = block[1];
+    if (palette[0] > palette[1])
+    {
+      for (uint32_t i = 1; i < 7; i++) palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+    }
+    else
+    {
+      for (uint32_t i = 1; i < 5; i++) palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+      palette[6] = 0;
+      palette[7] = 255;
+    }
+
+    // 16 indices of 3 bits
+    uint64_t indices{};
+    for (int i = 0; i < 6; i++) indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+    for (uint32_t i = 0; i < 16; i++)
+    {
+      pixels[i * 4 + 3] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 7]);
+    }
+  }
+}
+
+bool hasTranslucentPixels(const ImageData& image)
+{
+  if (image.mips.empty() || image.format != TextureFormat::RGBA8) return false;
+
+  const std::vector<uint8_t>& pixels = image.mips[0].pixels;
+  for (size_t i = 3; i < pixels.size(); i += 4)
+  {
+    if (pixels[i] != 255) return true;
+  }
+  return false;
+}
+
+void compressImage(const ImageData& source, TextureFormat format, ImageData& destination, unsigned threadCount, bool highQuality)
+{
+  destination = ImageData{};
+  destination.format = format;
+  destination.mips.resize(source.mips.size());
+
+  const bool opaque = format == TextureFormat::DXT1;
+  const size_t blockBytes = opaque ? 8 : 16;
+
+  // allocate every level up front and list its block rows, so threads can write to them without locking
+  std::vector<BlockRow> rows{};
+  for (uint32_t level = 0; level < source.mips.size(); level++)
+  {
+    const MipLevel& mip = source.mips[level];
+    destination.mips[level].width = mip.width;
+    destination.mips[level].height = mip.height;
+    destination.mips[level].pixels.resize(getLevelSize(format, mip.width, mip.height));
+
+    for (uint32_t row = 0; row < (mip.height + 3) / 4; row++) rows.push_back({ level, row });
+  }
+
+  std::atomic<size_t> nextRow{ 0 };
+  const auto work = [&]()
+  {
+    uint8_t block[64]{};
+    for (size_t i = nextRow++; i < rows.size(); i = nextRow++)
+    {
+      const MipLevel& mip = source.mips[rows[i].level];
+      MipLevel& target = destination.mips[rows[i].level];
+      const uint32_t blocksPerRow = (mip.width + 3) / 4;
+
+      uint8_t* output = target.pixels.data() + static_cast<size_t>(rows[i].row) * blocksPerRow * blockBytes;
+      for (uint32_t blockX = 0; blockX < blocksPerRow; blockX++)
+      {
+        fetchBlock(mip, blockX, rows[i].row, opaque, block);
+        stb_compress_dxt_block(output, block, opaque ? 0 : 1, highQuality ? STB_DXT_HIGHQUAL : STB_DXT_NORMAL);
+        output += blockBytes;
+      }
+    }
+  };
+
+  // the calling thread works too
+  std::vector<std::thread> threads{};
+  const unsigned extraThreads = static_cast<unsigned>(std::min<size_t>(std::max(threadCount, 1u) - 1, rows.size()));
+  for (unsigned i = 0; i < extraThreads; i++) threads.emplace_back(work);
+  work();
+  for (std::thread& thread : threads) thread.join();
+}
+
+void decompressImage(const ImageData& source, ImageData& destination)
+{
+  destination = ImageData{};
+  destination.format = TextureFormat::RGBA8;
+  destination.mips.resize(source.mips.size());
+
+  const bool hasAlphaBlock = source.format == TextureFormat::DXT5;
+  const size_t blockBytes = hasAlphaBlock ? 16 : 8;
+
+  for (size_t level = 0; level < source.mips.size(); level++)
+  {
+    const MipLevel& mip = source.mips[level];
+    MipLevel& target = destination.mips[level];
+    target.width = mip.width;
+    target.height = mip.height;
+    target.pixels.resize(getLevelSize(TextureFormat::RGBA8, mip.width, mip.height));
+
+    const uint32_t blocksPerRow = (mip.width + 3) / 4;
+    const uint8_t* input = mip.pixels.data();
+    uint8_t pixels[64]{};
+    for (uint32_t blockY = 0; blockY < (mip.height + 3) / 4; blockY++)
+    {
+      for (uint32_t blockX = 0; blockX < blocksPerRow; blockX++, input += blockBytes)
+      {
+        if (hasAlphaBlock)
+        {
+          decodeColorBlock(input + 8, false, pixels);
+          decodeAlphaBlock(input, pixels);
+        }
+        else
+        {
+          decodeColorBlock(input, true, pixels);
+        }
+
+        // write back only the pixels inside the level
+        for (uint32_t y = 0; y < 4 && blockY * 4 + y < mip.height; y++)
+        {
+          for (uint32_t x = 0; x < 4 && blockX * 4 + x < mip.width; x++)
+          {
+            const size_t offset = (static_cast<size_t>(blockY * 4 + y) * mip.width + blockX * 4 + x) * 4;
+            std::copy(&pixels[(y * 4 + x) * 4], &pixels[(y * 4 + x) * 4] + 4, &target.pixels[offset]);
+          }
+        }
+      }
+    }
+  }
+}
+
+double computePSNR(const MipLevel& reference, const MipLevel& test, bool includeAlpha)
+{
+  if (reference.pixels.size() != test.pixels.size() || reference.pixels.empty()) return 0.0;
+
+  const size_t channels = includeAlpha ? 4 : 3;
+  double squaredError{};
+  for (size_t i = 0; i < reference.pixels.size(); i += 4)
+  {
+    for (size_t c = 0; c < channels; c++)
+    {
+      const double difference = static_cast<double>(reference.pixels[i + c]) - test.pixels[i + c];
+      squaredError += difference * difference;
+    }
+  }
+
+  const double meanSquaredError = squaredError / (reference.pixels.size() / 4 * channels);
+  if (meanSquaredError == 0.0) return std::numeric_limits<double>::infinity();
+  return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
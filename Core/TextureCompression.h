@@ -0,0 +1,24 @@
+#pragma once
+
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include "ImageData.h"
+
+// DXT1/DXT5 (S3TC) block compression for cooked textures. No OpenGL in here either
+// The cooker compresses, the runtime only decompresses when the driver has no S3TC support
+
+// true if any pixel of level 0 isn't fully opaque. Such images need DXT5, the rest can use DXT1
+bool hasTranslucentPixels(const ImageData& image);
+
+// compress every level of an RGBA8 image to DXT1 or DXT5
+// levels are split into rows of 4x4 blocks and the rows of all levels are shared between threadCount threads
+void compressImage(const ImageData& source, TextureFormat format, ImageData& destination, unsigned threadCount = 1, bool highQuality = false);
+
+// decode a DXT1/DXT5 image back to RGBA8
+void decompressImage(const ImageData& source, ImageData& destination);
+
+// peak signal-to-noise ratio in dB between two RGBA8 levels of the same size. Alpha is ignored unless includeAlpha is set
+double computePSNR(const MipLevel& reference, const MipLevel& test, bool includeAlpha);
+
+#endif // !TEXTURE_COMPRESSION_H
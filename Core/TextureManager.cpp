@@ -0,0 +1,487 @@
+#include <iostream>
+#include <utility>
+#include <chrono>
+#include <algorithm>
+#include "TextureManager.h"
+
+namespace
+{
+  // first level that isn't larger than size on either side, or the last level
+  uint32_t findLevel(const ImageView& view, uint32_t size)
+  {
+    uint32_t level = 0;
+    while (level + 1 < view.mips.size() && std::max(view.mips[level].width, view.mips[level].height) > size) level++;
+    return level;
+  }
+}
+
+TextureHandle::TextureHandle(TextureManager* manager, uint32_t slot)
+  : mManager(manager), mSlot(slot)
+{
+  mManager->addRef(mSlot);
+}
+
+TextureHandle::TextureHandle(const TextureHandle& other)
+  : mManager(other.mManager), mSlot(other.mSlot)
+{
+  if (mManager != nullptr) mManager->addRef(mSlot);
+}
+
+TextureHandle::TextureHandle(TextureHandle&& other) noexcept
+  : mManager(other.mManager), mSlot(other.mSlot)
+{
+  other.mManager = nullptr;
+}
+
+TextureHandle& TextureHandle::operator=(TextureHandle other) noexcept
+{
+  // copy and swap. The old reference is released when other goes out of scope
+  std::swap(mManager, other.mManager);
+  std::swap(mSlot, other.mSlot);
+  return *this;
+}
+
+TextureHandle::~TextureHandle()
+{
+  if (mManager != nullptr) mManager->release(mSlot);
+}
+
+void TextureHandle::bind(GLint texUnit) const
+{
+  if (mManager != nullptr) mManager->bind(mSlot, texUnit);
+}
+
+void TextureHandle::unbind(GLint texUnit) const
+{
+  if (mManager != nullptr) mManager->unbind(mSlot, texUnit);
+}
+
+void TextureHandle::requestPixelsPerUV(float pixelsPerUV) const
+{
+  if (mManager != nullptr) mManager->requestPixelsPerUV(mSlot, pixelsPerUV);
+}
+
+TextureManager::TextureManager(uint64_t budgetBytes)
+  : mBudget(budgetBytes)
+{}
+
+TextureManager::~TextureManager()
+{
+  // Texture2D deletes its GL object. Nothing else to do
+}
+
+TextureHandle TextureManager::acquire(const std::string& path, bool generateMipMaps)
+{
+  mStats.requests++;
+
+  const bool isNew = mSlotsByPath.find(path) == mSlotsByPath.end();
+  const uint32_t slot = findOrAddEntry(path, generateMipMaps);
+
+  if (mEntries[slot].texture->isLoaded())
+  {
+    mStats.hits++;
+  }
+  else if (!makeResident(slot))
+  {
+    // loadTexture() already reported the error
+    if (isNew) removeEntry(slot);
+    return TextureHandle{};
+  }
+  return TextureHandle(this, slot);
+}
+
+std::vector<TextureHandle> TextureManager::acquire(const std::vector<std::string>& paths, unsigned decodeThreads, bool generateMipMaps)
+{
+  std::vector<TextureHandle> handles(paths.size());
+
+  // path -> indices into paths that wait for it. A path listed twice is decoded once
+  std::unordered_map<std::string, std::vector<size_t>> waiting{};
+  std::vector<uint32_t> newSlots{};
+  uint32_t streamed{};
+
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    mStats.requests++;
+
+    std::unordered_map<std::string, uint32_t>::iterator it = mSlotsByPath.find(paths[i]);
+    if (it != mSlotsByPath.end() && mEntries[it->second].texture->isLoaded())
+    {
+      mStats.hits++;
+      handles[i] = TextureHandle(this, it->second);
+      continue;
+    }
+
+    if (it == mSlotsByPath.end()) newSlots.push_back(findOrAddEntry(paths[i], generateMipMaps));
+
+    // streamed textures only upload their small levels, which is quicker than handing them to a worker
+    const uint32_t slot = mSlotsByPath[paths[i]];
+    if (waiting.find(paths[i]) == waiting.end() && uploadStreamed(slot))
+    {
+      onLoaded(slot);
+      handles[i] = TextureHandle(this, slot);
+      streamed++;
+      continue;
+    }
+
+    waiting[paths[i]].push_back(i);
+  }
+
+  if (streamed > 0) std::cout << "Streaming " << streamed << " textures, starting at " << mStreaming.initialSize << " texels" << std::endl;
+  if (waiting.empty()) return handles;
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  ImageDecodePool pool(std::min(decodeThreads == 0 ? std::thread::hardware_concurrency() : decodeThreads, static_cast<unsigned>(waiting.size())), true, mMemoryMapping);
+  for (const std::pair<const std::string, std::vector<size_t>>& request : waiting)
+  {
+    pool.submit(request.first);
+  }
+
+  // upload whatever is ready while the workers keep decoding the rest
+  DecodedImage decoded{};
+  while (pool.waitNext(decoded))
+  {
+    const uint32_t slot = mSlotsByPath[decoded.path];
+    Entry& entry = mEntries[slot];
+
+    if (!decoded.loaded || !entry.texture->upload(decoded.view, entry.generateMipMaps))
+    {
+      std::cerr << "Error loading texture '" << decoded.path << "'" << std::endl;
+      continue;
+    }
+
+    onLoaded(slot);
+    for (size_t i : waiting[decoded.path])
+    {
+      handles[i] = TextureHandle(this, slot);
+    }
+  }
+
+  // entries we created for textures that failed to load
+  for (uint32_t slot : newSlots)
+  {
+    if (mEntries[slot].refCount == 0 && !mEntries[slot].texture->isLoaded()) removeEntry(slot);
+  }
+
+  const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Loaded " << waiting.size() << " textures in " << milliseconds << " ms on " << pool.getThreadCount() << " decode threads" << std::endl;
+  return handles;
+}
+
+void TextureManager::beginFrame()
+{
+  mFrame++;
+}
+
+void TextureManager::updateStreaming()
+{
+  mStats.bytesStreamedLastFrame = 0;
+
+  std::vector<uint32_t> pending{};
+  for (uint32_t slot = 0; slot < mEntries.size(); slot++)
+  {
+    Entry& entry = mEntries[slot];
+    if (entry.texture == nullptr || !isStreamed(entry)) continue;
+
+    // nobody drew the texture this frame. It goes back to the levels it started with
+    if (entry.requestFrame != mFrame) entry.wantedLevel = findLevel(entry.view, mStreaming.initialSize);
+
+    const uint32_t base = entry.texture->getBaseLevel();
+    if (entry.wantedLevel <= base) entry.lastNeededFrame = mFrame;
+    if (entry.wantedLevel < base) pending.push_back(slot);
+  }
+
+  dropUnneededLevels(false, 0);
+
+  // the blurriest textures first: the most levels between what is resident and what is needed
+  std::sort(pending.begin(), pending.end(), [&](uint32_t a, uint32_t b)
+  {
+    return mEntries[a].texture->getBaseLevel() - mEntries[a].wantedLevel > mEntries[b].texture->getBaseLevel() - mEntries[b].wantedLevel;
+  });
+
+  // one level per texture per round, so a single large texture can't use up the whole frame
+  bool progress = true;
+  while (progress)
+  {
+    progress = false;
+    for (uint32_t slot : pending)
+    {
+      Entry& entry = mEntries[slot];
+      const uint32_t base = entry.texture->getBaseLevel();
+      if (base <= entry.wantedLevel) continue;
+
+      // the first level of a frame always goes, even if it's larger than the per frame budget
+      const uint64_t levelSize = entry.view.mips[base - 1].size;
+      if (mStats.bytesStreamedLastFrame > 0 && mStats.bytesStreamedLastFrame + levelSize > mStreaming.uploadBytesPerFrame) return;
+
+      // make room with levels other textures don't need. Whole textures aren't evicted for a sharper mip
+      if (mStats.bytesResident + levelSize > mBudget)
+      {
+        dropUnneededLevels(true, mBudget > levelSize ? mBudget - levelSize : 0);
+        if (mStats.bytesResident + levelSize > mBudget) return;
+      }
+
+      const size_t before = entry.texture->getMemorySize();
+      if (!entry.texture->streamInLevel(entry.view)) continue;
+
+      mStats.bytesResident += entry.texture->getMemorySize() - before;
+      mStats.bytesStreamedIn += levelSize;
+      mStats.bytesStreamedLastFrame += levelSize;
+      mStats.levelsStreamedIn++;
+      progress = true;
+    }
+  }
+}
+
+void TextureManager::setBudget(uint64_t budgetBytes)
+{
+  mBudget = budgetBytes;
+  enforceBudget();
+}
+
+void TextureManager::purgeUnused()
+{
+  for (uint32_t slot = 0; slot < mEntries.size(); slot++)
+  {
+    const Entry& entry = mEntries[slot];
+    if (entry.texture == nullptr || entry.refCount > 0) continue;
+
+    removeEntry(slot);
+  }
+}
+
+void TextureManager::addRef(uint32_t slot)
+{
+  mEntries[slot].refCount++;
+}
+
+void TextureManager::release(uint32_t slot)
+{
+  // unreferenced textures stay resident (and count as hits when acquired again)
+  // until they are evicted or purgeUnused() is called
+  mEntries[slot].refCount--;
+}
+
+void TextureManager::bind(uint32_t slot, GLint texUnit)
+{
+  Entry& entry = mEntries[slot];
+  if (!entry.texture->isLoaded() && !makeResident(slot)) return;
+
+  entry.lastBindFrame = mFrame;
+  if (mHead != slot)
+  {
+    unlink(slot);
+    linkFront(slot);
+  }
+
+  entry.texture->bind(texUnit);
+}
+
+void TextureManager::unbind(uint32_t slot, GLint texUnit)
+{
+  mEntries[slot].texture->unbind(texUnit);
+}
+
+void TextureManager::requestPixelsPerUV(uint32_t slot, float pixelsPerUV)
+{
+  Entry& entry = mEntries[slot];
+  if (!isStreamed(entry) || pixelsPerUV <= 0.0f) return;
+
+  // level k has 2^k times fewer texels per UV than level 0. Pick the finest one that doesn't
+  // put two or more of its texels on a screen pixel
+  const MipLevelView& top = entry.view.mips[0];
+  float texelsPerPixel = static_cast<float>(std::max(top.width, top.height)) / pixelsPerUV;
+  uint32_t level = 0;
+  while (texelsPerPixel >= 2.0f && level + 1 < entry.view.mips.size())
+  {
+    texelsPerPixel *= 0.5f;
+    level++;
+  }
+
+  if (entry.requestFrame != mFrame)
+  {
+    entry.requestFrame = mFrame;
+    entry.wantedLevel = level;
+  }
+  else
+  {
+    entry.wantedLevel = std::min(entry.wantedLevel, level);
+  }
+}
+
+uint32_t TextureManager::findOrAddEntry(const std::string& path, bool generateMipMaps)
+{
+  std::unordered_map<std::string, uint32_t>::iterator it = mSlotsByPath.find(path);
+  if (it != mSlotsByPath.end()) return it->second;
+
+  uint32_t slot{};
+  if (!mFreeSlots.empty())
+  {
+    slot = mFreeSlots.back();
+    mFreeSlots.pop_back();
+  }
+  else
+  {
+    slot = static_cast<uint32_t>(mEntries.size());
+    mEntries.emplace_back();
+  }
+
+  Entry& entry = mEntries[slot];
+  entry.path = path;
+  entry.texture = std::make_unique<Texture2D>();
+  entry.generateMipMaps = generateMipMaps;
+
+  mSlotsByPath[path] = slot;
+  return slot;
+}
+
+void TextureManager::removeEntry(uint32_t slot)
+{
+  Entry& entry = mEntries[slot];
+  if (entry.texture->isLoaded())
+  {
+    unlink(slot);
+    mStats.bytesResident -= entry.texture->getMemorySize();
+    mStats.texturesResident--;
+    if (isStreamed(entry)) mStats.texturesStreamed--;
+  }
+
+  mSlotsByPath.erase(entry.path);
+  entry = Entry{};
+  mFreeSlots.push_back(slot);
+}
+
+bool TextureManager::makeResident(uint32_t slot)
+{
+  Entry& entry = mEntries[slot];
+  if (!uploadStreamed(slot) && !entry.texture->loadTexture(entry.path, entry.generateMipMaps, mMemoryMapping)) return false;
+
+  onLoaded(slot);
+  return true;
+}
+
+bool TextureManager::uploadStreamed(uint32_t slot)
+{
+  Entry& entry = mEntries[slot];
+  if (!mStreaming.enabled || !mapImageFile(entry.path, entry.mapping, entry.view, false)) return false;
+
+  // only the levels we upload get paged in. That's the point of streaming
+  const uint32_t firstLevel = findLevel(entry.view, mStreaming.initialSize);
+  if (entry.view.mips.size() < 2 || !entry.texture->uploadStreamed(entry.view, firstLevel))
+  {
+    entry.mapping.close();
+    entry.view = ImageView{};
+    return false;
+  }
+
+  // uploaded in full (no S3TC support). Nothing left to stream
+  if (entry.texture->getBaseLevel() == 0)
+  {
+    entry.mapping.close();
+    entry.view = ImageView{};
+  }
+
+  entry.wantedLevel = firstLevel;
+  entry.lastNeededFrame = mFrame;
+  return true;
+}
+
+void TextureManager::dropUnneededLevels(bool ignoreDelay, uint64_t targetBytes)
+{
+  // least recently bound first
+  for (uint32_t slot = mTail; slot != NONE && mStats.bytesResident > targetBytes; slot = mEntries[slot].prev)
+  {
+    Entry& entry = mEntries[slot];
+    if (!isStreamed(entry)) continue;
+    if (!ignoreDelay && mFrame - entry.lastNeededFrame <= mStreaming.dropDelayFrames) continue;
+
+    while (entry.texture->getBaseLevel() < entry.wantedLevel && mStats.bytesResident > targetBytes)
+    {
+      const size_t before = entry.texture->getMemorySize();
+      if (!entry.texture->dropBaseLevel()) break;
+
+      mStats.bytesResident -= before - entry.texture->getMemorySize();
+      mStats.levelsDropped++;
+    }
+  }
+}
+
+void TextureManager::onLoaded(uint32_t slot)
+{
+  Entry& entry = mEntries[slot];
+  mStats.loads++;
+  mStats.bytesResident += entry.texture->getMemorySize();
+  mStats.texturesResident++;
+  if (isStreamed(entry)) mStats.texturesStreamed++;
+
+  // a texture that was just loaded is about to be used. Don't let the budget throw it out right away
+  entry.lastBindFrame = mFrame;
+  linkFront(slot);
+
+  enforceBudget();
+}
+
+void TextureManager::evict(uint32_t slot)
+{
+  Entry& entry = mEntries[slot];
+  unlink(slot);
+
+  mStats.bytesResident -= entry.texture->getMemorySize();
+  mStats.texturesResident--;
+  mStats.evictions++;
+  if (isStreamed(entry))
+  {
+    mStats.texturesStreamed--;
+    entry.mapping.close();
+    entry.view = ImageView{};
+  }
+
+  entry.texture->release();
+}
+
+void TextureManager::enforceBudget()
+{
+  // fine levels nobody looks at go before whole textures
+  if (mStats.bytesResident > mBudget) dropUnneededLevels(true, mBudget);
+
+  while (mStats.bytesResident > mBudget && mTail != NONE)
+  {
+    // the tail is the least recently bound texture. If it's in use this frame, so is everything else
+    if (mEntries[mTail].lastBindFrame >= mFrame)
+    {
+      if (mOverBudgetFrame != mFrame)
+      {
+        std::cerr << "Textures used this frame need " << mStats.bytesResident << " bytes. The budget is " << mBudget << " bytes" << std::endl;
+        mOverBudgetFrame = mFrame;
+      }
+      return;
+    }
+
+    evict(mTail);
+  }
+}
+
+void TextureManager::linkFront(uint32_t slot)
+{
+  Entry& entry = mEntries[slot];
+  entry.prev = NONE;
+  entry.next = mHead;
+
+  if (mHead != NONE) mEntries[mHead].prev = slot;
+  mHead = slot;
+  if (mTail == NONE) mTail = slot;
+}
+
+void TextureManager::unlink(uint32_t slot)
+{
+  Entry& entry = mEntries[slot];
+
+  if (entry.prev != NONE) mEntries[entry.prev].next = entry.next;
+  else if (mHead == slot) mHead = entry.next;
+
+  if (entry.next != NONE) mEntries[entry.next].prev = entry.prev;
+  else if (mTail == slot) mTail = entry.prev;
+
+  entry.prev = NONE;
+  entry.next = NONE;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "GL/glew.h"
+#include "Texture2D.h"
+#include "ImageDecodePool.h"
+#include "MappedFile.h"
+
+class TextureManager;
+
+// Ref-counted reference to a texture of a TextureManager. Copying a handle adds a reference
+// A handle stays valid when its texture is evicted. The next bind() loads it again
+// Handles must not outlive the manager they came from
+class TextureHandle
+{
+public:
+
+  TextureHandle() = default;
+  TextureHandle(const TextureHandle& other);
+  TextureHandle(TextureHandle&& other) noexcept;
+  TextureHandle& operator=(TextureHandle other) noexcept;
+  ~TextureHandle();
+
+  // works as Texture2D::bind(). Marks the texture as used this frame
+  void bind(GLint texUnit = 0) const;
+  void unbind(GLint texUnit = 0) const;
+
+  // streaming feedback: how many screen pixels one UV unit (one repeat of the texture) covers
+  // where something using the texture is drawn this frame. The largest request of a frame decides the mip
+  void requestPixelsPerUV(float pixelsPerUV) const;
+
+  bool isValid() const { return mManager != nullptr; };
+  explicit operator bool() const { return isValid(); };
+
+private:
+
+  friend class TextureManager;
+  TextureHandle(TextureManager* manager, uint32_t slot);
+
+  TextureManager* mManager{};
+  uint32_t mSlot{};
+};
+
+struct TextureStats
+{
+  uint64_t requests{};    // acquire() calls
+  uint64_t hits{};        // requests answered by a resident texture
+  uint64_t loads{};       // textures loaded from disk, reloads after eviction included
+  uint64_t evictions{};   // textures dropped from VRAM to stay in budget
+  uint64_t bytesResident{};
+  uint32_t texturesResident{};
+
+  // mip streaming
+  uint32_t texturesStreamed{}; // resident textures that stream their fine levels
+  uint64_t levelsStreamedIn{};
+  uint64_t levelsDropped{};
+  uint64_t bytesStreamedIn{};
+  uint64_t bytesStreamedLastFrame{};
+
+  double getHitRate() const { return requests == 0 ? 0.0 : static_cast<double>(hits) / requests; };
+};
+
+struct StreamingSettings
+{
+  bool enabled{};
+
+  // cooked textures start with the levels up to this size only. The finer ones are streamed in on demand
+  uint32_t initialSize{ 64 };
+
+  // bytes of fine levels uploaded per updateStreaming() call. Keeps streaming from causing frame spikes
+  uint64_t uploadBytesPerFrame{ 4ull * 1024 * 1024 };
+
+  // frames a level has to be unneeded before it's dropped. Under budget pressure it's dropped right away
+  uint32_t dropDelayFrames{ 120 };
+};
+
+// Loads every texture path once and shares it between all users
+// Keeps the VRAM of loaded textures (mips included) under a budget by evicting the textures that
+// were bound least recently. Textures bound in the current frame are never evicted, so a budget
+// smaller than one frame's textures only logs a warning
+//
+// With streaming on, cooked textures with a mip chain are uploaded from the coarse end and their .flytex stays
+// mapped. Every frame the draw loop tells the handles how large their textures are on screen. updateStreaming()
+// then uploads the finer levels that are needed and drops the ones that aren't (GL_TEXTURE_BASE_LEVEL), before the
+// budget has to evict whole textures
+class TextureManager
+{
+public:
+
+  static constexpr uint64_t DEFAULT_BUDGET = 256ull * 1024 * 1024;
+
+  explicit TextureManager(uint64_t budgetBytes = DEFAULT_BUDGET);
+  ~TextureManager();
+
+  TextureManager(const TextureManager&) = delete;
+  TextureManager& operator=(const TextureManager&) = delete;
+
+  // return the texture for a path, loading it if it isn't resident. Returns an invalid handle if loading fails
+  TextureHandle acquire(const std::string& path, bool generateMipMaps = true);
+
+  // acquire many textures at once. The ones that aren't resident are decoded in parallel on an ImageDecodePool
+  // (decodeThreads 0 = one per core) and uploaded on this thread in the order the decodes finish
+  // the returned handles are in the order of paths
+  std::vector<TextureHandle> acquire(const std::vector<std::string>& paths, unsigned decodeThreads = 0, bool generateMipMaps = true);
+
+  // call once per frame before drawing. Eviction uses frames to know what is in use right now
+  void beginFrame();
+
+  // evicts right away if the new budget is smaller than what is resident
+  void setBudget(uint64_t budgetBytes);
+  uint64_t getBudget() const { return mBudget; };
+
+  // upload cooked textures straight from a memory mapping of the .flytex instead of reading them into memory first
+  void setMemoryMapping(bool enabled) { mMemoryMapping = enabled; };
+  bool getMemoryMapping() const { return mMemoryMapping; };
+
+  // applies to textures loaded from now on
+  void setStreaming(const StreamingSettings& settings) { mStreaming = settings; };
+  const StreamingSettings& getStreaming() const { return mStreaming; };
+
+  // call once per frame after drawing. Streams levels in and out with this frame's requests
+  void updateStreaming();
+
+  // forget every texture nobody holds a handle to
+  void purgeUnused();
+
+  const TextureStats& getStats() const { return mStats; };
+
+private:
+
+  friend class TextureHandle;
+
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  struct Entry
+  {
+    std::string path{};
+    std::unique_ptr<Texture2D> texture{};
+    uint32_t refCount{};
+    bool generateMipMaps{};
+    uint64_t lastBindFrame{};
+
+    // streaming. mapping is open for streamed textures only. view points into it
+    MappedFile mapping{};
+    ImageView view{};
+    uint32_t wantedLevel{};     // finest level this frame's requests need
+    uint64_t requestFrame{};    // frame of the last request
+    uint64_t lastNeededFrame{}; // last frame the finest resident level was needed
+
+    // least recently bound list of resident textures. Head is the most recent one
+    uint32_t prev{ NONE };
+    uint32_t next{ NONE };
+  };
+
+  void addRef(uint32_t slot);
+  void release(uint32_t slot);
+  void bind(uint32_t slot, GLint texUnit);
+  void unbind(uint32_t slot, GLint texUnit);
+  void requestPixelsPerUV(uint32_t slot, float pixelsPerUV);
+
+  // find or create the entry of a path
+  uint32_t findOrAddEntry(const std::string& path, bool generateMipMaps);
+  void removeEntry(uint32_t slot);
+
+  // load the texture of an entry and put it at the head of the list
+  bool makeResident(uint32_t slot);
+
+  // map the cooked .flytex and upload its coarse levels. False if the texture can't stream
+  bool uploadStreamed(uint32_t slot);
+
+  bool isStreamed(const Entry& entry) const { return entry.mapping.isOpen(); };
+
+  // drop fine levels that aren't needed (for dropDelayFrames, unless ignoreDelay) from the least
+  // recently bound textures until at most targetBytes are resident
+  void dropUnneededLevels(bool ignoreDelay, uint64_t targetBytes);
+
+  // bookkeeping after an entry's texture was uploaded
+  void onLoaded(uint32_t slot);
+  void evict(uint32_t slot);
+
+  // evict from the tail of the list until we fit into the budget
+  void enforceBudget();
+
+  void linkFront(uint32_t slot);
+  void unlink(uint32_t slot);
+
+  std::vector<Entry> mEntries{};
+  std::vector<uint32_t> mFreeSlots{};
+  std::unordered_map<std::string, uint32_t> mSlotsByPath{};
+
+  uint32_t mHead{ NONE };
+  uint32_t mTail{ NONE };
+
+  uint64_t mBudget{};
+  bool mMemoryMapping{};
+  StreamingSettings mStreaming{};
+  uint64_t mFrame{ 1 };
+  uint64_t mOverBudgetFrame{}; // last frame we warned about, so the log isn't flooded
+  TextureStats mStats{};
+};
+
+#endif // !TEXTURE_MANAGER_H
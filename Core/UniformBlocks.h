@@ -0,0 +1,148 @@
+#pragma once
+
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <stddef.h>
+#include <iterator>
+#include <string>
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+// the std140 uniform blocks of our shaders. The structs are the source: each has a member table the GLSL block
+// is generated from (getUniformBlockDefines()), and the table is checked against std140 at compile time.
+// std140 rules that matter here: mat4 and vec4 are 16 byte aligned, vec3 takes 16 bytes (so we use vec4),
+// a float after a vec4 packs at the next 4 bytes, and a block's size rounds up to 16
+// ShaderProgram::bindUniformBlock() compares the size the linker reports with sizeof at runtime
+
+// a block member: its GLSL type and name, and where the struct has it
+struct UniformBlockMember
+{
+  const char* glslType{};
+  const char* name{};
+  size_t offset{};
+  size_t size{};
+};
+
+#define UNIFORM_BLOCK_MEMBER(Struct, glslType, member) UniformBlockMember{ #glslType, #member, offsetof(Struct, member), sizeof(Struct::member) }
+
+// std140 size and alignment of the GLSL types the blocks use. 0 for the others, which fails the check below
+constexpr bool isGlslType(const char* type, const char* name)
+{
+  while (*type != '\0' && *type == *name) { type++; name++; }
+  return *type == *name;
+}
+
+constexpr size_t getStd140Size(const char* type)
+{
+  return isGlslType(type, "mat4") ? 64 : isGlslType(type, "vec4") ? 16 : isGlslType(type, "float") ? 4 : 0;
+}
+
+constexpr size_t getStd140Alignment(const char* type)
+{
+  return isGlslType(type, "float") ? 4 : 16;
+}
+
+// true if GLSL lays the members out where the struct has them, and the block is as big as the struct
+template <size_t N>
+constexpr bool matchesStd140(const UniformBlockMember (&members)[N], size_t structSize)
+{
+  size_t offset = 0;
+  for (size_t i = 0; i < N; i++)
+  {
+    const size_t alignment = getStd140Alignment(members[i].glslType);
+    offset = (offset + alignment - 1) / alignment * alignment;
+    if (members[i].offset != offset || members[i].size != getStd140Size(members[i].glslType)) return false;
+    offset += members[i].size;
+  }
+  return (offset + 15) / 16 * 16 == structSize;
+}
+
+// binding points. GLSL 330 has no layout(binding), so programs are told with glUniformBlockBinding()
+constexpr GLuint FRAME_BLOCK_BINDING = 0;
+constexpr GLuint OBJECT_BLOCK_BINDING = 1;
+
+// written once per frame, shared by every program that declares it (FRAME_BLOCK)
+struct FrameUniforms
+{
+  glm::mat4 view{};
+  glm::mat4 projection{};
+  glm::vec4 camPos{}; // w unused
+};
+
+constexpr UniformBlockMember FRAME_BLOCK_MEMBERS[] =
+{
+  UNIFORM_BLOCK_MEMBER(FrameUniforms, mat4, view),
+  UNIFORM_BLOCK_MEMBER(FrameUniforms, mat4, projection),
+  UNIFORM_BLOCK_MEMBER(FrameUniforms, vec4, camPos),
+};
+
+static_assert(matchesStd140(FRAME_BLOCK_MEMBERS, sizeof(FrameUniforms)), "FrameUniforms doesn't match the std140 layout of its members");
+
+// written once per draw into a ring of uniform buffer memory and bound with an offset (OBJECT_BLOCK)
+struct ObjectUniforms
+{
+  glm::mat4 model{};
+  glm::vec4 uvTransform{ 1.0f, 1.0f, 0.0f, 0.0f };
+  float textureLayer{ -1.0f };
+  float padding[3]{}; // the block is rounded up to a multiple of 16
+};
+
+constexpr UniformBlockMember OBJECT_BLOCK_MEMBERS[] =
+{
+  UNIFORM_BLOCK_MEMBER(ObjectUniforms, mat4, model),
+  UNIFORM_BLOCK_MEMBER(ObjectUniforms, vec4, uvTransform),    // where our texture is in the bound texture: xy scale, zw offset
+  UNIFORM_BLOCK_MEMBER(ObjectUniforms, float, textureLayer),  // our layer in texArraySampler
+};
+
+static_assert(matchesStd140(OBJECT_BLOCK_MEMBERS, sizeof(ObjectUniforms)), "ObjectUniforms doesn't match the std140 layout of its members");
+
+// multi-draw batches can't rebind ObjectBlock between their draws. They store one ObjectUniforms record per draw
+// in a buffer texture (GL_RGBA32F) the vertex shader reads with texelFetch() instead
+constexpr GLint DRAW_DATA_UNIT = 3;
+constexpr GLint DRAW_DATA_TEXELS = sizeof(ObjectUniforms) / sizeof(glm::vec4);
+
+// what ShaderProgram puts in front of every shader, after #version:
+//   FRAME_BLOCK, OBJECT_BLOCK         the block declarations, generated from the member tables
+//   DRAW_DATA_TEXELS                  texels per draw data record
+//   DRAW_DATA_<MEMBER>                texel of each ObjectBlock member in a record, e.g. DRAW_DATA_UV_TRANSFORM
+inline std::string getUniformBlockDefines()
+{
+  const auto declareBlock = [](const char* define, const char* block, const UniformBlockMember* members, size_t count)
+  {
+    std::string text = std::string("#define ") + define + " layout (std140) uniform " + block + " {";
+    for (size_t i = 0; i < count; i++) text += std::string(" ") + members[i].glslType + " " + members[i].name + ";";
+    return text + " };\n";
+  };
+
+  std::string defines = declareBlock("FRAME_BLOCK", "FrameBlock", FRAME_BLOCK_MEMBERS, std::size(FRAME_BLOCK_MEMBERS));
+  defines += declareBlock("OBJECT_BLOCK", "ObjectBlock", OBJECT_BLOCK_MEMBERS, std::size(OBJECT_BLOCK_MEMBERS));
+  defines += "#define DRAW_DATA_TEXELS " + std::to_string(DRAW_DATA_TEXELS) + "\n";
+  for (const UniformBlockMember& member : OBJECT_BLOCK_MEMBERS)
+  {
+    // uvTransform -> UV_TRANSFORM
+    std::string name{};
+    for (const char* c = member.name; *c != '\0'; c++)
+    {
+      if (*c >= 'A' && *c <= 'Z') name += '_';
+      name += static_cast<char>(*c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c);
+    }
+    defines += "#define DRAW_DATA_" + name + " " + std::to_string(member.offset / sizeof(glm::vec4)) + "\n";
+  }
+  return defines;
+}
+
+// glBindBufferRange() offsets must be multiples of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT (256 on many GPUs)
+// returns size rounded up to it, so blocks can be packed back to back in one allocation
+inline GLsizeiptr getUniformBlockStride(GLsizeiptr size)
+{
+  static GLint alignment = 0;
+  if (alignment == 0)
+  {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment < 1) alignment = 256;
+  }
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+#endif // !UNIFORM_BLOCKS_H
@@ -2,14 +2,29 @@
 
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
 #define GLEW_STATIC
 #include "GL/glew.h" // to work with openGL and have access to all available method on a specific video card
 #include "GLFW/glfw3.h" // a lib to create, open, manage input and create contexts
 #include "glm/gtc/matrix_transform.hpp"
-#include "Shaders/ShaderProgram.h"
+#include "Shaders/ShaderVariants.h"
+#include "Shaders/ProgramBinaryCache.h"
 #include "Core/Texture2D.h"
 #include "Core/Camera.h"
 #include "Core/Mesh.h"
+#include "Core/Material.h"
+#include "Core/TextureManager.h"
+#include "Core/RenderState.h"
+#include "Core/RenderQueue.h"
+#include "Core/JobSystem.h"
+#include "Core/Profiler.h"
+#include "Core/MeshPool.h"
+#include "Core/StreamBuffer.h"
+#include "Core/UniformBlocks.h"
 
 // ptr to a main window
 // create a window. We moved to global data to have an access to our main window from different scopes and functions 
@@ -26,6 +41,21 @@ bool gWireframeMode = false;
 bool gRotateCubeToRight = false;
 bool gRotateCubeToLeft = false;
 bool gUseFPSCamera = true;
+bool gUseTextureArrays = true; // same size textures outside the atlas share one GL_TEXTURE_2D_ARRAY bind
+
+// how the draw loop submits. F7 cycles through them
+// PER_OBJECT: a draw call per sub-mesh of every object
+// INSTANCED: objects sharing a mesh and material are drawn with one instanced call
+// MULTI_DRAW: all pooled meshes with the same program and texture go out as one glMultiDrawElementsBaseVertex
+enum class DrawPath : uint8_t
+{
+  PER_OBJECT,
+  INSTANCED,
+  MULTI_DRAW,
+  COUNT,
+};
+const char* DRAW_PATH_NAMES[] = { "per object", "instanced", "multi-draw" };
+DrawPath gDrawPath = DrawPath::MULTI_DRAW;
 
 // create an Orbit Camera
 OrbitCamera orbitCamera;
@@ -67,7 +97,8 @@ void glfw_onMouseScroll(GLFWwindow* window, double deltaX, double deltaY);
 void update(double elapsedTime);
 
 // a function to show frame stats
-void showFrameStats(GLFWwindow* window, bool drawStats);
+// extraStats is appended to the title. Systems put their counters there
+void showFrameStats(GLFWwindow* window, bool drawStats, const std::string& extraStats = {});
 
 // a function to init OpenGL
 bool initOpenGL();
@@ -252,8 +283,45 @@ int main() // entry renderer point
   //glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
   ////////////////// CREATE SHADERS ////////////////////
-  ShaderProgram shaderProgram;
-  shaderProgram.loadShaders("./Shaders/advancedBasic.vert", "./Shaders/basic.frag");
+  // one program per feature combination (ShaderFeatures.h). Materials pick theirs in the draw loop
+  ShaderVariants shaders("./Shaders/advancedBasic.vert", "./Shaders/basic.frag");
+
+  // matrices and per object data come from uniform buffers. The blocks are bound to fixed binding points,
+  // so every program declaring them reads the same buffers
+  // what is left are the samplers. They never change, so they are set once per program (and after a hot reload)
+  // drawDataBase changes per multi-draw batch. Its handle is resolved here, so the draw loop doesn't look up names
+  std::unordered_map<const ShaderProgram*, UniformHandle> drawDataBaseHandles{};
+  shaders.setOnBuilt([&drawDataBaseHandles](ShaderProgram& program)
+  {
+    program.bindUniformBlock("FrameBlock", FRAME_BLOCK_BINDING, sizeof(FrameUniforms));
+    program.bindUniformBlock("ObjectBlock", OBJECT_BLOCK_BINDING, sizeof(ObjectUniforms));
+    program.setUniform("texArraySampler", TEXTURE_ARRAY_UNIT);
+    program.setUniform("drawData", DRAW_DATA_UNIT);
+    drawDataBaseHandles[&program] = program.getUniformHandle("drawDataBase");
+  });
+
+  // saving a shader file rebuilds the programs while we keep drawing with the old ones
+  shaders.enableHotReload();
+
+  // the variants the scene needs are built now rather than on the frame that first draws with them
+  shaders.prewarm("./Shaders/basic.variants");
+  std::cout << shaders.getVariantCount() << " shader variants built" << std::endl;
+
+  // programs come from the binary cache after the first run. Savings are the compile time of the hits minus their load time
+  const ProgramBinaryCache::Stats& programCacheStats = ProgramBinaryCache::get().getStats();
+  const uint32_t programLookups = programCacheStats.hits + programCacheStats.misses + programCacheStats.rejected;
+  if (programLookups > 0)
+  {
+    std::cout << "Program binary cache: " << programCacheStats.hits << "/" << programLookups << " hits, "
+      << programCacheStats.rejected << " rejected, " << static_cast<int>(programCacheStats.savedMs) << " ms saved" << std::endl;
+  }
+
+  // ring of uniform buffer memory. Each frame writes the frame block and one object block per draw into its own segment
+  // it's sized once the draw list is known
+  StreamBuffer uniformRing{};
+  const GLsizeiptr uniformAlignment = getUniformBlockStride(1);
+  const GLsizeiptr objectBlockStride = getUniformBlockStride(sizeof(ObjectUniforms));
+  uint32_t uniformCalls{}, uniformsSkipped{}; // of the last frame, for the stats
 
   // LOAD MESHES
   // model positions
@@ -272,22 +340,181 @@ int main() // entry renderer point
     glm::vec3(10.0f, 0.0f, 10.0f) // floor
   };
 
+  // all models share one vertex and index buffer, so multi-draw batches can mix them
+  MeshPool meshPool{};
+
   constexpr uint8_t numOfModels = 4;
   Mesh mesh[numOfModels];
-  // load textures separately
-  Texture2D texture[numOfModels];
+
+  // the scene: every object is one of the models placed in the world. The models themselves first, then a field
+  // of crates behind them. The crates share a mesh and a material, so with instancing they cost one draw
+  struct SceneObject
+  {
+    uint8_t model{};
+    glm::vec3 position{};
+    glm::vec3 scale{};
+  };
+  constexpr int CRATE_FIELD_SIZE = 32; // crates per side
+  std::vector<SceneObject> objects{};
+  for (uint8_t i = 0; i < numOfModels; i++)
+  {
+    objects.push_back({ i, modelPositions[i], modelScales[i] });
+  }
+  for (int z = 0; z < CRATE_FIELD_SIZE; z++)
+  {
+    for (int x = 0; x < CRATE_FIELD_SIZE; x++)
+    {
+      objects.push_back({ 0, glm::vec3((x - CRATE_FIELD_SIZE / 2) * 3.0f, 1.0f, -12.0f - z * 3.0f), glm::vec3(1.0f) });
+    }
+  }
+
+  // every texture is loaded once per path and shared. Textures that weren't bound for a while
+  // are evicted when the VRAM they take goes over the budget
+  TextureManager textures(TextureManager::DEFAULT_BUDGET);
+
+  // cooked textures go from the page cache to the driver without a copy in between
+  textures.setMemoryMapping(true);
+
+  // cooked textures with a mip chain start small and get their finer levels when they're seen up close
+  StreamingSettings streaming{};
+  streaming.enabled = true;
+  textures.setStreaming(streaming);
+
+  // materials (and their textures) come from the .mtl files next to the models
+  // the library is shared, so a texture used by several models is loaded once
+  MaterialLibrary materials(textures, "./Textures/");
 
   // load meshes
-  mesh[0].loadOBJ("./Models/crate.obj");
-  mesh[1].loadOBJ("./Models/woodcrate.obj");
-  mesh[2].loadOBJ("./Models/robot.obj");
-  mesh[3].loadOBJ("./Models/floor.obj");
+  mesh[0].loadOBJ("./Models/crate.obj", &materials, &meshPool);
+  mesh[1].loadOBJ("./Models/woodcrate.obj", &materials, &meshPool);
+  mesh[2].loadOBJ("./Models/robot.obj", &materials, &meshPool);
+  mesh[3].loadOBJ("./Models/floor.obj", &materials, &meshPool);
+
+  // the .mtl files are in. Small textures go into shared atlas pages, larger ones of the same size
+  // into texture arrays. The rest is decoded in parallel and uploaded as they finish
+  materials.buildAtlas();
+  if (gUseTextureArrays) materials.buildTextureArrays();
+  materials.loadTextures();
+  std::cout << "Textures resident after loading: " << textures.getStats().bytesResident / 1024 << " KB" << std::endl;
+
+  // build a draw list of all sub-meshes of all objects sorted by the texture they bind, then by material
+  // drawing in this order binds every texture (or atlas page) once per frame instead of once per object
+  struct DrawItem
+  {
+    uint32_t object{};
+    uint8_t model{};
+    uint32_t subMesh{};
+    MaterialId material{};
+    uint32_t bindKey{};
+    ShaderFeatures features{};
+    bool instanced{}; // more than one object draws this sub-mesh, so it can go through the instanced variant
+  };
+  std::vector<DrawItem> drawList{};
+  std::vector<uint32_t> modelUses(numOfModels);
+  for (const SceneObject& object : objects) modelUses[object.model]++;
+  for (uint32_t o = 0; o < objects.size(); o++)
+  {
+    const uint8_t i = objects[o].model;
+    for (uint32_t s = 0; s < mesh[i].getSubMeshCount(); s++)
+    {
+      const MaterialId material = mesh[i].getSubMesh(s).material;
+      ShaderFeatures features{};
+      if (material != INVALID_MATERIAL && materials.getMaterial(material).atlasPage != NO_ATLAS_PAGE) features |= SHADER_FEATURE_ATLAS;
+      if (material != INVALID_MATERIAL && materials.getMaterial(material).textureArray != NO_TEXTURE_ARRAY) features |= SHADER_FEATURE_TEXTURE_ARRAY;
+      drawList.push_back({ o, i, s, material, materials.getBindKey(material), features, modelUses[i] > 1 });
+    }
+  }
+  std::stable_sort(drawList.begin(), drawList.end(),
+    [](const DrawItem& a, const DrawItem& b) { return a.bindKey != b.bindKey ? a.bindKey < b.bindKey : a.material < b.material; });
+
+  // without the atlas every material would be a bind of its own
+  {
+    uint32_t atlasBinds{}, materialBinds{};
+    for (size_t i = 0; i < drawList.size(); i++)
+    {
+      if (i == 0 || drawList[i].bindKey != drawList[i - 1].bindKey) atlasBinds++;
+      if (i == 0 || drawList[i].material != drawList[i - 1].material) materialBinds++;
+    }
+    std::cout << "Texture binds per frame: " << atlasBinds << " (" << materialBinds << " without the atlas and texture arrays)" << std::endl;
+  }
+  uint32_t textureBinds{}; // of the last frame, for the stats
 
-  // load textures
-  texture[0].loadTexture("./Textures/crate.jpg");
-  texture[1].loadTexture("./Textures/woodcrate_diffuse.jpg");
-  texture[2].loadTexture("./Textures/robot_diffuse.jpg");
-  texture[3].loadTexture("./Textures/tile_floor.jpg");
+  // world space bounding spheres of the draw items, in draw list order. The scene doesn't move, so they're built once
+  // each frame they're tested against the camera frustum and draws that can't be seen are skipped
+  SphereBounds drawBounds{};
+  drawBounds.reserve(drawList.size());
+  for (const DrawItem& item : drawList)
+  {
+    const glm::vec3& scale = objects[item.object].scale;
+    const float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+    drawBounds.push_back(objects[item.object].position + mesh[item.model].getBoundsCenter() * scale, mesh[item.model].getBoundsRadius() * maxScale);
+  }
+  std::vector<uint64_t> drawVisible{};
+  size_t drawsCulled{}; // of the last frame, for the stats
+
+  // the visible draws of a frame, ordered by program, texture, material, mesh and then front to back
+  RenderQueue renderQueue{};
+  renderQueue.reserve(drawList.size());
+  std::vector<ShaderFeatures> drawFeatures(drawList.size()); // variant of each queued draw this frame, by draw list index
+
+  // the features are the program field of the key, so the queue sorts by variant. Drawing uses drawFeatures, a
+  // clamped field would only sort worse, but it should still hold every combination
+  static_assert((1u << SHADER_FEATURE_COUNT) - 1 <= (1u << RenderQueue::PROGRAM_BITS) - 1, "shader features don't fit the program field of the sort key");
+
+  // runs of the sorted queue that go out as one draw call. A run of instanced packets with the same sub-mesh and
+  // material is one glDrawElementsInstanced, everything else is a batch of one
+  struct DrawBatch
+  {
+    uint32_t first{}; // in the render queue
+    uint32_t count{};
+    bool instanced{};
+    bool multiDraw{};
+    GLintptr instanceOffset{}; // of the first model matrix in the instance ring
+  };
+  std::vector<DrawBatch> drawBatches{};
+  std::vector<uint32_t> packetBatches{}; // batch of each render queue packet
+  uint32_t drawCalls{}, instancedDraws{}, instancesDrawn{}, multiDraws{}, multiDrawn{}; // of the last frame, for the stats
+
+  // every ring fits a frame that draws the whole draw list (a batch per draw at most), plus an alignment per allocation
+  // an allocation that doesn't fit would drop all draws of its kind for the frame
+  const GLsizeiptr drawCount = static_cast<GLsizeiptr>(drawList.size());
+  uniformRing.init(GL_UNIFORM_BUFFER, getUniformBlockStride(sizeof(FrameUniforms)) + objectBlockStride * drawCount + 2 * uniformAlignment);
+
+  // model matrices of the instanced batches. Written each frame, read through instance attributes
+  StreamBuffer instanceRing{};
+  instanceRing.init(GL_ARRAY_BUFFER, sizeof(glm::mat4) * (drawCount + 1));
+
+  // per draw records of the multi-draw batches (ObjectUniforms, DRAW_DATA_TEXELS texels each), read through a buffer texture
+  // the texture covers the whole ring. Shaders find this frame's records with drawDataBase
+  // a buffer texture has at most GL_MAX_TEXTURE_BUFFER_SIZE texels (65536 in GL 3.3, ~3600 records a frame with
+  // 3 frames in flight), so the ring is capped there. Frames with more visible draws draw one by one instead
+  constexpr uint8_t DRAW_DATA_FRAMES = 3;
+  GLint maxTextureBufferTexels{};
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferTexels);
+  const GLsizeiptr maxDrawRecords = std::max<GLsizeiptr>(maxTextureBufferTexels / DRAW_DATA_TEXELS / DRAW_DATA_FRAMES - 1, 1);
+  const GLsizeiptr drawRecordCapacity = std::min(drawCount, maxDrawRecords); // a frame's records, one is alignment slack
+  if (drawRecordCapacity < drawCount)
+  {
+    std::cout << "Multi-draw: the draw data texture holds " << drawRecordCapacity << " of " << drawCount
+      << " draws a frame (GL_MAX_TEXTURE_BUFFER_SIZE " << maxTextureBufferTexels << "), frames with more draw one by one" << std::endl;
+  }
+  StreamBuffer drawDataRing{};
+  drawDataRing.init(GL_TEXTURE_BUFFER, sizeof(ObjectUniforms) * (drawRecordCapacity + 1), DRAW_DATA_FRAMES);
+  bool ringOverflowReported[3]{}; // uniform, instance and draw data ring
+  GLuint drawDataTexture{};
+  glGenTextures(1, &drawDataTexture);
+  RenderState::get().bindTexture(DRAW_DATA_UNIT, GL_TEXTURE_BUFFER, drawDataTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataRing.getBuffer());
+
+  // index ranges of the multi-draw batches, one entry per render queue packet. A batch passes its slice
+  std::vector<GLsizei> multiDrawCounts{};
+  std::vector<GLvoid*> multiDrawOffsets{};
+  std::vector<GLint> multiDrawBaseVertices{};
+
+  // gl_DrawIDARB tells the shader which draw of a multi-draw it is in. Without it every draw is a call of its own
+  // with drawDataBase moved in between. Still one VAO and no block rebinds, but no fewer calls
+  const bool multiDrawSupported = GLEW_ARB_shader_draw_parameters != 0;
+  std::cout << "Multi-draw: " << (multiDrawSupported ? "gl_DrawIDARB" : "ARB_shader_draw_parameters missing, one call per draw") << std::endl;
 
 
   ////////////////// TEXTURES///////////////////
@@ -309,19 +536,76 @@ int main() // entry renderer point
   //float cubeAngle = 0.0f;
   double lastTime = glfwGetTime();
 
+  // both cameras get the window's aspect here and on resize. Their matrices are rebuilt in one place each frame
+  CameraSet cameras{};
+  cameras.add(&fpsCamera);
+  cameras.add(&orbitCamera);
+  for (size_t i = 0; i < cameras.size(); i++)
+  {
+    cameras[i].setPerspective(45.0f, (float)gWindowWidth / (float)gWindowHeight, 0.1f, 100.0f);
+  }
+  orbitCamera.setLookAt(cubePos); // target (where camera looks is a cubePose)
+  orbitCamera.setRadius(gRadius);
+  orbitCamera.rotate(gYaw, gPitch);
+
+  Profiler::get().setThreadName("main");
+
   // Main loop - window on the screen
   // While a method doesn't return true we get the window on the screen
   while (!glfwWindowShouldClose(gWindow))
   {
+    // collect the last frame's scopes and the GPU times that are ready. The frame scope ends with the iteration
+    Profiler::get().newFrame();
+    PROFILE_SCOPE("frame");
+
     // Stats
-    showFrameStats(gWindow, gDrawStats);
+    std::ostringstream extraStats;
+    if (gDrawStats)
+    {
+      const TextureStats& textureStats = textures.getStats();
+      extraStats << std::fixed << std::setprecision(1)
+        << "Textures: " << textureStats.texturesResident << " (" << textureStats.bytesResident / (1024.0 * 1024.0) << " MB)  "
+        << "hit rate " << textureStats.getHitRate() * 100.0 << "%  evictions " << textureStats.evictions
+        << "  binds " << textureBinds << "  culled " << drawsCulled << "/" << drawList.size() << "  uniforms " << uniformCalls << " sent, " << uniformsSkipped << " skipped"
+        << "  streamed " << textureStats.texturesStreamed << " (+" << textureStats.levelsStreamedIn << " -" << textureStats.levelsDropped
+        << " levels, " << textureStats.bytesStreamedLastFrame / 1024.0 << " KB this frame)";
+
+      const RenderState::Stats& stateStats = RenderState::get().getStats();
+      extraStats << "  GL state calls " << stateStats.getIssued() << " issued, " << stateStats.getElided() << " elided";
+
+      const RenderQueue::Stats& queueStats = renderQueue.getStats();
+      extraStats << "  queue " << queueStats.packets << " draws, changes: program " << queueStats.programChanges
+        << " texture " << queueStats.textureChanges << " mesh " << queueStats.meshChanges
+        << " (VAO binds " << stateStats.issued[static_cast<size_t>(RenderState::Call::VERTEX_ARRAY)] << ")";
+      extraStats << "  draw calls " << drawCalls << " (" << DRAW_PATH_NAMES[static_cast<size_t>(gDrawPath)] << ": "
+        << instancedDraws << " instanced with " << instancesDrawn << " instances, "
+        << multiDraws << " multi-draws with " << multiDrawn << " draws)";
+
+      // avg (min-max) ms per frame of every scope over the last frames
+      const Profiler& profiler = Profiler::get();
+      extraStats << std::setprecision(2) << "  profile";
+      for (ProfileScopeId i = 0; i < profiler.getScopeCount(); i++)
+      {
+        const Profiler::ScopeStats& scope = profiler.getScopeStats(i);
+        if (scope.samples == 0) continue;
+        extraStats << "  " << (scope.gpu ? "GPU " : "") << scope.name << " " << scope.avgMs << " (" << scope.minMs << "-" << scope.maxMs << ")";
+      }
+    }
+    showFrameStats(gWindow, gDrawStats, extraStats.str());
+
+    // a new frame for the texture LRU and the GL state counters
+    textures.beginFrame();
+    RenderState::get().beginFrame();
 
     // rotate 3D cube. It gives us a time for each frame
     auto currentTime = glfwGetTime();
     auto deltaTime = currentTime - lastTime;
 
     // Quering any inputs (from keyboard, mouse and etc...)
-    glfwPollEvents();
+    {
+      PROFILE_SCOPE("input");
+      glfwPollEvents();
+    }
 
     // What kind of things we want to clear (in our case this is COLOR_BUFFER | DEPTH_BUFFER)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -355,7 +639,7 @@ int main() // entry renderer point
     }*/
 
     // matrices to transform vertices to clip space
-    glm::mat4 model, view, projection;
+    glm::mat4 model;
 
     // Setup model matrix
     // Translate our cube back from (0.0f - model was created with 0 origin) to position we set above (-5.0f) in front of the camera
@@ -381,41 +665,30 @@ int main() // entry renderer point
 
     //view = orbitCamera.getViewMatrix();
 
-    // Camera settings
-    const float fov = 45.0f;
-    const float nearPlane = 0.1f;
-    const float farPlane = 100.0f;
-
+    // Camera settings live in the cameras now (see setup before the loop). The orbit camera is moved from the
+    // mouse callback only when the mouse moved, the FPS camera from update() while keys are down
     if (gUseFPSCamera)
     {
       // call update method after PollEvents to register on pressed buttons
       // update methods for fpsCamera to move it
       update(deltaTime);
 
-      view = fpsCamera.getViewMatrix();
-      projection = glm::perspective(glm::radians(fpsCamera.getFOV()), (float)gWindowWidth / (float)gWindowHeight, nearPlane, farPlane);
-
       // Hides and grabs cursor, unlimited movement
       glfwSetInputMode(gWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // disable the cursor      
     }
     else
     {
-      view = orbitCamera.getViewMatrix();
-      // actually there is no need to do it every frame in the loop because a user might not change a camera every frame by moving a mouse      
-      orbitCamera.setLookAt(cubePos); // target (where camera looks is a cubePose)
-      orbitCamera.rotate(gYaw, gPitch); // setted from mouse cursor position
-      orbitCamera.setRadius(gRadius); // setted in mouse callback function
-
-      // create projection matrix (perspective not orthogonal)
-      // args: (field of view, aspect ration, near plane, far plane)
-      // glm makes all job for us with perspective method
-
-      projection = glm::perspective(glm::radians(fov), (float)gWindowWidth / (float)gWindowHeight, nearPlane, farPlane);
-
       // Hides and grabs cursor, unlimited movement
       glfwSetInputMode(gWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL); // disable the cursor      
     }
 
+    // rebuild the matrices of the cameras that changed. Everything below reads the cached ones
+    cameras.update();
+    const Camera& camera = gUseFPSCamera ? static_cast<const Camera&>(fpsCamera) : orbitCamera;
+    const glm::mat4& view = camera.getViewMatrix();
+    const glm::mat4& projection = camera.getProjectionMatrix();
+    const float nearPlane = camera.getNearPlane();
+
 
     // actually there is no need to do it every frame in the loop because a user might not change a camera every frame by moving a mouse
     //orbitCamera.setLookAt(cubePos); // target (where camera looks is a cubePose)
@@ -432,7 +705,8 @@ int main() // entry renderer point
 
     ////////////////DRAWING_TRIANGLE///////////////////////////
     // activate shader program
-    shaderProgram.useProgram();
+    // the variant is picked per draw below. Edited shader files are rebuilt here
+    shaders.updateHotReload();
 
     // when using more than one texture unit we need to specify texture unit location for a shader
     // args: shader program handler, name of the sampler, location of tex unit = 0
@@ -458,9 +732,20 @@ int main() // entry renderer point
     //shaderProgram.setUniform("posOffset", pos);
 
     // set uniforms (variables to read them in a vertex shader) as above (see comments)
-    // shaderProgram.setUniform("model", model);
-    shaderProgram.setUniform("view", view);
-    shaderProgram.setUniform("projection", projection);
+    // view and projection go into the frame block. It's written once and bound once for all programs
+    // streaming feedback below needs the camera position too
+    const glm::vec3& camPos = camera.getPosition();
+    uniformRing.beginFrame();
+    const StreamAllocation frameBlock = uniformRing.allocate(sizeof(FrameUniforms), uniformAlignment);
+    if (frameBlock.data != nullptr)
+    {
+      FrameUniforms frameUniforms{};
+      frameUniforms.view = view;
+      frameUniforms.projection = projection;
+      frameUniforms.camPos = glm::vec4(camPos, 1.0f);
+      memcpy(frameBlock.data, &frameUniforms, sizeof(FrameUniforms));
+      RenderState::get().bindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, uniformRing.getBuffer(), frameBlock.offset, sizeof(FrameUniforms));
+    }
 
     // before each draw we must bind our vertext array object
     //glBindVertexArray(vao);
@@ -484,22 +769,289 @@ int main() // entry renderer point
     model = glm::translate(model, floorPos) * glm::scale(model, glm::vec3(10.0f, 0.01f, 10.0f));
 
     // DRAW LOADED MODELS
-    for (int i = 0; i < numOfModels; i++)
+    // inside a program the queue is sorted by bind key. We only rebind textures when the key changes
+    // materials in the same atlas page keep the page bound and only move their UVs
+    // materials in the same texture array keep the array bound and only change the layer
+    MaterialId boundMaterial = INVALID_MATERIAL;
+    ShaderFeatures boundFeatures = UINT32_MAX; // no variant has all bits set, so the first visible draw picks one
+    uint32_t boundKey = UINT32_MAX;
+    textureBinds = 0;
+
+    // frustum culling. Everything below only looks at the draws that may be visible
+    {
+      PROFILE_SCOPE("cull");
+      drawsCulled = drawList.size() - cullSpheres(camera.getFrustum(), drawBounds, drawVisible);
+    }
+
+    // queue the visible draws. The key decides the submit order, the payload is the index into the draw list
+    // sub-meshes drawn by several objects use the instanced variant, so they sort next to each other
+    // multi-draw records are indexed like the queue, so a frame with more visible draws than the draw data texture
+    // holds draws one by one
+    const bool multiDrawFits = static_cast<GLsizeiptr>(drawList.size() - drawsCulled) <= drawRecordCapacity;
+    renderQueue.clear();
+    for (size_t i = 0; i < drawList.size(); i++)
+    {
+      if (!isVisible(drawVisible, i)) continue;
+
+      const DrawItem& item = drawList[i];
+      ShaderFeatures features = item.features;
+      if (gDrawPath == DrawPath::MULTI_DRAW && multiDrawFits && mesh[item.model].getPool() != nullptr) features |= SHADER_FEATURE_MULTI_DRAW;
+      else if (gDrawPath == DrawPath::INSTANCED && item.instanced) features |= SHADER_FEATURE_INSTANCED;
+      const float distance = glm::length(camPos - glm::vec3(drawBounds.x[i], drawBounds.y[i], drawBounds.z[i])) - drawBounds.radius[i];
+      const uint32_t depth = RenderQueue::quantizeDepth(distance, camera.getNearPlane(), camera.getFarPlane());
+      drawFeatures[i] = features;
+      renderQueue.push(RenderQueue::makeKey(0, features, item.bindKey, item.material, RenderQueue::makeMesh(item.model, item.subMesh), depth), static_cast<uint32_t>(i));
+    }
+    {
+      PROFILE_SCOPE("sort");
+      renderQueue.sort();
+    }
+
+    // cut the queue into draw calls. Instanced runs need the same sub-mesh and material, multi-draw runs only
+    // the same program and texture: the rest is per draw data
+    drawBatches.clear();
+    packetBatches.resize(renderQueue.size());
+    uint32_t instanceCount{}, multiDrawCount{};
+    for (uint32_t q = 0; q < renderQueue.size(); q++)
+    {
+      const DrawItem& item = drawList[renderQueue.getPayload(q)];
+      const ShaderFeatures features = drawFeatures[renderQueue.getPayload(q)];
+      const bool instanced = (features & SHADER_FEATURE_INSTANCED) != 0;
+      const bool multiDraw = (features & SHADER_FEATURE_MULTI_DRAW) != 0;
+      if (instanced) instanceCount++;
+      if (multiDraw) multiDrawCount++;
+
+      if (!drawBatches.empty() && (instanced || multiDraw))
+      {
+        DrawBatch& batch = drawBatches.back();
+        const DrawItem& first = drawList[renderQueue.getPayload(batch.first)];
+        const bool sameProgram = drawFeatures[renderQueue.getPayload(batch.first)] == features;
+        const bool joins = instanced
+          ? batch.instanced && first.model == item.model && first.subMesh == item.subMesh && first.material == item.material
+          : batch.multiDraw && sameProgram && first.bindKey == item.bindKey;
+        if (joins)
+        {
+          batch.count++;
+          packetBatches[q] = static_cast<uint32_t>(drawBatches.size() - 1);
+          continue;
+        }
+      }
+      drawBatches.push_back({ q, 1, instanced, multiDraw });
+      packetBatches[q] = static_cast<uint32_t>(drawBatches.size() - 1);
+    }
+
+    // streaming feedback. projection[1][1] is 1 / tan(fov / 2), so a unit at distance d is
+    // projection[1][1] * height / (2 * d) pixels tall. The nearest point of the bounding sphere decides
+    const float pixelsPerUnitAtOne = projection[1][1] * gWindowHeight * 0.5f;
+
+    // one object block per batch, one model matrix per instance. Both rings have to be committed before we draw from them
+    // multi-draw records are indexed like the render queue, so a batch's first record is frame base + its first packet
+    instanceRing.beginFrame();
+    drawDataRing.beginFrame();
+    const StreamAllocation objectBlocks = uniformRing.allocate(objectBlockStride * static_cast<GLsizeiptr>(drawBatches.size()), uniformAlignment);
+    const StreamAllocation instances = instanceRing.allocate(sizeof(glm::mat4) * static_cast<GLsizeiptr>(instanceCount), sizeof(glm::mat4));
+    const StreamAllocation drawRecords = multiDrawCount > 0
+      ? drawDataRing.allocate(sizeof(ObjectUniforms) * static_cast<GLsizeiptr>(renderQueue.size()), sizeof(ObjectUniforms))
+      : StreamAllocation{};
+    const GLint drawRecordBase = static_cast<GLint>(drawRecords.offset / sizeof(ObjectUniforms));
+    multiDrawCounts.resize(renderQueue.size());
+    multiDrawOffsets.resize(renderQueue.size());
+    multiDrawBaseVertices.resize(renderQueue.size());
+    GLintptr instanceOffset = instances.offset;
+    for (DrawBatch& batch : drawBatches)
     {
-      // position each model in the space (glm::translatte)
-      // args (glm::mat4 means identity matrix. Just affects a matrix itself)
-      // if we passed in ""model" it would squashed itself and got messy results
-      // multiply by scale to get model scales we want (glm::scale)
-      model = glm::translate(glm::mat4(), modelPositions[i]) * glm::scale(glm::mat4(), modelScales[i]);
+      if (!batch.instanced) continue;
+      batch.instanceOffset = instanceOffset;
+      instanceOffset += sizeof(glm::mat4) * batch.count;
+    }
 
-      // set uniform for a shader
-      shaderProgram.setUniform("model", model);
+    // every packet writes its own matrix, record or block, so the packets are spread over the job system
+    // nothing here touches GL, the workers only write into the mapped rings
+    if (objectBlocks.data != nullptr)
+    {
+      PROFILE_SCOPE("fill");
+      JobSystem::get().parallelFor(static_cast<uint32_t>(renderQueue.size()), [&](uint32_t begin, uint32_t end)
+      {
+        PROFILE_SCOPE("fill packets");
+        for (uint32_t q = begin; q < end; q++)
+        {
+          const uint32_t b = packetBatches[q];
+          const DrawBatch& batch = drawBatches[b];
+          const DrawItem& draw = drawList[renderQueue.getPayload(q)];
+          const SceneObject& object = objects[draw.object];
+
+          // position each model in the space (glm::translatte)
+          // args (glm::mat4 means identity matrix. Just affects a matrix itself)
+          // if we passed in ""model" it would squashed itself and got messy results
+          // multiply by scale to get model scales we want (glm::scale)
+          const glm::mat4 model = glm::translate(glm::mat4(), object.position) * glm::scale(glm::mat4(), object.scale);
+
+          if (batch.multiDraw)
+          {
+            // a record and an index range per draw. The object block of the batch isn't read
+            if (drawRecords.data == nullptr) continue;
+
+            ObjectUniforms record{};
+            record.model = model;
+            if (draw.material != INVALID_MATERIAL)
+            {
+              record.uvTransform = materials.getMaterial(draw.material).uvTransform;
+              record.textureLayer = materials.getMaterial(draw.material).arrayLayer;
+            }
+            memcpy(static_cast<uint8_t*>(drawRecords.data) + q * sizeof(ObjectUniforms), &record, sizeof(ObjectUniforms));
+
+            const SubMesh& subMesh = mesh[draw.model].getSubMesh(draw.subMesh);
+            multiDrawCounts[q] = static_cast<GLsizei>(subMesh.indexCount);
+            multiDrawOffsets[q] = (GLvoid*)(subMesh.firstIndex * sizeof(uint32_t));
+            multiDrawBaseVertices[q] = mesh[draw.model].getBaseVertex();
+            continue;
+          }
+
+          // instanced batches take the matrices from the instance buffer and leave the block's one alone
+          if (batch.instanced && instances.data != nullptr)
+          {
+            glm::mat4* instanceModels = reinterpret_cast<glm::mat4*>(static_cast<uint8_t*>(instances.data) + (batch.instanceOffset - instances.offset));
+            instanceModels[q - batch.first] = model;
+          }
+
+          // the first packet of a batch fills its object block
+          if (q != batch.first) continue;
+
+          ObjectUniforms objectUniforms{};
+          if (!batch.instanced) objectUniforms.model = model;
+          if (draw.material != INVALID_MATERIAL)
+          {
+            objectUniforms.uvTransform = materials.getMaterial(draw.material).uvTransform;
+            objectUniforms.textureLayer = materials.getMaterial(draw.material).arrayLayer;
+          }
+          memcpy(static_cast<uint8_t*>(objectBlocks.data) + b * objectBlockStride, &objectUniforms, sizeof(ObjectUniforms));
+        }
+      });
+    }
+    uniformRing.commit();
+    instanceRing.commit();
+    drawDataRing.commit();
+
+    // submission, streaming uploads and the swap. Both scopes end with the frame
+    PROFILE_SCOPE("render");
+    PROFILE_GPU_SCOPE("render");
+
+    drawCalls = instancedDraws = instancesDrawn = multiDraws = multiDrawn = 0;
+    for (size_t b = 0; b < drawBatches.size(); b++)
+    {
+      const DrawBatch& batch = drawBatches[b];
+      const DrawItem& item = drawList[renderQueue.getPayload(batch.first)];
+
+      // multi-draw batches mix meshes and materials, so every draw asks with its own sub-mesh and material
+      for (uint32_t q = 0; q < batch.count; q++)
+      {
+        const size_t i = renderQueue.getPayload(batch.first + q);
+        const DrawItem& draw = drawList[i];
+        const SubMesh& subMesh = mesh[draw.model].getSubMesh(draw.subMesh);
+        if (subMesh.uvDensity <= 0.0f) continue;
+
+        const glm::vec3& scale = objects[draw.object].scale;
+        const float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+        if (maxScale <= 0.0f) continue;
+
+        const glm::vec3 center(drawBounds.x[i], drawBounds.y[i], drawBounds.z[i]);
+        const float distance = std::max(glm::length(camPos - center) - drawBounds.radius[i], nearPlane);
+        materials.requestPixelsPerUV(draw.material, pixelsPerUnitAtOne / distance / (subMesh.uvDensity * maxScale));
+      }
+
+      if (item.bindKey != boundKey)
+      {
+        materials.bind(item.material, 0);
+        boundKey = item.bindKey;
+        textureBinds++;
+      }
+
+      boundMaterial = item.material;
+
+      // the queue is sorted by program (the features) first, so variants change a few times per frame at most
+      const ShaderFeatures features = drawFeatures[renderQueue.getPayload(batch.first)];
+      if (features != boundFeatures)
+      {
+        shaders.get(features).useProgram();
+        boundFeatures = features;
+      }
+
+      // one call for the whole batch (or one per draw without gl_DrawIDARB). The shader finds each draw's record
+      // from drawDataBase, so nothing is rebound between the draws
+      if (batch.multiDraw)
+      {
+        if (drawRecords.data == nullptr) continue;
+        ShaderProgram& program = shaders.get(features);
+        const std::unordered_map<const ShaderProgram*, UniformHandle>::const_iterator handle = drawDataBaseHandles.find(&program);
+        const UniformHandle drawDataBase = handle != drawDataBaseHandles.end() ? handle->second : INVALID_UNIFORM;
+        RenderState::get().bindTexture(DRAW_DATA_UNIT, GL_TEXTURE_BUFFER, drawDataTexture);
+        RenderState::get().bindVertexArray(meshPool.getVertexArray());
+        if (multiDrawSupported)
+        {
+          program.setUniform(drawDataBase, drawRecordBase + static_cast<GLint>(batch.first));
+          glMultiDrawElementsBaseVertex(GL_TRIANGLES, &multiDrawCounts[batch.first], GL_UNSIGNED_INT,
+            &multiDrawOffsets[batch.first], static_cast<GLsizei>(batch.count), &multiDrawBaseVertices[batch.first]);
+          drawCalls++;
+        }
+        else
+        {
+          for (uint32_t q = batch.first; q < batch.first + batch.count; q++)
+          {
+            program.setUniform(drawDataBase, drawRecordBase + static_cast<GLint>(q));
+            glDrawElementsBaseVertex(GL_TRIANGLES, multiDrawCounts[q], GL_UNSIGNED_INT, multiDrawOffsets[q], multiDrawBaseVertices[q]);
+            drawCalls++;
+          }
+        }
+        multiDraws++;
+        multiDrawn += batch.count;
+        continue;
+      }
+
+      // our slice of the object blocks. Without one (the ring is full) there is nothing to draw with
+      if (objectBlocks.data == nullptr) continue;
+      RenderState::get().bindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, uniformRing.getBuffer(),
+        objectBlocks.offset + static_cast<GLintptr>(b) * objectBlockStride, sizeof(ObjectUniforms));
 
       // draw meshes
-      texture[i].bind(0);
-      mesh[i].draw();
-      texture[i].unbind(0);
+      if (batch.instanced)
+      {
+        if (instances.data == nullptr) continue;
+        mesh[item.model].drawSubMeshInstanced(item.subMesh, instanceRing.getBuffer(), batch.instanceOffset, batch.count);
+        instancedDraws++;
+        instancesDrawn += batch.count;
+      }
+      else
+      {
+        mesh[item.model].drawSubMesh(item.subMesh);
+      }
+      drawCalls++;
+    }
+    materials.unbind(boundMaterial, 0);
+    uniformRing.endFrame();
+    instanceRing.endFrame();
+    drawDataRing.endFrame();
+
+    // the rings are sized for the draw list, so this only happens if the scene outgrows them. Said once per ring
+    const StreamBuffer* rings[] = { &uniformRing, &instanceRing, &drawDataRing };
+    const char* RING_NAMES[] = { "uniform", "instance", "draw data" };
+    for (size_t r = 0; r < 3; r++)
+    {
+      if (rings[r]->getStats().overflows > 0 && !ringOverflowReported[r])
+      {
+        std::cerr << "The " << RING_NAMES[r] << " ring overflowed, draws that needed it were skipped" << std::endl;
+        ringOverflowReported[r] = true;
+      }
+    }
+
+    uniformCalls = shaders.getUniformCalls();
+    uniformsSkipped = shaders.getUniformsSkipped();
+    shaders.resetUniformCalls();
 
+    // upload the mip levels this frame asked for, drop the ones nobody needs anymore
+    {
+      PROFILE_SCOPE("streaming");
+      PROFILE_GPU_SCOPE("streaming");
+      textures.updateStreaming();
     }
 
     // we also need to tell our shader to draw the floor one more time and draw our floor (vertices) one more time
@@ -512,7 +1064,10 @@ int main() // entry renderer point
     ///////////////END_DRAWING_TRIANGLE///////////////////////
 
     // Double buffering (Front buffer is what a monitor shows, back buffer is what a video card draws. They are swapping to eliminate tearing)
-    glfwSwapBuffers(gWindow);
+    {
+      PROFILE_SCOPE("swap");
+      glfwSwapBuffers(gWindow);
+    }
 
     // setting current time to last time for rotating 3D cube. Calculating delta
     lastTime = currentTime;
@@ -534,6 +1089,9 @@ int main() // entry renderer point
   //// delete color vertex buffer object (separate buffer layout)
   //glDeleteBuffers(1, &vbo_color);
 
+  RenderState::get().deleteTexture(drawDataTexture);
+  Profiler::get().release();
+
   // GLFW cleans up itself properly
   glfwTerminate();
   return 0;
@@ -588,15 +1146,27 @@ void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mode)
     if (gWireframeMode)
     {
       // wireframe
-      glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+      RenderState::get().setPolygonMode(GL_LINE);
     }
     else
     {
       // fill
-      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      RenderState::get().setPolygonMode(GL_FILL);
     }
   }
 
+  // switch the draw path: per object, instanced, multi-draw. Per object every crate of the field is a draw call
+  if (key == GLFW_KEY_F7 && action == GLFW_PRESS)
+  {
+    gDrawPath = static_cast<DrawPath>((static_cast<uint8_t>(gDrawPath) + 1) % static_cast<uint8_t>(DrawPath::COUNT));
+  }
+
+  // write the next 120 frames as a Chrome trace (chrome://tracing or ui.perfetto.dev)
+  if (key == GLFW_KEY_F8 && action == GLFW_PRESS)
+  {
+    Profiler::get().startCapture(120, "flyeng.trace.json");
+  }
+
   // switch camera
   if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
   {
@@ -617,6 +1187,13 @@ void glfw_onFrameWindowBufferResized(GLFWwindow* window, int width, int height)
   // a method that convers from OpenGL 2D coord to Screen viewport and resize our viewport
   // args (lower left corner of the coords (x), lower left corner of the coords (y), screen width (1024), screen height (768))
   glViewport(0, 0, gWindowWidth, gWindowHeight);
+
+  // a minimized window has no size. Keep the aspect until it comes back
+  if (width <= 0 || height <= 0) return;
+
+  // only the projection is rebuilt
+  fpsCamera.setAspect((float)gWindowWidth / (float)gWindowHeight);
+  orbitCamera.setAspect((float)gWindowWidth / (float)gWindowHeight);
 }
 
 void glfw_onMouseMove(GLFWwindow* window, double posX, double posY)
@@ -632,6 +1209,7 @@ void glfw_onMouseMove(GLFWwindow* window, double posX, double posY)
     // without MOUSE_SENSITIVITY movement of the camera will be too fast
     gYaw -= ((float)posX - lastMousePos.x) * MOUSE_SENSITIVITY;
     gPitch += ((float)posY - lastMousePos.y) * MOUSE_SENSITIVITY;
+    orbitCamera.rotate(gYaw, gPitch);
   }
 
   if (glfwGetMouseButton(gWindow, GLFW_MOUSE_BUTTON_RIGHT) == 1)
@@ -641,6 +1219,7 @@ void glfw_onMouseMove(GLFWwindow* window, double posX, double posY)
     float dy = 0.01f * ((float)posY - lastMousePos.y);
     // actual zooming
     gRadius += dx - dy;
+    orbitCamera.setRadius(gRadius);
   }
   // set current position as last mouse position
   lastMousePos.x = (float)posX;
@@ -691,7 +1270,7 @@ void update(double elapsedTime)
 }
 
 // show fram stats implementation
-void showFrameStats(GLFWwindow* window, bool drawStats)
+void showFrameStats(GLFWwindow* window, bool drawStats, const std::string& extraStats)
 {
   if (drawStats)
   {
@@ -730,6 +1309,11 @@ void showFrameStats(GLFWwindow* window, bool drawStats)
         << "FPS: " << fps << "    "
         << "Frame Time: " << msPerFrame << " (ms)";
 
+      if (!extraStats.empty())
+      {
+        outs << "    " << extraStats;
+      }
+
       // affect the title of this specific window (window argument) ARGS: (specific window to affect the title, output string for a title)
       glfwSetWindowTitle(window, outs.str().c_str());
 
@@ -811,6 +1395,9 @@ bool initOpenGL()
   // Mouse Scroll callback
   glfwSetScrollCallback(gWindow, glfw_onMouseScroll);
 
+  // Framebuffer resize callback. Keeps the viewport and the camera aspect in step with the window
+  glfwSetFramebufferSizeCallback(gWindow, glfw_onFrameWindowBufferResized);
+
   // We need to initialize that (according to documentation) to set GLEW properly 
   glewExperimental = GL_TRUE;
 
@@ -829,7 +1416,7 @@ bool initOpenGL()
 
   // enable depth test vertices to draw on top vertices that are closer to the camera and behind that are farther from the camera
   // args: (what to enable)
-  glEnable(GL_DEPTH_TEST);
+  RenderState::get().setDepthTest(true);
 
   // Hides and grabs cursor, unlimited movement
   // glfwSetInputMode(gWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL); // disable the cursor
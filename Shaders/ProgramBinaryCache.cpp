@@ -0,0 +1,157 @@
+#include "ProgramBinaryCache.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "Hash.h"
+
+namespace
+{
+  constexpr uint32_t FLYPROG_MAGIC = 0x50594C46; // "FLYP"
+  constexpr uint32_t FLYPROG_VERSION = 1;
+
+  struct FlyProgHeader
+  {
+    uint32_t magic{ FLYPROG_MAGIC };
+    uint32_t version{ FLYPROG_VERSION };
+    uint64_t key{};       // repeated in the file, so a renamed or truncated file can't pass
+    uint32_t format{};    // binaryFormat from glGetProgramBinary()
+    uint32_t size{};      // bytes of binary after the header
+    float compileMs{};    // what building from source took when the blob was stored
+    uint32_t reserved{};
+  };
+
+  static_assert(sizeof(FlyProgHeader) == 32, "FlyProgHeader layout is part of the file format");
+
+  uint64_t hashGLString(GLenum name, uint64_t seed)
+  {
+    const GLubyte* str = glGetString(name);
+    return str != nullptr ? fnv1a64(reinterpret_cast<const char*>(str), seed) : seed;
+  }
+}
+
+ProgramBinaryCache& ProgramBinaryCache::get()
+{
+  static ProgramBinaryCache cache{};
+  return cache;
+}
+
+bool ProgramBinaryCache::isSupported()
+{
+  if (mSupported < 0)
+  {
+    GLint formatCount{};
+    if (GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    mSupported = formatCount > 0 ? 1 : 0;
+
+    if (mSupported == 0)
+    {
+      std::cout << "ARB_get_program_binary is not supported. Shaders are compiled on every run" << std::endl;
+    }
+
+    mDriverHash = hashGLString(GL_VENDOR, FNV_OFFSET_BASIS);
+    mDriverHash = hashGLString(GL_RENDERER, mDriverHash);
+    mDriverHash = hashGLString(GL_VERSION, mDriverHash);
+  }
+  return mSupported == 1 && !mDirectory.empty();
+}
+
+uint64_t ProgramBinaryCache::makeKey(const std::string* sources, size_t count)
+{
+  isSupported(); // for the driver hash
+
+  uint64_t key = mDriverHash;
+  for (size_t i = 0; i < count; i++)
+  {
+    // the length goes in too, so moving text from one stage to the next changes the key
+    const uint64_t length = sources[i].size();
+    key = fnv1a64(&length, sizeof(length), key);
+    key = fnv1a64(sources[i].data(), sources[i].size(), key);
+  }
+  return key;
+}
+
+std::string ProgramBinaryCache::getPath(uint64_t key) const
+{
+  std::ostringstream name{};
+  name << std::hex << std::setw(16) << std::setfill('0') << key << ".flyprog";
+  return (std::filesystem::path(mDirectory) / name.str()).generic_string();
+}
+
+bool ProgramBinaryCache::load(GLuint program, uint64_t key)
+{
+  if (!isSupported()) return false;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::ifstream in(getPath(key), std::ios::in | std::ios::binary);
+  FlyProgHeader header{};
+  if (!in.is_open() || !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+    header.magic != FLYPROG_MAGIC || header.version != FLYPROG_VERSION || header.key != key)
+  {
+    mStats.misses++;
+    return false;
+  }
+
+  std::vector<char> binary(header.size);
+  if (!in.read(binary.data(), binary.size()))
+  {
+    mStats.misses++;
+    return false;
+  }
+
+  glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+  // the driver reports a refused blob as a failed link, not as a GL error
+  GLint status{};
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE)
+  {
+    mStats.rejected++;
+    return false;
+  }
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  mStats.hits++;
+  mStats.loadMs += ms;
+  mStats.savedMs += header.compileMs - ms;
+  return true;
+}
+
+bool ProgramBinaryCache::store(GLuint program, uint64_t key, double compileMs)
+{
+  if (!isSupported()) return false;
+
+  GLint length{};
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return false;
+
+  std::vector<char> binary(static_cast<size_t>(length));
+  GLenum format{};
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  const std::string path = getPath(key);
+  std::error_code error{};
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+  {
+    std::cerr << "Can't write program binary " << path << std::endl;
+    return false;
+  }
+
+  FlyProgHeader header{};
+  header.key = key;
+  header.format = format;
+  header.size = static_cast<uint32_t>(length);
+  header.compileMs = static_cast<float>(compileMs);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(binary.data(), length);
+
+  mStats.stored++;
+  return static_cast<bool>(out);
+}
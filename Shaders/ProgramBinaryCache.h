@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include "GL/glew.h"
+
+// On-disk cache of linked programs (ARB_get_program_binary, core in GL 4.1)
+// Compiling and linking GLSL costs milliseconds per program. The driver can hand us the linked result
+// as an opaque blob, and on the next run we give it back with glProgramBinary() instead of compiling
+//
+// Blobs are only valid for the driver that made them. The key hashes the sources as they're passed to
+// glShaderSource() together with GL_VENDOR, GL_RENDERER and GL_VERSION, so a driver update just misses.
+// The driver may still reject a blob (glProgramBinary() fails to link). The caller then compiles from source
+//
+// .flyprog: FlyProgHeader, binary
+// one file per key, named by the key. Stale files of old sources or drivers are never read again
+class ProgramBinaryCache
+{
+public:
+
+  struct Stats
+  {
+    uint32_t hits{};      // programs restored from a blob
+    uint32_t misses{};    // no blob for the key
+    uint32_t rejected{};  // a blob was there but the driver refused it
+    uint32_t stored{};
+    double loadMs{};      // time spent restoring blobs
+    double savedMs{};     // compile + link time the hits would have cost, as measured when they were stored
+  };
+
+  static ProgramBinaryCache& get();
+
+  ProgramBinaryCache(const ProgramBinaryCache&) = delete;
+  ProgramBinaryCache& operator=(const ProgramBinaryCache&) = delete;
+
+  // where the blobs go. An empty directory turns the cache off
+  void setDirectory(const std::string& directory) { mDirectory = directory; };
+  const std::string& getDirectory() const { return mDirectory; };
+
+  // needs a GL context. False without the extension or if the driver has no binary formats
+  bool isSupported();
+
+  // hash of the sources of all stages in link order and the driver strings
+  uint64_t makeKey(const std::string* sources, size_t count);
+
+  // restore program from the blob stored under key. program must be a fresh glCreateProgram()
+  // false on a miss or if the driver refused the blob. The program has no valid link then
+  bool load(GLuint program, uint64_t key);
+
+  // save the linked program under key. compileMs is what building it from source took (for the stats)
+  // the program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+  bool store(GLuint program, uint64_t key, double compileMs);
+
+  const Stats& getStats() const { return mStats; };
+
+private:
+
+  ProgramBinaryCache() = default;
+
+  std::string getPath(uint64_t key) const;
+
+  std::string mDirectory{ "./Cooked/ShaderCache/" };
+
+  // -1 not checked yet, then 0 or 1
+  int mSupported{ -1 };
+
+  // driver strings hashed once
+  uint64_t mDriverHash{};
+
+  Stats mStats{};
+};
+
+#endif // !PROGRAM_BINARY_CACHE_H
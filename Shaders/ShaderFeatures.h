@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef SHADER_FEATURES_H
+#define SHADER_FEATURES_H
+
+#include <stdint.h>
+
+// bitmask of optional shader features. Every set bit becomes "#define <name> 1" after the #version line,
+// so a shader tests features with #ifdef and each combination compiles into its own program (a variant)
+using ShaderFeatures = uint32_t;
+
+enum ShaderFeature : ShaderFeatures
+{
+  SHADER_FEATURE_ATLAS = 1u << 0,         // diffuse map is a part of an atlas page: wrap UVs into it
+  SHADER_FEATURE_TEXTURE_ARRAY = 1u << 1, // diffuse map is a layer of texArraySampler instead of texSampler
+  SHADER_FEATURE_INSTANCED = 1u << 2,     // model matrix is a per instance attribute instead of ObjectBlock.model
+  SHADER_FEATURE_MULTI_DRAW = 1u << 3,    // per draw data comes from the drawData buffer texture instead of ObjectBlock
+};
+
+constexpr uint32_t SHADER_FEATURE_COUNT = 4;
+
+// the #define of each bit, in bit order. Also what the prewarm manifest lists
+constexpr const char* SHADER_FEATURE_NAMES[SHADER_FEATURE_COUNT] =
+{
+  "ATLAS",
+  "TEXTURE_ARRAY",
+  "INSTANCED",
+  "MULTI_DRAW",
+};
+
+#endif // !SHADER_FEATURES_H
@@ -1,8 +1,20 @@
+#define _CRT_SECURE_NO_WARNINGS // stb_include uses strcpy and fopen
 #include "ShaderProgram.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include "glm/gtc/type_ptr.hpp"
+#include "RenderState.h"
+#include "UniformBlocks.h"
+#include "ProgramBinaryCache.h"
+#define STB_INCLUDE_IMPLEMENTATION // generates the implementation of stb_include in this file only
+#define STB_INCLUDE_LINE_GLSL      // GLSL #line takes a source string number, not a file name
+#include "stb_include/stb_include.h"
 
 ShaderProgram::ShaderProgram()
   : mProgramHandler{}
@@ -15,17 +27,40 @@ ShaderProgram::~ShaderProgram()
 
 }
 
-bool ShaderProgram::loadShaders(const char * vsFileName, const char * fsFileName)
+bool ShaderProgram::loadShaders(const char * vsFileName, const char * fsFileName, ShaderFeatures features)
 {
   ////////////CREATE_SHADERS////////////////////
-  // read shaders
-  string vsString = readShaderFile(vsFileName);
-  string fsString = readShaderFile(fsFileName);
+  // hot reload reads them again
+  mVertexFileName = vsFileName;
+  mFragmentFileName = fsFileName;
+  mFeatures = features;
+
+  // read shaders (with our feature #defines and #includes resolved)
+  string vsString = loadShaderSource(vsFileName);
+  string fsString = loadShaderSource(fsFileName);
 
   // get source ptr (char*) to shaders to pass them in glCreateShader
   const GLchar* vsSourcePtr = vsString.c_str();
   const GLchar* fsSourcePtr = fsString.c_str();
 
+  // a blob of this program from an earlier run skips compiling and linking altogether
+  ProgramBinaryCache& binaryCache = ProgramBinaryCache::get();
+  const string sources[] = { vsString, fsString };
+  const uint64_t binaryKey = binaryCache.makeKey(sources, 2);
+  const auto buildStart = std::chrono::steady_clock::now();
+
+  // a program loaded before is replaced
+  if (mProgramHandler > 0) RenderState::get().deleteProgram(mProgramHandler);
+
+  // shader program
+  mProgramHandler = glCreateProgram();
+
+  if (binaryCache.load(mProgramHandler, binaryKey))
+  {
+    reflectUniforms();
+    return true;
+  }
+
   // vertex shader id
   GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
 
@@ -71,19 +106,26 @@ bool ShaderProgram::loadShaders(const char * vsFileName, const char * fsFileName
   //  std::cout << "Error! Fragment Shader failed to compile" << infoLog << std::endl;
   //}
 
-  // shader program
-  mProgramHandler = glCreateProgram();
-
   // attach our shaders to a created shader program 
   glAttachShader(mProgramHandler, vertexShader); // args: shader program, attaching shader
   glAttachShader(mProgramHandler, fragmentShader); // args: shader program, attaching shader
 
+  // the driver only keeps what glGetProgramBinary() needs if we ask before linking
+  if (binaryCache.isSupported()) glProgramParameteri(mProgramHandler, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
   // Link shader program
   glLinkProgram(mProgramHandler);
 
   // log shader program  
   checkCompilierErrors(mProgramHandler, ShaderType::PROGRAM);
 
+  GLint linked{};
+  glGetProgramiv(mProgramHandler, GL_LINK_STATUS, &linked);
+  if (linked == GL_TRUE)
+  {
+    binaryCache.store(mProgramHandler, binaryKey, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count());
+  }
+
   //glGetProgramiv(shaderProgram, GL_LINK_STATUS, &result);
 
   //if (!result)
@@ -97,18 +139,19 @@ bool ShaderProgram::loadShaders(const char * vsFileName, const char * fsFileName
   glDeleteShader(vertexShader);
   glDeleteShader(fragmentShader);
 
-  // clear Uniform locations. Not neccesary because it's called once in our program
-  mUniformLocations.clear();
+  // locations change with every link. Handles resolved before keep working
+  reflectUniforms();
 
   ////////////END_CREATE_SHADERS////////////////////
-  return true;
+  return linked == GL_TRUE;
 }
 
 void ShaderProgram::useProgram()
 {
   if (mProgramHandler > 0)
   {
-    glUseProgram(mProgramHandler);
+    // the state cache skips it if the program is in use already (most frames it is)
+    RenderState::get().useProgram(mProgramHandler);
   }
 }
 
@@ -118,42 +161,88 @@ GLuint ShaderProgram::getShaderProgram() const
   return mProgramHandler;
 }
 
-void ShaderProgram::setUniform(const GLchar * name, const glm::vec2 & vec)
+UniformHandle ShaderProgram::getUniformHandle(const GLchar* name)
+{
+  return getUniformHandle(fnv1a64(name));
+}
+
+UniformHandle ShaderProgram::getUniformHandle(uint64_t nameHash)
+{
+  std::unordered_map<uint64_t, UniformHandle>::iterator it = mHandlesByHash.find(nameHash);
+  if (it != mHandlesByHash.end()) return it->second;
+
+  const UniformHandle handle = static_cast<UniformHandle>(mHandleLocations.size());
+  mHandleLocations.push_back(findUniformLocation(nameHash));
+  mShadows.push_back(UniformShadow{});
+  mHandleHashes.push_back(nameHash);
+  mHandlesByHash[nameHash] = handle;
+  return handle;
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, GLint value)
+{
+  if (!updateShadow(handle, &value, sizeof(value))) return;
+
+  // Set Uniform Location
+  glUniform1i(mHandleLocations[handle], value);
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, GLfloat value)
+{
+  if (!updateShadow(handle, &value, sizeof(value))) return;
+
+  glUniform1f(mHandleLocations[handle], value);
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, const glm::vec2 & vec)
 {
-  // Get Uniform Location from out map
-  GLint loc = getUnifomLocation(name);
+  if (!updateShadow(handle, &vec, sizeof(vec))) return;
 
   // Set Uniform Location. This method is C-like. We cannot have one overloaded 
   // function C++-like
-  glUniform2f(loc, vec.x, vec.y);
+  glUniform2f(mHandleLocations[handle], vec.x, vec.y);
 }
 
-void ShaderProgram::setUniform(const GLchar * name, const glm::vec3 & vec)
+void ShaderProgram::setUniform(UniformHandle handle, const glm::vec3 & vec)
 {
-  // Get Uniform Location from out map
-  GLint loc = getUnifomLocation(name);
+  if (!updateShadow(handle, &vec, sizeof(vec))) return;
 
-  // Set Uniform Location
-  glUniform3f(loc, vec.x, vec.y, vec.z);
+  glUniform3f(mHandleLocations[handle], vec.x, vec.y, vec.z);
 }
 
-void ShaderProgram::setUniform(const GLchar * name, const glm::vec4 & vec)
+void ShaderProgram::setUniform(UniformHandle handle, const glm::vec4 & vec)
 {
-  // Get Uniform Location from our map
-  GLint loc = getUnifomLocation(name);
+  if (!updateShadow(handle, &vec, sizeof(vec))) return;
 
-  // Set Uniform Location
-  glUniform4f(loc, vec.x, vec.y, vec.z, vec.w);
+  glUniform4f(mHandleLocations[handle], vec.x, vec.y, vec.z, vec.w);
 }
 
-void ShaderProgram::setUniform(const GLchar * name, const glm::mat4 & m)
+void ShaderProgram::setUniform(UniformHandle handle, const glm::mat4 & m)
 {
-  // Get Uniform Location from our map
-  GLint loc = getUnifomLocation(name);
+  if (!updateShadow(handle, &m, sizeof(m))) return;
 
   // Set Uniform Location
   // args:(location, number of matrices, transpose or not matrices, ptr to the matrix
-  glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(m));
+  glUniformMatrix4fv(mHandleLocations[handle], 1, GL_FALSE, glm::value_ptr(m));
+}
+
+bool ShaderProgram::updateShadow(UniformHandle handle, const void* value, size_t size)
+{
+  // inactive uniforms have location -1. GL ignores them, so we don't even make the call
+  if (handle >= mHandleLocations.size() || mHandleLocations[handle] < 0) return false;
+
+  // uniforms are at most a mat4, so a memcmp of up to 64 bytes is all an unchanged value costs
+  UniformShadow& shadow = mShadows[handle];
+  if (shadow.size == size && memcmp(shadow.data, value, size) == 0)
+  {
+    mUniformsSkipped++;
+    return false;
+  }
+
+  memcpy(shadow.data, value, size);
+  shadow.size = static_cast<uint8_t>(size);
+  mUniformCalls++;
+  return true;
 }
 
 string ShaderProgram::readShaderFile(const string & fileName)
@@ -184,26 +273,86 @@ string ShaderProgram::readShaderFile(const string & fileName)
   return shaderData.str();
 }
 
-void ShaderProgram::checkCompilierErrors(GLint shader, ShaderType type)
+string ShaderProgram::loadShaderSource(const string& fileName)
+{
+  string source = readShaderFile(fileName);
+  if (source.empty()) return source;
+
+  const string directory = std::filesystem::path(fileName).parent_path().string();
+
+  // the includes of the file itself, so editing them reloads us too. Includes inside includes aren't watched
+  std::istringstream lines(source);
+  for (string line{}; std::getline(lines, line);)
+  {
+    const size_t directive = line.find_first_not_of(" \t");
+    if (directive == string::npos || line.compare(directive, 8, "#include") != 0) continue;
+
+    const size_t open = line.find('"', directive);
+    const size_t close = open != string::npos ? line.find('"', open + 1) : string::npos;
+    if (close == string::npos) continue;
+
+    const string includeFileName = (std::filesystem::path(directory) / line.substr(open + 1, close - open - 1)).string();
+    if (std::find(mIncludeFileNames.begin(), mIncludeFileNames.end(), includeFileName) == mIncludeFileNames.end())
+    {
+      mIncludeFileNames.push_back(includeFileName);
+    }
+    if (mHotReload) mSourceWatcher.watch(includeFileName);
+  }
+
+  // stb_include wants writable strings. Include paths are relative to the including shader
+  string includeDirectory = directory.empty() ? string(".") : directory;
+  char error[256]{};
+  char* included = stb_include_string(&source[0], nullptr, &includeDirectory[0], nullptr, error);
+  if (included == nullptr)
+  {
+    std::cerr << "Can't resolve the includes of " << fileName << ": " << error << std::endl;
+    return string{};
+  }
+
+  source = included;
+  free(included);
+
+  // GLSL wants #version first, so the defines go right after it. #line puts the lines after them back at their numbers
+  // this comes after the includes, because stb_include numbers its #line directives by the lines it sees
+  // the uniform blocks are defines too, generated from the C++ structs (UniformBlocks.h)
+  string defines = getUniformBlockDefines();
+  for (uint32_t bit = 0; bit < SHADER_FEATURE_COUNT; bit++)
+  {
+    if (mFeatures & (1u << bit)) defines += string("#define ") + SHADER_FEATURE_NAMES[bit] + " 1\n";
+  }
+
+  size_t insertAt = 0;
+  if (source.compare(0, 8, "#version") == 0)
+  {
+    const size_t versionEnd = source.find('\n');
+    insertAt = versionEnd != string::npos ? versionEnd + 1 : source.size();
+  }
+  const size_t nextLine = std::count(source.begin(), source.begin() + insertAt, '\n') + 1;
+  source.insert(insertAt, defines + "#line " + std::to_string(nextLine) + "\n");
+
+  return source;
+}
+
+bool ShaderProgram::checkCompilierErrors(GLint shader, ShaderType type)
 {
   GLint status{};
 
   if (type == ShaderType::PROGRAM)
   {
     // check link status
-    glGetProgramiv(mProgramHandler, GL_LINK_STATUS, &status);
+    glGetProgramiv(shader, GL_LINK_STATUS, &status);
 
     // if the status is not good
     if (status == GL_FALSE)
     {
       // get get log info
       GLint length{};
-      glGetProgramiv(mProgramHandler, GL_INFO_LOG_LENGTH, &length);
+      glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &length);
 
       string errorLog(length, ' ');
 
       // args: program or shader, log length, ptr to log length, where to put log message
-      glGetProgramInfoLog(mProgramHandler, length, &length, &errorLog[0]);
+      glGetProgramInfoLog(shader, length, &length, &errorLog[0]);
       std::cerr << "Program failed to link! " << errorLog << std::endl;
 
     }
@@ -215,7 +364,7 @@ void ShaderProgram::checkCompilierErrors(GLint shader, ShaderType type)
     {
       // get get log info
       GLint length{};
-      glGetShaderiv(shader, GL_COMPILE_STATUS, &length);
+      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
 
       string errorLog(length, ' ');
 
@@ -225,18 +374,185 @@ void ShaderProgram::checkCompilierErrors(GLint shader, ShaderType type)
       std::cerr << "Shader failed to compile!" << errorLog << std::endl;
     }
   }
+  return status == GL_TRUE;
 }
 
-GLint ShaderProgram::getUnifomLocation(const GLchar * name)
+void ShaderProgram::enableHotReload()
 {
-  std::map <string, GLint>::iterator it = mUniformLocations.find(name);
+  mHotReload = true;
+  mSourceWatcher.watch(mVertexFileName);
+  mSourceWatcher.watch(mFragmentFileName);
+  for (const string& fileName : mIncludeFileNames) mSourceWatcher.watch(fileName);
+
+  // let the driver compile on its own threads, so rebuilds don't stall the frame. Off by default on some drivers
+  if (GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+  else if (GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+}
+
+bool ShaderProgram::updateHotReload()
+{
+  if (mPending.program == 0)
+  {
+    std::vector<string> changed{};
+    if (!mSourceWatcher.poll(changed)) return false;
+
+    const string vsString = loadShaderSource(mVertexFileName);
+    const string fsString = loadShaderSource(mFragmentFileName);
+
+    // an editor may have truncated the file and not written it yet. The write that follows triggers us again
+    if (vsString.empty() || fsString.empty()) return false;
+
+    std::cout << "Rebuilding shader program, " << changed[0] << " changed" << std::endl;
+    const string sources[] = { vsString, fsString };
+    mPending.binaryKey = ProgramBinaryCache::get().makeKey(sources, 2);
+    mPending.changeTime = std::chrono::steady_clock::now();
+    startBuild(vsString, fsString);
+  }
 
-  // if Location is not found we try to find it in the current Shader Program
-  if (it == mUniformLocations.end())
+  if (!isBuildDone()) return false;
+
+  // log every stage, not just the first that failed
+  const bool vertexCompiled = checkCompilierErrors(mPending.vertexShader, ShaderType::VERTEX);
+  const bool fragmentCompiled = checkCompilierErrors(mPending.fragmentShader, ShaderType::FRAGMENT);
+  const bool linked = vertexCompiled && fragmentCompiled && checkCompilierErrors(mPending.program, ShaderType::PROGRAM);
+  glDeleteShader(mPending.vertexShader);
+  glDeleteShader(mPending.fragmentShader);
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mPending.changeTime).count();
+  const PendingBuild build = mPending;
+  mPending = PendingBuild{};
+
+  if (!linked)
   {
-    mUniformLocations[name] = glGetUniformLocation(mProgramHandler, name);
+    RenderState::get().deleteProgram(build.program);
+    std::cerr << "Shader program rebuild failed after " << static_cast<int>(ms) << " ms. Keeping the old program" << std::endl;
+    return false;
   }
 
-  // return found
-  return mUniformLocations[name];
+  // the next start gets it from the cache
+  ProgramBinaryCache::get().store(build.program, build.binaryKey, ms);
+
+  // swap. Handles index into our tables, so they survive. reflectUniforms() points them at the new locations
+  RenderState::get().deleteProgram(mProgramHandler);
+  mProgramHandler = build.program;
+  reflectUniforms();
+
+  std::cout << "Shader program reloaded " << static_cast<int>(ms) << " ms after the change" << std::endl;
+  return true;
+}
+
+void ShaderProgram::startBuild(const string& vsString, const string& fsString)
+{
+  const GLchar* vsSourcePtr = vsString.c_str();
+  const GLchar* fsSourcePtr = fsString.c_str();
+
+  mPending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(mPending.vertexShader, 1, &vsSourcePtr, nullptr);
+  glCompileShader(mPending.vertexShader);
+
+  mPending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(mPending.fragmentShader, 1, &fsSourcePtr, nullptr);
+  glCompileShader(mPending.fragmentShader);
+
+  // GL links even if a stage failed to compile. The link just fails too, and we find out in updateHotReload()
+  mPending.program = glCreateProgram();
+  glAttachShader(mPending.program, mPending.vertexShader);
+  glAttachShader(mPending.program, mPending.fragmentShader);
+  if (ProgramBinaryCache::get().isSupported()) glProgramParameteri(mPending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(mPending.program);
+}
+
+bool ShaderProgram::isBuildDone() const
+{
+  // without the extension any query waits for the compiler, so we may as well ask right away
+  if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile) return true;
+
+  GLint done{};
+  glGetProgramiv(mPending.program, GL_COMPLETION_STATUS_KHR, &done);
+  return done == GL_TRUE;
+}
+
+void ShaderProgram::reflectUniforms()
+{
+  mActiveUniforms.clear();
+
+  GLint count{}, maxLength{};
+  glGetProgramiv(mProgramHandler, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(mProgramHandler, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+  string name(static_cast<size_t>(maxLength) + 1, '\0');
+  for (GLint i = 0; i < count; i++)
+  {
+    ActiveUniform uniform{};
+    GLsizei length{};
+    glGetActiveUniform(mProgramHandler, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &uniform.size, &uniform.type, &name[0]);
+    uniform.name.assign(name.data(), length);
+
+    // arrays are reported as "name[0]". We address them by the plain name
+    const size_t bracket = uniform.name.find('[');
+    if (bracket != string::npos) uniform.name.resize(bracket);
+
+    // members of uniform blocks have no location. They're set through their buffer
+    uniform.location = glGetUniformLocation(mProgramHandler, uniform.name.c_str());
+    if (uniform.location < 0) continue;
+
+    uniform.hash = fnv1a64(uniform.name.c_str());
+    mActiveUniforms.push_back(std::move(uniform));
+  }
+
+  // a new link starts with the defaults from the shader, not with what we set before
+  for (size_t handle = 0; handle < mHandleLocations.size(); handle++)
+  {
+    mHandleLocations[handle] = findUniformLocation(mHandleHashes[handle]);
+    mShadows[handle].size = 0;
+  }
+
+  for (const BlockBinding& block : mBlockBindings)
+  {
+    applyBlockBinding(block.name, block.binding, block.expectedSize);
+  }
+}
+
+bool ShaderProgram::bindUniformBlock(const GLchar* blockName, GLuint binding, GLsizeiptr expectedSize)
+{
+  for (BlockBinding& block : mBlockBindings)
+  {
+    if (block.name == blockName)
+    {
+      block.binding = binding;
+      block.expectedSize = expectedSize;
+      return applyBlockBinding(block.name, binding, expectedSize);
+    }
+  }
+
+  mBlockBindings.push_back({ blockName, binding, expectedSize });
+  return applyBlockBinding(mBlockBindings.back().name, binding, expectedSize);
+}
+
+bool ShaderProgram::applyBlockBinding(const string& blockName, GLuint binding, GLsizeiptr expectedSize)
+{
+  const GLuint index = glGetUniformBlockIndex(mProgramHandler, blockName.c_str());
+  if (index == GL_INVALID_INDEX) return false;
+
+  // the linker lays the block out with std140. If it disagrees with sizeof, the C++ struct is out of date
+  GLint size{};
+  glGetActiveUniformBlockiv(mProgramHandler, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+  if (size != expectedSize)
+  {
+    std::cerr << "Uniform block '" << blockName << "' is " << size << " bytes in the shader and " << expectedSize << " bytes in C++" << std::endl;
+    return false;
+  }
+
+  glUniformBlockBinding(mProgramHandler, index, binding);
+  return true;
+}
+
+GLint ShaderProgram::findUniformLocation(uint64_t nameHash) const
+{
+  // programs have a handful of uniforms and this runs once per handle, so a linear search is fine
+  for (const ActiveUniform& uniform : mActiveUniforms)
+  {
+    if (uniform.hash == nameHash) return uniform.location;
+  }
+  return -1;
 }
@@ -3,12 +3,32 @@
 
 #include "GL/glew.h"
 #include <stdint.h>
+#include <chrono>
 #include <string>
-#include <map>
+#include <vector>
+#include <unordered_map>
 #include "glm\glm.hpp"
+#include "Hash.h"
+#include "FileWatcher.h"
+#include "ShaderFeatures.h"
 
 using std::string;
 
+// index of a uniform the caller resolved once with ShaderProgram::getUniformHandle()
+// handles stay valid for the lifetime of the program object, relinking included
+using UniformHandle = uint32_t;
+constexpr UniformHandle INVALID_UNIFORM = UINT32_MAX;
+
+// an active uniform as reported by glGetActiveUniform() after linking
+struct ActiveUniform
+{
+  string name{};     // arrays without the "[0]"
+  uint64_t hash{};   // fnv1a64(name)
+  GLint location{};
+  GLenum type{};     // GL_FLOAT_MAT4, GL_SAMPLER_2D, ...
+  GLint size{};      // array length, 1 for everything else
+};
+
 class ShaderProgram
 {
 public:
@@ -22,7 +42,23 @@ public:
     PROGRAM,
   };
 
-  bool loadShaders(const char* vsFileName, const char* fsFileName);
+  // compile and link, or restore the program from ProgramBinaryCache if these sources were built before
+  // features become #defines in both stages (ShaderFeatures.h), and so do the uniform blocks (UniformBlocks.h)
+  // #include "file" is resolved relative to the shader
+  // returns false if the program didn't link
+  bool loadShaders(const char* vsFileName, const char* fsFileName, ShaderFeatures features = 0);
+
+  ShaderFeatures getFeatures() const { return mFeatures; };
+
+  // watch the source files of the program. updateHotReload() rebuilds it when they change
+  void enableHotReload();
+
+  // call once per frame. Starts a rebuild when a source changed and swaps it in once the driver is done
+  // with it. Never waits for the compiler (KHR/ARB_parallel_shader_compile). Without the extension the
+  // rebuild blocks one frame. A rebuild that fails keeps the old program
+  // returns true on the frame the new program was swapped in. Handles stay valid, but plain uniforms
+  // (samplers) start at their defaults again and have to be set
+  bool updateHotReload();
 
   // ativate a shader program
   void useProgram();
@@ -30,26 +66,118 @@ public:
   // getter of our shader program
   GLuint getShaderProgram() const;
 
+  // resolve a uniform name once, outside the game loop. The hash version takes fnv1a64() of the name,
+  // which is computed at compile time for string literals: getUniformHandle(fnv1a64("model"))
+  // names that aren't active in the program (unused, optimized out) still get a handle. Setting it does nothing
+  UniformHandle getUniformHandle(const GLchar* name);
+  UniformHandle getUniformHandle(uint64_t nameHash);
+
+  // what the linker kept. Filled after every link
+  const std::vector<ActiveUniform>& getActiveUniforms() const { return mActiveUniforms; };
+
+  // connect a uniform block of the program to a binding point (see UniformBlocks.h). expectedSize is
+  // sizeof the C++ mirror. A mismatch means the layouts differ and is reported. Reapplied after every link
+  // returns false if the program has no such block
+  bool bindUniformBlock(const GLchar* blockName, GLuint binding, GLsizeiptr expectedSize);
+
+  // glUniform* calls made through this program since the last reset, and the sets that were skipped because
+  // the program already had that value. For the frame stats
+  uint32_t getUniformCalls() const { return mUniformCalls; };
+  uint32_t getUniformsSkipped() const { return mUniformsSkipped; };
+  void resetUniformCalls() { mUniformCalls = 0; mUniformsSkipped = 0; };
+
   // Uniforms are global vars "In" visible by all shaders
-  void setUniform(const GLchar* name, const glm::vec2& vec);
-  void setUniform(const GLchar* name, const glm::vec3& vec);
-  void setUniform(const GLchar* name, const glm::vec4& vec);
-  void setUniform(const GLchar* name, const glm::mat4& m);
+  // the GLint one is for samplers too: it sets the texture unit the sampler reads from
+  // setting through a handle is an array access, a compare with the value set last and the GL call if it differs
+  // the program must be in use (like for glUniform*)
+  void setUniform(UniformHandle handle, GLint value);
+  void setUniform(UniformHandle handle, GLfloat value);
+  void setUniform(UniformHandle handle, const glm::vec2& vec);
+  void setUniform(UniformHandle handle, const glm::vec3& vec);
+  void setUniform(UniformHandle handle, const glm::vec4& vec);
+  void setUniform(UniformHandle handle, const glm::mat4& m);
+
+  // by name. Hashes the name and looks the handle up every call. Fine for one-off uniforms
+  template <typename T>
+  void setUniform(const GLchar* name, const T& value) { setUniform(getUniformHandle(name), value); };
 
 private:
 
   // load shader string from a file
   string readShaderFile(const string& fileName);
-  void checkCompilierErrors(GLint shader, ShaderType type);
 
-  // Utility method to get Uniform Location. We don't want to call it every time in Game Loop
-  GLint getUnifomLocation(const GLchar* name);
+  // the source as the compiler gets it: read, #includes resolved, our uniform block and feature #defines added. Empty on failure
+  string loadShaderSource(const string& fileName);
+  // logs the info log on failure. For PROGRAM pass the program
+  bool checkCompilierErrors(GLint shader, ShaderType type);
+
+  // compile both stages and link into a new program. Doesn't check anything, so with parallel
+  // compilation the driver is still at it when this returns
+  void startBuild(const string& vsString, const string& fsString);
+
+  // true once the build started by startBuild() can be queried without blocking
+  bool isBuildDone() const;
+
+  // enumerate the active uniforms after linking and point the handles at their new locations
+  void reflectUniforms();
+
+  // glUniformBlockBinding() for a block. False if the block isn't there or its size is off
+  bool applyBlockBinding(const string& blockName, GLuint binding, GLsizeiptr expectedSize);
+
+  // location of an active uniform by name hash. -1 if it isn't active
+  GLint findUniformLocation(uint64_t nameHash) const;
+
+  // true if value differs from the last one set through handle and has to go to GL. Remembers it and counts either way
+  bool updateShadow(UniformHandle handle, const void* value, size_t size);
 
   // Program Handler
   GLint mProgramHandler{};
 
-  // Map to hold uniforms
-  std::map<string, GLint> mUniformLocations;
+  std::vector<ActiveUniform> mActiveUniforms{};
+
+  // handle -> location. Handles index into it
+  std::vector<GLint> mHandleLocations{};
+  std::vector<uint64_t> mHandleHashes{};
+  std::unordered_map<uint64_t, UniformHandle> mHandlesByHash{};
+
+  // value last set through each handle. size 0 means nothing was set since the last link
+  struct UniformShadow
+  {
+    alignas(16) uint8_t data[sizeof(glm::mat4)]{};
+    uint8_t size{};
+  };
+  std::vector<UniformShadow> mShadows{};
+
+  struct BlockBinding
+  {
+    string name{};
+    GLuint binding{};
+    GLsizeiptr expectedSize{};
+  };
+  std::vector<BlockBinding> mBlockBindings{};
+
+  uint32_t mUniformCalls{};
+  uint32_t mUniformsSkipped{};
+
+  ShaderFeatures mFeatures{};
+
+  // sources, for hot reloading
+  string mVertexFileName{};
+  string mFragmentFileName{};
+  std::vector<string> mIncludeFileNames{};
+  FileWatcher mSourceWatcher{};
+  bool mHotReload{};
+
+  // the rebuild in flight. The old program stays in use until it succeeded
+  struct PendingBuild
+  {
+    GLuint program{};
+    GLuint vertexShader{};
+    GLuint fragmentShader{};
+    uint64_t binaryKey{};
+    std::chrono::steady_clock::time_point changeTime{}; // when we saw the change
+  };
+  PendingBuild mPending{};
 
 };
 
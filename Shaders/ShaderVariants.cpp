@@ -0,0 +1,123 @@
+#include "ShaderVariants.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+ShaderVariants::ShaderVariants(const string& vsFileName, const string& fsFileName)
+  : mVertexFileName{ vsFileName }, mFragmentFileName{ fsFileName }
+{
+
+}
+
+ShaderProgram& ShaderVariants::get(ShaderFeatures features)
+{
+  std::unordered_map<ShaderFeatures, std::unique_ptr<ShaderProgram>>::iterator it = mVariants.find(features);
+  if (it != mVariants.end()) return *it->second;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::unique_ptr<ShaderProgram> program = std::make_unique<ShaderProgram>();
+  program->loadShaders(mVertexFileName.c_str(), mFragmentFileName.c_str(), features);
+  if (mHotReload) program->enableHotReload();
+
+  program->useProgram();
+  if (mOnBuilt) mOnBuilt(*program);
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Built shader variant 0x" << std::hex << features << std::dec << " in " << static_cast<int>(ms) << " ms" << std::endl;
+
+  ShaderProgram& variant = *program;
+  mVariants[features] = std::move(program);
+  return variant;
+}
+
+uint32_t ShaderVariants::prewarm(const string& manifestFileName)
+{
+  std::ifstream manifest(manifestFileName);
+  if (!manifest.is_open())
+  {
+    std::cerr << "Can't open shader variant manifest " << manifestFileName << std::endl;
+    return 0;
+  }
+
+  uint32_t count{};
+  for (string line{}; std::getline(manifest, line);)
+  {
+    const size_t comment = line.find('#');
+    if (comment != string::npos) line.resize(comment);
+
+    ShaderFeatures features{};
+    bool listed = false;
+    std::istringstream names(line);
+    for (string name{}; names >> name;)
+    {
+      listed = true;
+      if (name == "-") continue;
+
+      uint32_t bit = 0;
+      while (bit < SHADER_FEATURE_COUNT && name != SHADER_FEATURE_NAMES[bit]) bit++;
+      if (bit == SHADER_FEATURE_COUNT)
+      {
+        std::cerr << "Unknown shader feature '" << name << "' in " << manifestFileName << std::endl;
+        continue;
+      }
+      features |= 1u << bit;
+    }
+
+    if (!listed) continue;
+
+    get(features);
+    count++;
+  }
+  return count;
+}
+
+void ShaderVariants::enableHotReload()
+{
+  mHotReload = true;
+  for (std::pair<const ShaderFeatures, std::unique_ptr<ShaderProgram>>& variant : mVariants)
+  {
+    variant.second->enableHotReload();
+  }
+}
+
+void ShaderVariants::updateHotReload()
+{
+  for (std::pair<const ShaderFeatures, std::unique_ptr<ShaderProgram>>& variant : mVariants)
+  {
+    if (variant.second->updateHotReload())
+    {
+      variant.second->useProgram();
+      if (mOnBuilt) mOnBuilt(*variant.second);
+    }
+  }
+}
+
+uint32_t ShaderVariants::getUniformCalls() const
+{
+  uint32_t total{};
+  for (const std::pair<const ShaderFeatures, std::unique_ptr<ShaderProgram>>& variant : mVariants)
+  {
+    total += variant.second->getUniformCalls();
+  }
+  return total;
+}
+
+uint32_t ShaderVariants::getUniformsSkipped() const
+{
+  uint32_t total{};
+  for (const std::pair<const ShaderFeatures, std::unique_ptr<ShaderProgram>>& variant : mVariants)
+  {
+    total += variant.second->getUniformsSkipped();
+  }
+  return total;
+}
+
+void ShaderVariants::resetUniformCalls()
+{
+  for (std::pair<const ShaderFeatures, std::unique_ptr<ShaderProgram>>& variant : mVariants)
+  {
+    variant.second->resetUniformCalls();
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "ShaderProgram.h"
+#include "ShaderFeatures.h"
+
+// All permutations of one vertex + fragment shader pair, cached by feature bitmask
+// A variant is compiled the first time it's asked for. Variants we know we need can be built up front from a
+// manifest, so the first frame that uses them doesn't hitch. With the program binary cache either is cheap after
+// the first run
+//
+// Features select code with #ifdef, so a variant only contains the paths it uses (static branches)
+class ShaderVariants
+{
+public:
+
+  ShaderVariants(const string& vsFileName, const string& fsFileName);
+
+  ShaderVariants(const ShaderVariants&) = delete;
+  ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+  // called for every variant after it's built and after a hot reload swapped it. Bind uniform blocks,
+  // set samplers. The program is in use when it's called
+  void setOnBuilt(std::function<void(ShaderProgram&)> onBuilt) { mOnBuilt = std::move(onBuilt); };
+
+  // the variant with exactly these features. Compiles it if it's not there yet
+  ShaderProgram& get(ShaderFeatures features);
+
+  // build the variants listed in a manifest. One variant per line: feature names (SHADER_FEATURE_NAMES)
+  // separated by spaces, "-" for no features. "#" starts a comment, blank lines are skipped
+  // returns the number of variants listed. Unknown names are reported and ignored
+  uint32_t prewarm(const string& manifestFileName);
+
+  // watch the sources of all variants, including the ones built later
+  void enableHotReload();
+
+  // ShaderProgram::updateHotReload() for every variant. Calls the onBuilt callback for the ones that swapped
+  void updateHotReload();
+
+  size_t getVariantCount() const { return mVariants.size(); };
+
+  // sums over all variants. For the frame stats
+  uint32_t getUniformCalls() const;
+  uint32_t getUniformsSkipped() const;
+  void resetUniformCalls();
+
+private:
+
+  string mVertexFileName{};
+  string mFragmentFileName{};
+
+  std::function<void(ShaderProgram&)> mOnBuilt{};
+  bool mHotReload{};
+
+  // programs don't move, so references handed out by get() stay valid
+  std::unordered_map<ShaderFeatures, std::unique_ptr<ShaderProgram>> mVariants{};
+};
+
+#endif // !SHADER_VARIANTS_H
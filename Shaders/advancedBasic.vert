@@ -1,18 +1,56 @@
 #version 330 core
 
+#ifdef MULTI_DRAW
+// gl_DrawIDARB: which draw of a glMultiDrawElements* call this vertex belongs to. Without the extension
+// the engine draws one by one and moves drawDataBase instead
+#extension GL_ARB_shader_draw_parameters : enable
+#endif
+
 layout (location = 0) in vec3 pos; // for location of vertices (location = 0) 0 means location data
 layout (location = 1) in vec2 texCoordsData; // for location of texture UV (so vec2) (location = 1) because of interleaved memory pattern we use 1 means UV data
 
-// matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef INSTANCED
+// one model matrix per instance from the instance buffer (glVertexAttribDivisor 1). A mat4 takes 4 locations, one per column
+// location must match Mesh::INSTANCE_MODEL_LOCATION
+layout (location = 2) in mat4 instanceModel;
+#endif
+
+#ifdef MULTI_DRAW
+// per draw data of a multi-draw batch, one ObjectUniforms record (DRAW_DATA_TEXELS texels) per draw
+// DRAW_DATA_<MEMBER> is the texel of a member in it. ShaderProgram defines both from Core/UniformBlocks.h
+uniform samplerBuffer drawData;
+uniform int drawDataBase; // record of the batch's first draw
+flat out vec4 drawUvTransform;
+flat out float drawTextureLayer;
+#endif
+
+// matrices come in uniform blocks (uniform buffers) instead of single uniforms
+// ShaderProgram defines the blocks from the C++ structs in Core/UniformBlocks.h
+FRAME_BLOCK
+OBJECT_BLOCK
 
 out vec2 TexCoords; // will be passing out our tex coords to frag shader
 
 void main()
 {
+#if defined(MULTI_DRAW)
+#ifdef GL_ARB_shader_draw_parameters
+    int record = (drawDataBase + gl_DrawIDARB) * DRAW_DATA_TEXELS;
+#else
+    int record = drawDataBase * DRAW_DATA_TEXELS;
+#endif
+    int modelTexel = record + DRAW_DATA_MODEL;
+    mat4 objectModel = mat4(texelFetch(drawData, modelTexel), texelFetch(drawData, modelTexel + 1),
+        texelFetch(drawData, modelTexel + 2), texelFetch(drawData, modelTexel + 3));
+    drawUvTransform = texelFetch(drawData, record + DRAW_DATA_UV_TRANSFORM);
+    drawTextureLayer = texelFetch(drawData, record + DRAW_DATA_TEXTURE_LAYER).x;
+#elif defined(INSTANCED)
+    mat4 objectModel = instanceModel;
+#else
+    mat4 objectModel = model;
+#endif
+
     // get gl_Position in Normalized Device Coords. A right sequence of multiplication read from right to left
-    gl_Position = projection * view * model * vec4(pos, 1.0); // pos comes in in local space. Read from right to left, it's correct sequence to multiply
+    gl_Position = projection * view * objectModel * vec4(pos, 1.0); // pos comes in in local space. Read from right to left, it's correct sequence to multiply
     TexCoords = texCoordsData; // vertex shader just passes on tex coords
 };
\ No newline at end of file
@@ -6,8 +6,33 @@ out vec4 frag_color;
 uniform sampler2D texSampler; // sampler2D is a built-in type in GLSL
 uniform sampler2D texSampler2; // the second sampler to blend 2 textures
 uniform vec4 vertColor; // unifrom is a kind of var we have an access from any shader (think of this like global vars)
+uniform sampler2DArray texArraySampler; // texture array with the diffuse maps of several materials (its own texture unit)
+
+// per object data. ShaderProgram defines the block from Core/UniformBlocks.h
+OBJECT_BLOCK
+
+// multi-draw batches mix objects, so the per object values come from the vertex shader instead of ObjectBlock
+#ifdef MULTI_DRAW
+flat in vec4 drawUvTransform;
+flat in float drawTextureLayer;
+#define UV_TRANSFORM drawUvTransform
+#define TEXTURE_LAYER drawTextureLayer
+#else
+#define UV_TRANSFORM uvTransform
+#define TEXTURE_LAYER textureLayer
+#endif
+
 void main()
 {
+    // features are #defines set by ShaderProgram (see ShaderFeatures.h). Each combination is its own program
+#ifdef ATLAS
+    // textures repeat, but an atlas page must not repeat as a whole, so we wrap the UVs into our part of the page
+    // the mip level comes from the unwrapped UVs. The derivatives of fract() jump at every seam and would pick the smallest mip there
+    vec2 atlasCoords = UV_TRANSFORM.zw + fract(TexCoords) * UV_TRANSFORM.xy;
+    vec2 dx = dFdx(TexCoords) * UV_TRANSFORM.xy;
+    vec2 dy = dFdy(TexCoords) * UV_TRANSFORM.xy;
+#endif
+
     //frag_color = vec4(0.0f, 1.0f, 0.0f, 1.0f);
     //frag_color = vertColor;
 
@@ -19,5 +44,14 @@ void main()
 
     // blend two texture (mix() method in GLSL)
     // args: (texture 1 to blend, texture 2 to blend, how much to blend (from 0.0 to 1.0))
-    frag_color = mix(texture(texSampler, TexCoords), texture(texSampler2, TexCoords), 0.2);
+#if defined(TEXTURE_ARRAY) && defined(ATLAS)
+    vec4 diffuse = textureGrad(texArraySampler, vec3(atlasCoords, TEXTURE_LAYER), dx, dy);
+#elif defined(TEXTURE_ARRAY)
+    vec4 diffuse = texture(texArraySampler, vec3(TexCoords, TEXTURE_LAYER));
+#elif defined(ATLAS)
+    vec4 diffuse = textureGrad(texSampler, atlasCoords, dx, dy);
+#else
+    vec4 diffuse = texture(texSampler, TexCoords);
+#endif
+    frag_color = mix(diffuse, texture(texSampler2, TexCoords), 0.2);
 };
\ No newline at end of file
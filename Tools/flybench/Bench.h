@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+// Shared helpers of the flybench benchmarks. Every benchmark is a function in its own Bench*.cpp file
+// and is registered in the table in flybench.cpp
+
+struct BenchOptions
+{
+  std::filesystem::path root{ "." }; // project folder with Models/ and Textures/
+  uint32_t iterations{ 20 };
+};
+
+using BenchFunction = int (*)(const BenchOptions& options);
+
+struct BenchTiming
+{
+  double minMs{};
+  double avgMs{};
+  double maxMs{};
+};
+
+// run work() the given number of times and time every run. setup() runs before each run and isn't timed
+template <typename Setup, typename Work>
+BenchTiming measure(uint32_t iterations, Setup&& setup, Work&& work)
+{
+  BenchTiming timing{};
+  timing.minMs = 1e30;
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    setup();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    work();
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    timing.minMs = std::min(timing.minMs, ms);
+    timing.maxMs = std::max(timing.maxMs, ms);
+    timing.avgMs += ms / iterations;
+  }
+  return timing;
+}
+
+template <typename Work>
+BenchTiming measure(uint32_t iterations, Work&& work)
+{
+  return measure(iterations, []() {}, work);
+}
+
+// every image in <root>/Textures, sorted by name so runs are comparable
+std::vector<std::filesystem::path> findImages(const BenchOptions& options);
+
+// benchmarks
+int benchFlip(const BenchOptions& options);
+int benchDecode(const BenchOptions& options);
+int benchMips(const BenchOptions& options);
+int benchAtlas(const BenchOptions& options);
+int benchCull(const BenchOptions& options);
+int benchSort(const BenchOptions& options);
+int benchJobs(const BenchOptions& options);
+
+#endif // !BENCH_H
@@ -0,0 +1,75 @@
+// Atlas packing of the bundled textures with different gutters and page sizes
+// Reports how much of the page area holds texels, the build time (mip chains and blits included)
+// and the binds a frame needs to draw something with every texture: one per texture without the atlas,
+// one per page (plus one per texture too large for the atlas) with it
+
+#include <iostream>
+#include <iomanip>
+#include "Bench.h"
+#include "ImageDecodePool.h"
+#include "TextureAtlas.h"
+
+int benchAtlas(const BenchOptions& options)
+{
+  const std::vector<std::filesystem::path> images = findImages(options);
+  if (images.empty())
+  {
+    std::cerr << "No images in " << (options.root / "Textures").string() << std::endl;
+    return 1;
+  }
+
+  std::vector<ImageData> sources(images.size());
+  for (size_t i = 0; i < images.size(); i++)
+  {
+    if (!loadImageFile(images[i].string(), sources[i], false))
+    {
+      std::cerr << "Cannot decode " << images[i].string() << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << images.size() << " images" << std::endl;
+  std::cout << "  " << std::left << std::setw(8) << "page" << std::setw(8) << "max" << std::setw(8) << "gutter" << std::right
+    << std::setw(8) << "pages" << std::setw(8) << "packed" << std::setw(8) << "used" << std::setw(12) << "binds"
+    << std::setw(10) << "min ms" << std::setw(10) << "avg ms" << std::endl;
+
+  int result = 0;
+  for (uint32_t pageSize : { 1024u, 2048u })
+  {
+    for (uint32_t maxTextureSize : { 512u, 1024u })
+    {
+      if (maxTextureSize >= pageSize) continue;
+
+      for (uint32_t gutter : { 1u, 4u, 8u, 16u })
+      {
+        AtlasSettings settings{};
+        settings.pageSize = pageSize;
+        settings.maxTextureSize = maxTextureSize;
+        settings.gutter = gutter;
+
+        AtlasStats stats{};
+        uint32_t standalone{};
+        const BenchTiming timing = measure(options.iterations, [&]()
+        {
+          TextureAtlasBuilder builder(settings);
+          standalone = 0;
+          for (const ImageData& image : sources)
+          {
+            uint32_t id{};
+            if (!builder.add(image, id)) standalone++;
+          }
+          if (standalone < sources.size() && !builder.build()) result = 1;
+          stats = builder.getStats();
+        });
+
+        std::cout << std::fixed << std::setprecision(1)
+          << "  " << std::left << std::setw(8) << pageSize << std::setw(8) << maxTextureSize << std::setw(8) << gutter << std::right
+          << std::setw(8) << stats.pages << std::setw(8) << stats.textures << std::setw(7) << stats.getEfficiency() * 100.0 << "%"
+          << std::setw(5) << sources.size() << " -> " << std::left << std::setw(3) << stats.pages + standalone << std::right
+          << std::setprecision(3) << std::setw(10) << timing.minMs << std::setw(10) << timing.avgMs << std::endl;
+      }
+    }
+  }
+
+  return result;
+}
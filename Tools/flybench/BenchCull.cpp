@@ -0,0 +1,93 @@
+// Frustum culling throughput of the scalar, SSE and AVX kernels in Core/Culling
+// Objects are scattered in a 2 km cube around a camera with a 45 degree FOV looking down -z, so only a small part
+// of them (about 5%) is visible, like in a big open scene. Every path must agree on what's visible, or the benchmark fails
+//
+// Reported as objects per millisecond (best run), spheres and boxes separately
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include "Bench.h"
+#include "Culling.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace
+{
+  constexpr CullPath PATHS[] = { CullPath::SCALAR, CullPath::SSE, CullPath::AVX };
+
+  void printRow(const char* bounds, size_t count, CullPath path, const BenchTiming& timing, size_t visible)
+  {
+    const double objectsPerMs = timing.minMs > 0.0 ? count / timing.minMs : 0.0;
+    std::cout << std::fixed << std::setprecision(3)
+      << "  " << std::left << std::setw(10) << bounds << std::setw(8) << getCullPathName(path) << std::right
+      << std::setw(9) << count << std::setw(10) << timing.minMs << std::setw(10) << timing.avgMs
+      << std::setprecision(0) << std::setw(12) << objectsPerMs << std::setw(10) << visible << std::endl;
+  }
+}
+
+int benchCull(const BenchOptions& options)
+{
+  const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+  const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  const Frustum frustum = extractFrustum(projection * view);
+
+  std::cout << "  " << std::left << std::setw(10) << "bounds" << std::setw(8) << "path" << std::right
+    << std::setw(9) << "objects" << std::setw(10) << "min ms" << std::setw(10) << "avg ms"
+    << std::setw(12) << "objects/ms" << std::setw(10) << "visible" << std::endl;
+
+  int result = 0;
+  for (size_t count : { 10000u, 100000u, 1000000u })
+  {
+    // same seed for every size, so runs are comparable
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+    SphereBounds spheres{};
+    AabbBounds boxes{};
+    spheres.reserve(count);
+    boxes.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      const glm::vec3 center(position(random), position(random), position(random));
+      const glm::vec3 extent(size(random), size(random), size(random));
+      spheres.push_back(center, glm::length(extent));
+      boxes.push_back(center, extent);
+    }
+
+    std::vector<uint64_t> visible{}, reference{};
+    for (CullPath path : PATHS)
+    {
+      if (!isCullPathSupported(path)) continue;
+
+      size_t visibleCount{};
+      const BenchTiming timing = measure(options.iterations, [&]() { visibleCount = cullSpheres(frustum, spheres, visible, path); });
+      printRow("spheres", count, path, timing, visibleCount);
+
+      if (path == CullPath::SCALAR) reference = visible;
+      else if (visible != reference)
+      {
+        std::cerr << "  " << getCullPathName(path) << " sphere culling disagrees with the scalar kernel" << std::endl;
+        result = 1;
+      }
+    }
+
+    for (CullPath path : PATHS)
+    {
+      if (!isCullPathSupported(path)) continue;
+
+      size_t visibleCount{};
+      const BenchTiming timing = measure(options.iterations, [&]() { visibleCount = cullAabbs(frustum, boxes, visible, path); });
+      printRow("boxes", count, path, timing, visibleCount);
+
+      if (path == CullPath::SCALAR) reference = visible;
+      else if (visible != reference)
+      {
+        std::cerr << "  " << getCullPathName(path) << " box culling disagrees with the scalar kernel" << std::endl;
+        result = 1;
+      }
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,68 @@
+// Startup texture decode: all bundled textures decoded one after another (what Texture2D::loadTexture did
+// for each material) against ImageDecodePool with 1, 2, 4 and 8 worker threads
+// Times are wall clock from the first submit until the last image is back, thread startup included
+// Source images are decoded, cooked files are ignored
+
+#include <iostream>
+#include <iomanip>
+#include "Bench.h"
+#include "ImageDecodePool.h"
+
+int benchDecode(const BenchOptions& options)
+{
+  const std::vector<std::filesystem::path> images = findImages(options);
+  if (images.empty())
+  {
+    std::cerr << "No images in " << (options.root / "Textures").string() << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> paths{};
+  for (const std::filesystem::path& image : images) paths.push_back(image.string());
+
+  // a pool can't finish before its slowest image, so print that as the lower bound
+  double slowestImage{};
+  int result = 0;
+  const BenchTiming serial = measure(options.iterations, [&]()
+  {
+    ImageData image{};
+    for (const std::string& path : paths)
+    {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      if (!loadImageFile(path, image, false)) result = 1;
+      slowestImage = std::max(slowestImage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+  });
+
+  std::cout << paths.size() << " images, slowest single decode " << std::fixed << std::setprecision(3) << slowestImage << " ms" << std::endl;
+  std::cout << "  " << std::left << std::setw(10) << "threads" << std::right
+    << std::setw(10) << "min" << std::setw(10) << "avg" << std::setw(10) << "max" << std::setw(10) << "speedup" << std::endl;
+
+  const auto printRow = [&](const std::string& name, const BenchTiming& timing)
+  {
+    std::cout << std::fixed << std::setprecision(3)
+      << "  " << std::left << std::setw(10) << name << std::right
+      << std::setw(10) << timing.minMs << std::setw(10) << timing.avgMs << std::setw(10) << timing.maxMs
+      << std::setprecision(2) << std::setw(9) << serial.minMs / timing.minMs << "x" << std::endl;
+  };
+  printRow("serial", serial);
+
+  for (unsigned threads : { 1u, 2u, 4u, 8u })
+  {
+    const BenchTiming timing = measure(options.iterations, [&]()
+    {
+      ImageDecodePool pool(threads, false);
+      for (const std::string& path : paths) pool.submit(path);
+
+      // the engine uploads each image here, in the order they finish
+      DecodedImage decoded{};
+      while (pool.waitNext(decoded))
+      {
+        if (!decoded.loaded) result = 1;
+      }
+    });
+    printRow(std::to_string(threads), timing);
+  }
+
+  return result;
+}
@@ -0,0 +1,113 @@
+// Vertical flip of decoded images (stb_image returns the top row first, OpenGL wants the bottom row first)
+//
+//   bytewise    - the original Texture2D loop, one byte swap at a time
+//   scratch row - memcpy rows through a scratch buffer
+//   sse2 rows   - swap rows 16 bytes at a time in registers (flipImageVertically)
+//   copy        - flip while copying into another buffer (copyImageFlipped, what flycook does)
+//   on decode   - stbi_set_flip_vertically_on_load_thread. Only the whole decode can be timed, so decode and
+//                 decode+flip are reported and their minimums compared
+//
+// Cooked .flytex textures are flipped offline, so loading them doesn't flip at all
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include "Bench.h"
+#include "ImageData.h"
+#include "stb_image/stb_image.h"
+
+namespace
+{
+  void printRow(const char* variant, const BenchTiming& timing, size_t bytes)
+  {
+    // bytes of the image per run. For the flips that's the effective bandwidth, for the decodes the output rate
+    const double gigabytesPerSecond = timing.minMs > 0.0 ? bytes / (timing.minMs * 1e-3) / 1e9 : 0.0;
+    std::cout << std::fixed << std::setprecision(3)
+      << "  " << std::left << std::setw(12) << variant << std::right
+      << std::setw(10) << timing.minMs << std::setw(10) << timing.avgMs << std::setw(10) << timing.maxMs << " ms"
+      << std::setprecision(2) << std::setw(10) << gigabytesPerSecond << " GB/s" << std::endl;
+  }
+}
+
+int benchFlip(const BenchOptions& options)
+{
+  const std::vector<std::filesystem::path> images = findImages(options);
+  if (images.empty())
+  {
+    std::cerr << "No images in " << (options.root / "Textures").string() << std::endl;
+    return 1;
+  }
+
+  int result = 0;
+  for (const std::filesystem::path& path : images)
+  {
+    int width{}, height{}, components{};
+    stbi_set_flip_vertically_on_load_thread(0);
+    unsigned char* decoded = stbi_load(path.string().c_str(), &width, &height, &components, STBI_rgb_alpha);
+    if (decoded == nullptr)
+    {
+      std::cerr << "Cannot decode " << path.string() << std::endl;
+      result = 1;
+      continue;
+    }
+
+    const size_t size = static_cast<size_t>(width) * height * 4;
+    const std::vector<uint8_t> original(decoded, decoded + size);
+    stbi_image_free(decoded);
+
+    std::vector<uint8_t> expected = original;
+    flipImageVerticallyBytewise(expected.data(), width, height, 4);
+
+    std::cout << path.filename().string() << " (" << width << "x" << height << " RGBA, "
+      << std::fixed << std::setprecision(2) << size / (1024.0 * 1024.0) << " MB)" << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "variant" << std::right
+      << std::setw(10) << "min" << std::setw(10) << "avg" << std::setw(10) << "max" << std::endl;
+
+    // in-place variants get a fresh copy of the unflipped image before every run
+    std::vector<uint8_t> pixels{};
+    const auto reset = [&]() { pixels = original; };
+
+    BenchTiming timing = measure(options.iterations, reset, [&]() { flipImageVerticallyBytewise(pixels.data(), width, height, 4); });
+    printRow("bytewise", timing, size);
+
+    timing = measure(options.iterations, reset, [&]() { flipImageVerticallyScratchRow(pixels.data(), width, height, 4); });
+    printRow("scratch row", timing, size);
+    if (pixels != expected) { std::cerr << "  scratch row result differs" << std::endl; result = 1; }
+
+    timing = measure(options.iterations, reset, [&]() { flipImageVertically(pixels.data(), width, height, 4); });
+    printRow("sse2 rows", timing, size);
+    if (pixels != expected) { std::cerr << "  sse2 rows result differs" << std::endl; result = 1; }
+
+    std::vector<uint8_t> copy(size);
+    timing = measure(options.iterations, [&]() { copyImageFlipped(original.data(), copy.data(), width, height, 4); });
+    printRow("copy", timing, size);
+    if (copy != expected) { std::cerr << "  copy result differs" << std::endl; result = 1; }
+
+    // stb_image flips inside stbi_load, so the flip can't be timed on its own. Decode with and without it over all
+    // iterations and compare the minimums, which are the least noisy. The difference is signed: decode time varies
+    // by about as much as the flip costs, and a negative one means the flip was lost in that noise
+    const std::string filename = path.string();
+    const auto decode = [&](int flip)
+    {
+      stbi_set_flip_vertically_on_load_thread(flip);
+      int w{}, h{}, c{};
+      stbi_image_free(stbi_load(filename.c_str(), &w, &h, &c, STBI_rgb_alpha));
+    };
+
+    const BenchTiming plain = measure(options.iterations, [&]() { decode(0); });
+    printRow("decode", plain, size);
+    const BenchTiming onDecode = measure(options.iterations, [&]() { decode(1); });
+    printRow("decode+flip", onDecode, size);
+
+    stbi_set_flip_vertically_on_load_thread(1);
+    int w{}, h{}, c{};
+    unsigned char* flipped = stbi_load(filename.c_str(), &w, &h, &c, STBI_rgb_alpha);
+    if (flipped == nullptr || memcmp(flipped, expected.data(), size) != 0) { std::cerr << "  on decode result differs" << std::endl; result = 1; }
+    stbi_image_free(flipped);
+    stbi_set_flip_vertically_on_load_thread(0);
+
+    std::cout << std::fixed << std::setprecision(3) << "  (flip on decode " << onDecode.minMs - plain.minMs << " ms, min of decode+flip minus min of decode)" << std::endl;
+  }
+
+  return result;
+}
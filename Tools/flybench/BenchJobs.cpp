@@ -0,0 +1,122 @@
+// Job system: scheduling overhead and parallelFor scaling for 1, 2, 4 and all cores
+// "spawn" has one thread create 100k empty child jobs of a root and wait for it, so the others only get work by
+// stealing. "split" is a parallelFor over 100k elements with grain 1, which makes the same number of jobs but
+// spreads their creation over the workers. Both are reported as nanoseconds per job (best run)
+//
+// "transform" runs a parallelFor with automatic grain over 1M model matrices, like the per frame transform
+// update, and is reported as speedup over a plain loop. Every element must match the plain loop, or the benchmark fails
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include "Bench.h"
+#include "JobSystem.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace
+{
+  constexpr uint32_t JOB_COUNT = 100000;
+  constexpr uint32_t TRANSFORM_COUNT = 1000000;
+
+  // a test reports either ns/job or speedup. NONE prints "-" in the other column
+  constexpr double NONE = -1.0;
+
+  void printValue(double value, int precision)
+  {
+    if (value < 0.0) std::cout << std::setw(10) << "-";
+    else std::cout << std::setprecision(precision) << std::setw(10) << value;
+  }
+
+  void printRow(const char* test, unsigned threads, uint32_t count, const BenchTiming& timing, double perJobNs, double speedup)
+  {
+    std::cout << std::fixed << std::setprecision(3)
+      << "  " << std::left << std::setw(11) << test << std::right << std::setw(8) << threads
+      << std::setw(9) << count << std::setw(10) << timing.minMs << std::setw(10) << timing.avgMs;
+    printValue(perJobNs, 1);
+    printValue(speedup, 2);
+    std::cout << std::endl;
+  }
+
+  struct Transform
+  {
+    glm::vec3 position{};
+    float angle{};
+    float scale{};
+  };
+
+  glm::mat4 toMatrix(const Transform& transform)
+  {
+    glm::mat4 model = glm::translate(glm::mat4(), transform.position);
+    model = glm::rotate(model, transform.angle, glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::scale(model, glm::vec3(transform.scale));
+  }
+}
+
+int benchJobs(const BenchOptions& options)
+{
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned> threadCounts{};
+  for (unsigned threads : { 1u, 2u, 4u, cores })
+  {
+    if (threads <= cores && std::find(threadCounts.begin(), threadCounts.end(), threads) == threadCounts.end()) threadCounts.push_back(threads);
+  }
+
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> angle(0.0f, 6.28f);
+  std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+  std::vector<Transform> transforms(TRANSFORM_COUNT);
+  for (Transform& transform : transforms) transform = { glm::vec3(position(random), position(random), position(random)), angle(random), scale(random) };
+
+  std::vector<glm::mat4> reference(TRANSFORM_COUNT), models(TRANSFORM_COUNT);
+  const BenchTiming serial = measure(options.iterations, [&]()
+  {
+    for (uint32_t i = 0; i < TRANSFORM_COUNT; i++) reference[i] = toMatrix(transforms[i]);
+  });
+
+  std::cout << "  " << std::left << std::setw(11) << "test" << std::right << std::setw(8) << "threads"
+    << std::setw(9) << "jobs" << std::setw(10) << "min ms" << std::setw(10) << "avg ms"
+    << std::setw(10) << "ns/job" << std::setw(10) << "speedup" << std::endl;
+  printRow("transform", 0, TRANSFORM_COUNT, serial, NONE, 1.0);
+
+  int result = 0;
+  for (unsigned threads : threadCounts)
+  {
+    JobSystem jobs(threads);
+
+    const BenchTiming spawn = measure(options.iterations, [&]()
+    {
+      Job* root = jobs.createJob([]() {});
+      for (uint32_t i = 0; i < JOB_COUNT; i++) jobs.run(jobs.createChild(root, []() {}));
+      jobs.run(root);
+      jobs.wait(root);
+    });
+    printRow("spawn", threads, JOB_COUNT, spawn, spawn.minMs * 1e6 / JOB_COUNT, NONE);
+
+    const BenchTiming split = measure(options.iterations, [&]()
+    {
+      jobs.parallelFor(JOB_COUNT, [](uint32_t, uint32_t) {}, 1);
+    });
+    printRow("split", threads, JOB_COUNT, split, split.minMs * 1e6 / JOB_COUNT, NONE);
+
+    const BenchTiming transform = measure(options.iterations, [&]()
+    {
+      jobs.parallelFor(TRANSFORM_COUNT, [&](uint32_t begin, uint32_t end)
+      {
+        for (uint32_t i = begin; i < end; i++) models[i] = toMatrix(transforms[i]);
+      });
+    });
+    printRow("transform", threads, TRANSFORM_COUNT, transform, NONE, transform.minMs > 0.0 ? serial.minMs / transform.minMs : NONE);
+
+    if (models != reference)
+    {
+      std::cerr << "  parallelFor with " << threads << " threads doesn't match the plain loop" << std::endl;
+      result = 1;
+    }
+    std::fill(models.begin(), models.end(), glm::mat4(0.0f));
+  }
+
+  return result;
+}
@@ -0,0 +1,135 @@
+// Mip chains: what it costs at startup to have every bundled texture in memory with its full chain
+//   source    decode the source image and box filter the chain on the CPU. Stands in for glGenerateMipmap,
+//             which we can't time without a GL context (it runs on the driver thread or the GPU)
+//   read      read a cooked RGBA8 .flytex with the chain already in it
+//   mapped    map the same .flytex and touch every page
+// and what buildMipChain() costs in the cooker for every filter, on one thread and on one per core
+// The cooked files are written to the temp folder first, so they are in the OS file cache when they are read
+// That's the best case for reading. Cold starts pay the disk on top of both read and mapped
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include "Bench.h"
+#include "ImageDecodePool.h"
+#include "AssetFormats.h"
+
+int benchMips(const BenchOptions& options)
+{
+  const std::vector<std::filesystem::path> images = findImages(options);
+  if (images.empty())
+  {
+    std::cerr << "No images in " << (options.root / "Textures").string() << std::endl;
+    return 1;
+  }
+
+  // decode every source once, then cook it with the default settings into the temp folder
+  std::error_code error{};
+  const std::filesystem::path cookedDirectory = std::filesystem::temp_directory_path(error) / "flybench-mips";
+  std::vector<ImageData> sources(images.size());
+  std::vector<std::string> cookedPaths{};
+  uint64_t cookedBytes{};
+  for (size_t i = 0; i < images.size(); i++)
+  {
+    if (!loadImageFile(images[i].string(), sources[i], false))
+    {
+      std::cerr << "Cannot decode " << images[i].string() << std::endl;
+      return 1;
+    }
+
+    ImageData cooked = sources[i];
+    buildMipChain(cooked);
+    cookedPaths.push_back((cookedDirectory / images[i].filename()).replace_extension(".flytex").string());
+    if (!writeFlyTex(cookedPaths.back(), cooked, 0)) return 1;
+
+    for (const MipLevel& mip : cooked.mips) cookedBytes += mip.pixels.size();
+  }
+
+  int result = 0;
+  std::cout << images.size() << " images, " << std::fixed << std::setprecision(1) << cookedBytes / (1024.0 * 1024.0) << " MB with mips" << std::endl;
+  std::cout << "  " << std::left << std::setw(24) << "startup" << std::right
+    << std::setw(10) << "min" << std::setw(10) << "avg" << std::setw(10) << "max" << std::setw(10) << "speedup" << std::endl;
+
+  const auto printRow = [&](const std::string& name, const BenchTiming& timing, double baselineMs)
+  {
+    std::cout << std::fixed << std::setprecision(3)
+      << "  " << std::left << std::setw(24) << name << std::right
+      << std::setw(10) << timing.minMs << std::setw(10) << timing.avgMs << std::setw(10) << timing.maxMs
+      << std::setprecision(2) << std::setw(9) << baselineMs / timing.minMs << "x" << std::endl;
+  };
+
+  const BenchTiming source = measure(options.iterations, [&]()
+  {
+    ImageData image{};
+    for (const std::filesystem::path& path : images)
+    {
+      if (!loadImageFile(path.string(), image, false)) result = 1;
+      buildMipChainBox(image);
+    }
+  });
+  printRow("source + box mips", source, source.minMs);
+
+  const BenchTiming read = measure(options.iterations, [&]()
+  {
+    ImageData image{};
+    for (const std::string& path : cookedPaths)
+    {
+      if (!readFlyTex(path, image)) result = 1;
+    }
+  });
+  printRow("cooked, read", read, source.minMs);
+
+  const BenchTiming mapped = measure(options.iterations, [&]()
+  {
+    MappedFile file{};
+    ImageView view{};
+    for (const std::string& path : cookedPaths)
+    {
+      if (!mapFlyTex(path, file, view)) result = 1;
+      file.touchPages();
+    }
+  });
+  printRow("cooked, mapped", mapped, source.minMs);
+
+  // cook time. Gamma correct unless the name says linear
+  std::cout << "  " << std::left << std::setw(24) << "cook (all images)" << std::right
+    << std::setw(10) << "min" << std::setw(10) << "avg" << std::setw(10) << "max" << std::setw(10) << "vs box" << std::endl;
+
+  const BenchTiming box = measure(options.iterations, [&]()
+  {
+    for (ImageData& image : sources) buildMipChainBox(image);
+  });
+  printRow("2x2 box, sRGB", box, box.minMs);
+
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for (MipFilter filter : { MipFilter::BOX, MipFilter::TRIANGLE, MipFilter::CUBIC_BSPLINE, MipFilter::CATMULL_ROM, MipFilter::MITCHELL })
+  {
+    for (bool gammaCorrect : { true, false })
+    {
+      // linear is only interesting once, to see what the sRGB conversion costs
+      if (!gammaCorrect && filter != MipFilter::MITCHELL) continue;
+
+      for (unsigned threads : { 1u, cores })
+      {
+        MipChainSettings settings{};
+        settings.filter = filter;
+        settings.gammaCorrect = gammaCorrect;
+        settings.threadCount = threads;
+
+        const BenchTiming timing = measure(options.iterations, [&]()
+        {
+          for (ImageData& image : sources) buildMipChain(image, settings);
+        });
+
+        const std::string name = std::string(getMipFilterName(filter)) + (gammaCorrect ? "" : " linear") + ", " + std::to_string(threads) + " thr";
+        printRow(name, timing, box.minMs);
+
+        // one core: the second run would be the same
+        if (cores == 1) break;
+      }
+    }
+  }
+
+  std::filesystem::remove_all(cookedDirectory, error);
+  return result;
+}
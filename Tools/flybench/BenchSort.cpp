@@ -0,0 +1,83 @@
+// Sorting the render queue: RenderQueue's radix sort vs std::sort on the same packets
+// Two kinds of keys: "scene" keys look like a real frame (a few programs, a few hundred textures and meshes,
+// random depth), so most of the high bytes are shared and their passes are skipped. "random" keys use all 64 bits
+// and need all 8 passes. Both sorts must produce the same order, or the benchmark fails
+//
+// Reported as packets per millisecond (best run)
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include "Bench.h"
+#include "RenderQueue.h"
+
+namespace
+{
+  struct Packet
+  {
+    uint64_t key{};
+    uint32_t payload{};
+  };
+
+  void printRow(const char* keys, const char* sort, size_t count, const BenchTiming& timing)
+  {
+    const double packetsPerMs = timing.minMs > 0.0 ? count / timing.minMs : 0.0;
+    std::cout << std::fixed << std::setprecision(3)
+      << "  " << std::left << std::setw(8) << keys << std::setw(12) << sort << std::right
+      << std::setw(9) << count << std::setw(10) << timing.minMs << std::setw(10) << timing.avgMs
+      << std::setprecision(0) << std::setw(12) << packetsPerMs << std::endl;
+  }
+}
+
+int benchSort(const BenchOptions& options)
+{
+  std::cout << "  " << std::left << std::setw(8) << "keys" << std::setw(12) << "sort" << std::right
+    << std::setw(9) << "packets" << std::setw(10) << "min ms" << std::setw(10) << "avg ms"
+    << std::setw(12) << "packets/ms" << std::endl;
+
+  int result = 0;
+  for (const char* keys : { "scene", "random" })
+  {
+    const bool scene = keys[0] == 's';
+    for (size_t count : { 1000u, 10000u, 100000u, 1000000u })
+    {
+      // same seed for every size, so runs are comparable
+      std::mt19937_64 random(42);
+      std::vector<Packet> packets(count);
+      for (size_t i = 0; i < count; i++)
+      {
+        packets[i].payload = static_cast<uint32_t>(i);
+        packets[i].key = scene
+          ? RenderQueue::makeKey(0, random() % 4, random() % 300, random() % 600, random() % 400, random() % 65536)
+          : random();
+      }
+
+      RenderQueue queue{};
+      queue.reserve(count);
+      const BenchTiming radixTiming = measure(options.iterations,
+        [&]() { queue.clear(); for (const Packet& packet : packets) queue.push(packet.key, packet.payload); },
+        [&]() { queue.sort(); });
+      printRow(keys, "radix", count, radixTiming);
+
+      std::vector<Packet> sorted{};
+      const BenchTiming stdTiming = measure(options.iterations,
+        [&]() { sorted = packets; },
+        [&]() { std::sort(sorted.begin(), sorted.end(), [](const Packet& a, const Packet& b) { return a.key < b.key; }); });
+      printRow(keys, "std::sort", count, stdTiming);
+
+      // the radix sort is stable. Compare against a stable sort, so equal keys line up too
+      std::stable_sort(sorted.begin(), sorted.end(), [](const Packet& a, const Packet& b) { return a.key < b.key; });
+      for (size_t i = 0; i < count; i++)
+      {
+        if (queue.getKey(i) != sorted[i].key || queue.getPayload(i) != sorted[i].payload)
+        {
+          std::cerr << "  radix sort order differs from std::stable_sort at packet " << i << std::endl;
+          result = 1;
+          break;
+        }
+      }
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,98 @@
+// flybench - headless benchmarks for engine code that doesn't need a window
+// usage: flybench <benchmark|all> [--root <dir>] [--iterations <n>]
+
+#include <iostream>
+#include <string>
+#include <cctype>
+#include "Bench.h"
+
+namespace
+{
+  struct Benchmark
+  {
+    const char* name;
+    const char* description;
+    BenchFunction function;
+  };
+
+  const Benchmark BENCHMARKS[] =
+  {
+    { "flip", "vertical image flip variants on the bundled textures", benchFlip },
+    { "decode", "startup texture decode, serial vs ImageDecodePool with 1/2/4/8 threads", benchDecode },
+    { "mips", "startup with cooked mip chains (read and mapped) vs decode + box mips, mip filter cook times", benchMips },
+    { "atlas", "atlas packing efficiency, build time and bind reduction for page sizes and gutters", benchAtlas },
+    { "cull", "frustum culling of 10k to 1M spheres and boxes, scalar vs SSE vs AVX", benchCull },
+    { "sort", "render queue sort of 1k to 1M packets, radix vs std::sort, scene-like and random keys", benchSort },
+    { "jobs", "job system overhead in ns per job and parallelFor speedup with 1/2/4/all threads", benchJobs },
+  };
+
+  void printUsage()
+  {
+    std::cout << "usage: flybench <benchmark|all> [--root <dir>] [--iterations <n>]" << std::endl << std::endl;
+    for (const Benchmark& benchmark : BENCHMARKS)
+    {
+      std::cout << "  " << benchmark.name << ": " << benchmark.description << std::endl;
+    }
+  }
+}
+
+std::vector<std::filesystem::path> findImages(const BenchOptions& options)
+{
+  std::vector<std::filesystem::path> images{};
+
+  std::error_code error{};
+  for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(options.root / "Textures", error))
+  {
+    std::string extension = entry.path().extension().string();
+    for (char& c : extension) c = static_cast<char>(tolower(c));
+    if (extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".tga" || extension == ".bmp")
+    {
+      images.push_back(entry.path());
+    }
+  }
+
+  std::sort(images.begin(), images.end());
+  return images;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    printUsage();
+    return -1;
+  }
+
+  const std::string selected = argv[1];
+  BenchOptions options{};
+  for (int i = 2; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--root" && i + 1 < argc) options.root = argv[++i];
+    else if (arg == "--iterations" && i + 1 < argc) options.iterations = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+    else
+    {
+      printUsage();
+      return -1;
+    }
+  }
+
+  int result = 0;
+  bool found = false;
+  for (const Benchmark& benchmark : BENCHMARKS)
+  {
+    if (selected != "all" && selected != benchmark.name) continue;
+
+    found = true;
+    std::cout << "== " << benchmark.name << " ==" << std::endl;
+    result |= benchmark.function(options);
+    std::cout << std::endl;
+  }
+
+  if (!found)
+  {
+    printUsage();
+    return -1;
+  }
+  return result;
+}
@@ -0,0 +1,460 @@
+// flycook - offline asset cooker
+// Converts source assets into the runtime formats from Core/AssetFormats.h, so the engine
+// only has to read files and upload them at startup
+//
+//   Models/*.obj           -> Cooked/Models/*.flymesh  (indexed, vertex cache optimized)
+//   Textures/*.jpg|png|... -> Cooked/Textures/*.flytex (flipped for OpenGL, gamma correct mip chain, DXT1/DXT5 compressed)
+//
+// Inputs whose content hash matches the hash stored in the cooked file are skipped
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include "Hash.h"
+#include "MeshData.h"
+#include "ImageData.h"
+#include "AssetFormats.h"
+#include "TextureCompression.h"
+
+#include "stb_image/stb_image.h" // implemented in Core/ImageDecodePool.cpp
+
+namespace fs = std::filesystem;
+
+namespace
+{
+  enum class AssetType : uint8_t
+  {
+    MESH,
+    TEXTURE,
+  };
+
+  enum class CookStatus : uint8_t
+  {
+    COOKED,
+    SKIPPED,
+    FAILED,
+  };
+
+  struct CookJob
+  {
+    AssetType type{};
+    std::string sourcePath{}; // relative to the root, like the paths in main()
+    std::string cookedPath{};
+  };
+
+  struct CookResult
+  {
+    CookStatus status{ CookStatus::FAILED };
+    double milliseconds{};
+    uint64_t sourceBytes{};
+    uint64_t cookedBytes{};
+    std::string details{};
+  };
+
+  enum class Compression : uint8_t
+  {
+    AUTO, // DXT1 for opaque images, DXT5 for images with alpha
+    NONE,
+    DXT1,
+    DXT5,
+  };
+
+  struct Options
+  {
+    fs::path root{ "." };
+    fs::path output{};
+    unsigned threads{};
+    unsigned stageThreads{}; // of the mip and DXT stages inside one asset. threads split between the asset workers
+    bool force{};
+    Compression compression{ Compression::AUTO };
+    bool highQuality{};
+    MipFilter mipFilter{ MipFilter::MITCHELL };
+    bool linearMips{};
+  };
+
+  const char* COMPRESSION_NAMES[] = { "auto", "none", "dxt1", "dxt5" };
+
+  // settings that change the cooked output are part of the hash, so changing them re-cooks everything
+  std::string getMeshSettings()
+  {
+    return "flymesh v" + std::to_string(FLYMESH_VERSION) + " forsyth32";
+  }
+
+  std::string getTextureSettings(const Options& options)
+  {
+    return "flytex v" + std::to_string(FLYTEX_VERSION) + " mips-" + getMipFilterName(options.mipFilter)
+      + (options.linearMips ? "-linear " : "-srgb ") + COMPRESSION_NAMES[static_cast<int>(options.compression)]
+      + (options.highQuality ? " hq" : "");
+  }
+
+  const char* getFormatName(TextureFormat format)
+  {
+    switch (format)
+    {
+    case TextureFormat::DXT1: return "DXT1";
+    case TextureFormat::DXT5: return "DXT5";
+    default: return "RGBA8";
+    }
+  }
+
+  bool readFile(const fs::path& path, std::vector<uint8_t>& bytes)
+  {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in) return false;
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+  }
+
+  uint64_t fileSize(const std::string& path)
+  {
+    std::error_code error{};
+    const uintmax_t size = fs::file_size(path, error);
+    return error ? 0 : static_cast<uint64_t>(size);
+  }
+
+  // true if the cooked file was made from exactly this content with these settings
+  bool isUpToDate(const CookJob& job, uint64_t sourceHash)
+  {
+    uint64_t cookedHash{};
+    return readCookedSourceHash(job.cookedPath, cookedHash) && cookedHash == sourceHash;
+  }
+
+  CookResult cookMesh(const CookJob& job, const Options& options, uint64_t sourceHash)
+  {
+    CookResult result{};
+
+    MeshData mesh{};
+    if (!parseOBJ((options.root / job.sourcePath).string(), mesh))
+    {
+      result.details = "failed to parse OBJ";
+      return result;
+    }
+
+    const float acmrBefore = computeACMR(mesh);
+    optimizeMeshData(mesh);
+    const float acmrAfter = computeACMR(mesh);
+
+    if (!writeFlyMesh(job.cookedPath, mesh, sourceHash))
+    {
+      result.details = "failed to write";
+      return result;
+    }
+
+    std::ostringstream details;
+    details << std::fixed << std::setprecision(2)
+      << mesh.vertices.size() << " verts, " << mesh.indices.size() / 3 << " tris, "
+      << mesh.sections.size() << " sections, ACMR " << acmrBefore << " -> " << acmrAfter;
+
+    result.status = CookStatus::COOKED;
+    result.details = details.str();
+    return result;
+  }
+
+  CookResult cookTexture(const CookJob& job, const Options& options, const std::vector<uint8_t>& source, uint64_t sourceHash)
+  {
+    CookResult result{};
+
+    // decode from the bytes we already read for hashing
+    int width{}, height{}, components{};
+    unsigned char* pixels = stbi_load_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &components, STBI_rgb_alpha);
+    if (pixels == nullptr)
+    {
+      result.details = std::string("failed to decode: ") + stbi_failure_reason();
+      return result;
+    }
+
+    ImageData image{};
+    image.format = TextureFormat::RGBA8;
+    image.mips.resize(1);
+    image.mips[0].width = static_cast<uint32_t>(width);
+    image.mips[0].height = static_cast<uint32_t>(height);
+    image.mips[0].pixels.resize(static_cast<size_t>(width) * height * 4);
+
+    // the runtime uploads rows as they are, so flip once here instead of on every launch
+    // we copy out of stb's buffer anyway, so copying the rows bottom up costs nothing extra
+    copyImageFlipped(pixels, image.mips[0].pixels.data(), width, height, 4);
+    stbi_image_free(pixels);
+
+    // gamma correct and filtered with the chosen kernel. The driver's glGenerateMipmap is a plain box filter on the sRGB values
+    MipChainSettings mipSettings{};
+    mipSettings.filter = options.mipFilter;
+    mipSettings.gammaCorrect = !options.linearMips;
+    mipSettings.threadCount = options.stageThreads;
+
+    const std::chrono::steady_clock::time_point mipStart = std::chrono::steady_clock::now();
+    buildMipChain(image, mipSettings);
+    const double mipMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mipStart).count();
+
+    TextureFormat format = TextureFormat::RGBA8;
+    switch (options.compression)
+    {
+    case Compression::AUTO: format = hasTranslucentPixels(image) ? TextureFormat::DXT5 : TextureFormat::DXT1; break;
+    case Compression::DXT1: format = TextureFormat::DXT1; break;
+    case Compression::DXT5: format = TextureFormat::DXT5; break;
+    default: break;
+    }
+
+    std::ostringstream details;
+    details << width << "x" << height << ", " << image.mips.size() << " mips (" << getMipFilterName(options.mipFilter)
+      << ", " << std::fixed << std::setprecision(1) << mipMilliseconds << " ms), " << getFormatName(format);
+
+    ImageData compressed{};
+    if (isBlockCompressed(format))
+    {
+      uint64_t uncompressedBytes{}, compressedBytes{};
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      compressImage(image, format, compressed, options.stageThreads, options.highQuality);
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      for (size_t level = 0; level < image.mips.size(); level++)
+      {
+        uncompressedBytes += image.mips[level].pixels.size();
+        compressedBytes += compressed.mips[level].pixels.size();
+      }
+
+      // decode level 0 again to see what the GPU will actually sample
+      ImageData decoded{};
+      decompressImage(compressed, decoded);
+      const double psnr = computePSNR(image.mips[0], decoded.mips[0], format == TextureFormat::DXT5);
+
+      details << std::fixed << std::setprecision(1)
+        << " " << static_cast<double>(uncompressedBytes) / compressedBytes << ":1"
+        << " at " << uncompressedBytes / (1024.0 * 1024.0) / seconds << " MB/s"
+        << std::setprecision(2) << ", PSNR " << psnr << " dB";
+    }
+
+    if (!writeFlyTex(job.cookedPath, isBlockCompressed(format) ? compressed : image, sourceHash))
+    {
+      result.details = "failed to write";
+      return result;
+    }
+
+    result.status = CookStatus::COOKED;
+    result.details = details.str();
+    return result;
+  }
+
+  CookResult cook(const CookJob& job, const Options& options)
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    CookResult result{};
+    std::vector<uint8_t> source{};
+    if (!readFile(options.root / job.sourcePath, source))
+    {
+      result.details = "cannot read source";
+      return result;
+    }
+
+    const std::string settings = (job.type == AssetType::MESH) ? getMeshSettings() : getTextureSettings(options);
+    const uint64_t sourceHash = fnv1a64(source.data(), source.size(), fnv1a64(settings.c_str()));
+
+    if (!options.force && isUpToDate(job, sourceHash))
+    {
+      // the engine compares timestamps. Touch the cooked file, so an unchanged but re-saved source doesn't make it look stale
+      std::error_code error{};
+      fs::last_write_time(job.cookedPath, fs::file_time_type::clock::now(), error);
+
+      result.status = CookStatus::SKIPPED;
+      result.details = "unchanged";
+    }
+    else if (job.type == AssetType::MESH)
+    {
+      result = cookMesh(job, options, sourceHash);
+    }
+    else
+    {
+      result = cookTexture(job, options, source, sourceHash);
+    }
+
+    result.sourceBytes = source.size();
+    result.cookedBytes = fileSize(job.cookedPath);
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+  }
+
+  bool isImage(const fs::path& path)
+  {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".tga" || extension == ".bmp";
+  }
+
+  bool isMesh(const fs::path& path)
+  {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+    return extension == ".obj";
+  }
+
+  // walk <root>/<folder> and add a job for every file the filter accepts
+  void collectJobs(const Options& options, const char* folder, AssetType type, bool (*filter)(const fs::path&), std::vector<CookJob>& jobs)
+  {
+    const fs::path directory = options.root / folder;
+    std::error_code error{};
+    if (!fs::is_directory(directory, error))
+    {
+      std::cerr << "flycook: " << directory.string() << " not found, skipping" << std::endl;
+      return;
+    }
+
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(directory))
+    {
+      if (!entry.is_regular_file() || !filter(entry.path())) continue;
+
+      CookJob job{};
+      job.type = type;
+      job.sourcePath = fs::relative(entry.path(), options.root).generic_string();
+      job.cookedPath = getCookedPath(job.sourcePath, options.output.generic_string());
+      jobs.push_back(job);
+    }
+  }
+
+  std::string formatBytes(uint64_t bytes)
+  {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (bytes >= 1024 * 1024) out << bytes / (1024.0 * 1024.0) << " MB";
+    else if (bytes >= 1024) out << bytes / 1024.0 << " KB";
+    else out << bytes << " B";
+    return out.str();
+  }
+
+  void printUsage()
+  {
+    std::cout
+      << "usage: flycook [--root <dir>] [--out <dir>] [--threads <n>] [--force] [--compression auto|none|dxt1|dxt5] [--high-quality]\n"
+      << "               [--mip-filter box|triangle|bspline|catmullrom|mitchell] [--linear-mips]\n"
+      << "  --root     project folder with Models/ and Textures/ (default: .)\n"
+      << "  --out      output folder (default: <root>/Cooked)\n"
+      << "  --threads  worker threads (default: one per core)\n"
+      << "  --force    cook everything, even unchanged inputs\n"
+      << "  --compression\n"
+      << "             texture format (default: auto = DXT1 for opaque images, DXT5 for images with alpha)\n"
+      << "  --high-quality\n"
+      << "             extra refinement steps in the DXT encoder (~30-40% slower)\n"
+      << "  --mip-filter\n"
+      << "             resampling filter of the mip chain (default: mitchell)\n"
+      << "  --linear-mips\n"
+      << "             filter the sRGB values directly instead of converting to linear first (darker small mips)" << std::endl;
+  }
+
+  bool parseOptions(int argc, char** argv, Options& options)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const std::string arg = argv[i];
+      if (arg == "--root" && i + 1 < argc) options.root = argv[++i];
+      else if (arg == "--out" && i + 1 < argc) options.output = argv[++i];
+      else if (arg == "--threads" && i + 1 < argc)
+      {
+        // a plain decimal number. strtoul would also take a sign and stop at junk, so check both
+        const char* value = argv[++i];
+        char* end{};
+        const unsigned long threads = std::strtoul(value, &end, 10);
+        if (!std::isdigit(static_cast<unsigned char>(value[0])) || *end != '\0' || threads > UINT32_MAX) return false;
+        options.threads = static_cast<unsigned>(threads);
+      }
+      else if (arg == "--force") options.force = true;
+      else if (arg == "--high-quality") options.highQuality = true;
+      else if (arg == "--linear-mips") options.linearMips = true;
+      else if (arg == "--mip-filter" && i + 1 < argc)
+      {
+        if (!parseMipFilter(argv[++i], options.mipFilter)) return false;
+      }
+      else if (arg == "--compression" && i + 1 < argc)
+      {
+        const std::string name = argv[++i];
+        const auto found = std::find(std::begin(COMPRESSION_NAMES), std::end(COMPRESSION_NAMES), name);
+        if (found == std::end(COMPRESSION_NAMES)) return false;
+        options.compression = static_cast<Compression>(found - std::begin(COMPRESSION_NAMES));
+      }
+      else return false;
+    }
+
+    if (options.output.empty()) options.output = options.root / "Cooked";
+    if (options.threads == 0) options.threads = std::max(1u, std::thread::hardware_concurrency());
+    return true;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  Options options{};
+  if (!parseOptions(argc, argv, options))
+  {
+    printUsage();
+    return -1;
+  }
+
+  std::vector<CookJob> jobs{};
+  collectJobs(options, "Models", AssetType::MESH, isMesh, jobs);
+  collectJobs(options, "Textures", AssetType::TEXTURE, isImage, jobs);
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  // every worker grabs the next job until there are none left
+  // jobs are independent files, so there is nothing to synchronize except the job counter
+  std::vector<CookResult> results(jobs.size());
+  std::atomic<size_t> nextJob{ 0 };
+  const unsigned workerCount = std::min<unsigned>(options.threads, static_cast<unsigned>(std::max<size_t>(jobs.size(), 1)));
+
+  // the stages of a texture start threads of their own. Give each worker its share, so there are about
+  // options.threads threads in total instead of options.threads squared
+  options.stageThreads = std::max(1u, options.threads / workerCount);
+
+  std::vector<std::thread> workers{};
+  for (unsigned i = 0; i < workerCount; i++)
+  {
+    workers.emplace_back([&]()
+    {
+      for (size_t job = nextJob++; job < jobs.size(); job = nextJob++)
+      {
+        results[job] = cook(jobs[job], options);
+      }
+    });
+  }
+  for (std::thread& worker : workers) worker.join();
+
+  const double totalMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  // report in job order, so the output is stable no matter which thread finished first
+  uint32_t cooked{}, skipped{}, failed{};
+  uint64_t sourceBytes{}, cookedBytes{};
+  std::cout << std::endl;
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    const CookResult& result = results[i];
+    const char* status = result.status == CookStatus::COOKED ? "cooked " : result.status == CookStatus::SKIPPED ? "skipped" : "FAILED ";
+
+    std::cout << std::fixed << std::setprecision(1)
+      << "[" << status << "] " << std::left << std::setw(32) << jobs[i].sourcePath << std::right
+      << std::setw(9) << result.milliseconds << " ms  "
+      << std::setw(9) << formatBytes(result.sourceBytes) << " -> " << std::setw(9) << formatBytes(result.cookedBytes)
+      << "  " << result.details << std::endl;
+
+    if (result.status == CookStatus::COOKED) cooked++;
+    else if (result.status == CookStatus::SKIPPED) skipped++;
+    else failed++;
+
+    sourceBytes += result.sourceBytes;
+    cookedBytes += result.cookedBytes;
+  }
+
+  std::cout << std::endl << std::fixed << std::setprecision(1)
+    << jobs.size() << " assets: " << cooked << " cooked, " << skipped << " skipped, " << failed << " failed in "
+    << totalMilliseconds << " ms on " << workerCount << " threads ("
+    << formatBytes(sourceBytes) << " -> " << formatBytes(cookedBytes) << ")" << std::endl;
+
+  return failed == 0 ? 0 : 1;
+}